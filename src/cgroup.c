@@ -0,0 +1,413 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Functions for resource accounting using cgroup v2.
+ *
+ * Copyright IBM Corp. 2023
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "cgroup.h"
+#include "misc.h"
+
+/* Maximum time to wait for processes to leave a group in milliseconds. */
+#define CG_TIMEOUT_MS	5000
+
+/* Interval for checking if processes left a group in milliseconds. */
+#define CG_POLL_MS	10
+
+/* Return the mount point of the cgroup v2 hierarchy, or %NULL if it is not
+ * mounted. */
+static char *cg_mountpoint(void)
+{
+	char *line = NULL, *mnt = NULL, *sep;
+	size_t n = 0;
+	FILE *fd;
+
+	fd = fopen("/proc/self/mountinfo", "r");
+	if (!fd)
+		return NULL;
+	while (getline(&line, &n, fd) != -1) {
+		sep = strstr(line, " - ");
+		if (!sep || !misc_starts_with(sep + 3, "cgroup2 "))
+			continue;
+		if (sscanf(line, "%*s %*s %*s %*s %ms", &mnt) == 1)
+			break;
+	}
+	free(line);
+	fclose(fd);
+
+	return mnt;
+}
+
+/* Return the path of the cgroup v2 group of the calling process relative to
+ * the hierarchy mount point, or %NULL if it cannot be determined. */
+static char *cg_self(void)
+{
+	char *line = NULL, *path = NULL;
+	size_t n = 0;
+	FILE *fd;
+
+	fd = fopen("/proc/self/cgroup", "r");
+	if (!fd)
+		return NULL;
+	while (getline(&line, &n, fd) != -1) {
+		if (misc_starts_with(line, "0::/")) {
+			misc_chomp(line);
+			path = misc_strdup(line + 3);
+			break;
+		}
+	}
+	free(line);
+	fclose(fd);
+
+	return path;
+}
+
+/* Open file @name in group directory @dir for reading. */
+static FILE *cg_open(const char *dir, const char *name)
+{
+	char *path;
+	FILE *fd;
+
+	path = misc_asprintf("%s/%s", dir, name);
+	fd = fopen(path, "r");
+	free(path);
+
+	return fd;
+}
+
+/* Return the first line of file @name in group directory @dir, or %NULL if
+ * the file cannot be read. */
+static char *cg_read_line(const char *dir, const char *name)
+{
+	char *line = NULL;
+	size_t n = 0;
+	FILE *fd;
+
+	fd = cg_open(dir, name);
+	if (!fd)
+		return NULL;
+	if (getline(&line, &n, fd) == -1) {
+		free(line);
+		line = NULL;
+	} else {
+		misc_chomp(line);
+	}
+	fclose(fd);
+
+	return line;
+}
+
+/* Write formatted string to file @name in group directory @dir. Return %true
+ * on success. */
+static bool cg_write(const char *dir, const char *name, const char *fmt, ...)
+{
+	char *path;
+	bool rc;
+	int fd;
+	get_varargs(fmt, str);
+
+	path = misc_asprintf("%s/%s", dir, name);
+	fd = open(path, O_WRONLY | O_CLOEXEC);
+	rc = fd != -1 && write(fd, str, strlen(str)) == (ssize_t) strlen(str);
+	if (fd != -1)
+		close(fd);
+	free(path);
+	free(str);
+
+	return rc;
+}
+
+/**
+ * cg_create - Create a transient cgroup
+ * @cg: Group data to initialize
+ * @name: Name of group
+ *
+ * Create a cgroup v2 group named @name as child of the group of the calling
+ * process. Return %true on success, %false if cgroup v2 is not available or
+ * the group cannot be created.
+ *
+ * Note: Resource controllers are not enabled by this function because this
+ * would change the configuration of the parent group for the whole system.
+ * Statistics of a controller are only available if the controller is already
+ * enabled for child groups of the parent group. Due to the cgroup v2 "no
+ * internal processes" rule, this is only possible for domain controllers such
+ * as memory, io and pids if the parent group is the root group, since it
+ * contains the calling process.
+ */
+bool cg_create(struct cg_group *cg, const char *name)
+{
+	char *mnt, *self, *path;
+
+	memset(cg, 0, sizeof(*cg));
+	cg->procs_fd = -1;
+
+	mnt = cg_mountpoint();
+	self = cg_self();
+	if (!mnt || !self) {
+		debug("%s: cgroup v2 not available\n", __func__);
+		goto err;
+	}
+
+	cg->parent = misc_asprintf("%s%s", mnt, strcmp(self, "/") == 0 ?
+				   "" : self);
+	cg->path = misc_asprintf("%s/%s", cg->parent, name);
+
+	/* Remove stale group left behind by a previous process. */
+	if (mkdir(cg->path, 0755) == -1 &&
+	    (errno != EEXIST || rmdir(cg->path) == -1 ||
+	     mkdir(cg->path, 0755) == -1)) {
+		debug("%s: could not create %s: %s\n", __func__, cg->path,
+		      strerror(errno));
+		goto err;
+	}
+
+	path = misc_asprintf("%s/cgroup.procs", cg->path);
+	cg->procs_fd = open(path, O_WRONLY | O_CLOEXEC);
+	free(path);
+	if (cg->procs_fd == -1) {
+		rmdir(cg->path);
+		goto err;
+	}
+
+	free(self);
+	free(mnt);
+
+	return true;
+
+err:
+	free(self);
+	free(mnt);
+	free(cg->path);
+	free(cg->parent);
+	cg->path = NULL;
+	cg->parent = NULL;
+
+	return false;
+}
+
+/* Move the calling process to group @cg. Intended to be called by a child
+ * process after fork(). */
+void cg_enter(struct cg_group *cg)
+{
+	if (write(cg->procs_fd, "0", 1) == -1)
+		debug("%s: could not enter %s: %s\n", __func__, cg->path,
+		      strerror(errno));
+}
+
+/* Return the value of key=value pair @key in @str, or 0 if not found. */
+static uint64_t cg_keyval(const char *str, const char *key)
+{
+	const char *s;
+
+	s = strstr(str, key);
+	if (!s || (s != str && s[-1] != ' ') || s[strlen(key)] != '=')
+		return 0;
+
+	return strtoull(s + strlen(key) + 1, NULL, 10);
+}
+
+/* Read a single number from file @name in @cg into @value. Return %true
+ * on success. */
+static bool cg_read_u64(struct cg_group *cg, const char *name,
+			uint64_t *value)
+{
+	char *line, *end;
+	bool rc;
+
+	line = cg_read_line(cg->path, name);
+	if (!line)
+		return false;
+	*value = strtoull(line, &end, 10);
+	rc = end != line;
+	free(line);
+
+	return rc;
+}
+
+/* Call @fn for each process ID listed in the cgroup.procs file of @cg.
+ * Return the number of processes. */
+static int cg_for_each_pid(struct cg_group *cg,
+			   void (*fn)(struct cg_group *, pid_t))
+{
+	char *line = NULL;
+	size_t n = 0;
+	int num = 0;
+	FILE *fd;
+
+	fd = cg_open(cg->path, "cgroup.procs");
+	if (!fd)
+		return 0;
+	while (getline(&line, &n, fd) != -1) {
+		if (fn)
+			fn(cg, atoi(line));
+		num++;
+	}
+	free(line);
+	fclose(fd);
+
+	return num;
+}
+
+/**
+ * cg_sample - Get current resource usage of a cgroup
+ * @cg: Group data
+ * @usage: Resulting resource usage
+ *
+ * Read only the CPU time, current memory usage and I/O statistics of
+ * processes in @cg. This is intended for frequent calls during periodic
+ * sampling where the full set of statistics provided by cg_read() is not
+ * needed. Other fields of @usage are set to 0.
+ */
+void cg_sample(struct cg_group *cg, struct cg_usage *usage)
+{
+	char *line = NULL, key[32];
+	unsigned long long value;
+	size_t n = 0;
+	FILE *fd;
+
+	memset(usage, 0, sizeof(*usage));
+
+	fd = cg_open(cg->path, "cpu.stat");
+	if (fd) {
+		while (getline(&line, &n, fd) != -1) {
+			if (sscanf(line, "%31s %llu", key, &value) != 2)
+				continue;
+			if (strcmp(key, "usage_usec") == 0) {
+				usage->usage_usec = value;
+				usage->cpu_valid = true;
+			} else if (strcmp(key, "user_usec") == 0) {
+				usage->user_usec = value;
+			} else if (strcmp(key, "system_usec") == 0) {
+				usage->system_usec = value;
+			}
+		}
+		fclose(fd);
+	}
+
+	/* Sum up I/O statistics of all devices. */
+	fd = cg_open(cg->path, "io.stat");
+	if (fd) {
+		while (getline(&line, &n, fd) != -1) {
+			usage->rbytes += cg_keyval(line, "rbytes");
+			usage->wbytes += cg_keyval(line, "wbytes");
+			usage->rios += cg_keyval(line, "rios");
+			usage->wios += cg_keyval(line, "wios");
+		}
+		usage->io_valid = true;
+		fclose(fd);
+	}
+	free(line);
+
+	cg_read_u64(cg, "memory.current", &usage->memory_current);
+}
+
+/* Get resource usage of processes in @cg and store it in @usage. */
+void cg_read(struct cg_group *cg, struct cg_usage *usage)
+{
+	cg_sample(cg, usage);
+	usage->memory_valid = cg_read_u64(cg, "memory.peak",
+					  &usage->memory_peak);
+	usage->pids_valid = cg_read_u64(cg, "pids.peak", &usage->pids_peak);
+	usage->leftover = cg_for_each_pid(cg, NULL);
+}
+
+static void cg_kill_pid(struct cg_group *cg, pid_t pid)
+{
+	kill(pid, SIGKILL);
+}
+
+static void cg_move_pid(struct cg_group *cg, pid_t pid)
+{
+	cg_write(cg->parent, "cgroup.procs", "%d", pid);
+}
+
+/**
+ * cg_release - Remove a transient cgroup
+ * @cg: Group data
+ * @kill: If set, kill processes remaining in @cg
+ *
+ * Processes remaining in @cg are killed if @kill is set, or moved to the
+ * parent group otherwise. Release all resources associated with @cg.
+ */
+void cg_release(struct cg_group *cg, bool kill)
+{
+	int ms;
+
+	if (!cg->path)
+		return;
+	close(cg->procs_fd);
+
+	for (ms = 0; rmdir(cg->path) == -1; ms += CG_POLL_MS) {
+		if (errno != EBUSY || ms >= CG_TIMEOUT_MS) {
+			warn("Could not remove cgroup %s", cg->path);
+			break;
+		}
+		if (kill) {
+			/* cgroup.kill is only available with kernel 5.14
+			 * and later. */
+			if (!cg_write(cg->path, "cgroup.kill", "1"))
+				cg_for_each_pid(cg, cg_kill_pid);
+		} else {
+			cg_for_each_pid(cg, cg_move_pid);
+		}
+		usleep(CG_POLL_MS * 1000);
+	}
+
+	free(cg->path);
+	free(cg->parent);
+	cg->path = NULL;
+	cg->parent = NULL;
+}
+
+/* Print @usec microseconds as milliseconds. */
+static void cg_print_ms(FILE *fd, const char *name, uint64_t usec, int indent)
+{
+	fprintf(fd, "%*s%s: %llu.%03llu\n", indent, "", name,
+		(unsigned long long) usec / 1000,
+		(unsigned long long) usec % 1000);
+}
+
+/* Print resource usage in @usage indented by @indent spaces. */
+void cg_print(FILE *fd, struct cg_usage *usage, int indent)
+{
+	if (usage->cpu_valid) {
+		cg_print_ms(fd, "cpu_usage_ms", usage->usage_usec, indent);
+		cg_print_ms(fd, "cpu_user_ms", usage->user_usec, indent);
+		cg_print_ms(fd, "cpu_system_ms", usage->system_usec, indent);
+	}
+	if (usage->memory_valid) {
+		fprintf(fd, "%*smemory_peak_kb: %llu\n", indent, "",
+			(unsigned long long) usage->memory_peak / 1024);
+	}
+	if (usage->io_valid) {
+		fprintf(fd, "%*sio_rbytes: %llu\n", indent, "",
+			(unsigned long long) usage->rbytes);
+		fprintf(fd, "%*sio_wbytes: %llu\n", indent, "",
+			(unsigned long long) usage->wbytes);
+		fprintf(fd, "%*sio_rios: %llu\n", indent, "",
+			(unsigned long long) usage->rios);
+		fprintf(fd, "%*sio_wios: %llu\n", indent, "",
+			(unsigned long long) usage->wios);
+	}
+	if (usage->pids_valid) {
+		fprintf(fd, "%*spids_peak: %llu\n", indent, "",
+			(unsigned long long) usage->pids_peak);
+	}
+	if (usage->leftover > 0) {
+		fprintf(fd, "%*sleftover_procs: %d\n", indent, "",
+			usage->leftover);
+	}
+}
@@ -0,0 +1,70 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Functions for resource accounting using cgroup v2.
+ *
+ * Copyright IBM Corp. 2023
+ */
+
+#ifndef CGROUP_H
+#define CGROUP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * struct cg_group - A transient cgroup v2 group
+ * @path: Path to group directory
+ * @parent: Path to directory of parent group
+ * @procs_fd: File descriptor of cgroup.procs file of group
+ */
+struct cg_group {
+	char *path;
+	char *parent;
+	int procs_fd;
+};
+
+/**
+ * struct cg_usage - Resource usage of a cgroup
+ * @cpu_valid: Flag indicating that CPU usage fields are valid
+ * @usage_usec: Total CPU time in microseconds
+ * @user_usec: CPU time spent in user mode in microseconds
+ * @system_usec: CPU time spent in kernel mode in microseconds
+ * @memory_valid: Flag indicating that @memory_peak is valid
+ * @memory_peak: Maximum memory usage in bytes
+ * @memory_current: Current memory usage in bytes (0 if not available)
+ * @io_valid: Flag indicating that I/O fields are valid
+ * @rbytes: Number of bytes read from block devices
+ * @wbytes: Number of bytes written to block devices
+ * @rios: Number of block device read operations
+ * @wios: Number of block device write operations
+ * @pids_valid: Flag indicating that @pids_peak is valid
+ * @pids_peak: Maximum number of processes
+ * @leftover: Number of processes that were still running at test end
+ */
+struct cg_usage {
+	bool cpu_valid;
+	uint64_t usage_usec;
+	uint64_t user_usec;
+	uint64_t system_usec;
+	bool memory_valid;
+	uint64_t memory_peak;
+	uint64_t memory_current;
+	bool io_valid;
+	uint64_t rbytes;
+	uint64_t wbytes;
+	uint64_t rios;
+	uint64_t wios;
+	bool pids_valid;
+	uint64_t pids_peak;
+	int leftover;
+};
+
+bool cg_create(struct cg_group *cg, const char *name);
+void cg_enter(struct cg_group *cg);
+void cg_read(struct cg_group *cg, struct cg_usage *usage);
+void cg_sample(struct cg_group *cg, struct cg_usage *usage);
+void cg_release(struct cg_group *cg, bool kill);
+void cg_print(FILE *fd, struct cg_usage *usage, int indent);
+
+#endif /* CGROUP_H */
@@ -20,14 +20,17 @@ static void set_defaults(struct config_t *cfg)
 {
 	cfg->plan = -1;
 	cfg->large_temp = 0;
+	cfg->output_limit = -1;
+	cfg->perf = -1;
+	cfg->perf_events = NULL;
 	cfg->desc = NULL;
 }
 
 void config_parse(struct config_t *cfg, struct yaml_node *root)
 {
-	struct yaml_node *plan, *node, *test;
+	struct yaml_node *plan, *node, *test, *limit, *perf;
 	char *v;
-	int i;
+	int i, num;
 
 	set_defaults(cfg);
 	if (!root)
@@ -76,6 +79,52 @@ void config_parse(struct config_t *cfg, struct yaml_node *root)
 	if (v)
 		cfg->large_temp = atoi(v);
 
+	/*
+	 * output_limit: <size>
+	 *   Maximum number of bytes to keep from the beginning and from the end
+	 *   of test output. 0 means no limit.
+	 */
+	limit = yaml_get_node(root, "test/output_limit");
+	if (limit) {
+		v = yaml_get_scalar(root, "test/output_limit");
+		if (!v || !misc_parse_size(v, &cfg->output_limit)) {
+			twarn(limit->filename, limit->lineno,
+			      "Invalid output limit, expect size value");
+			cfg->output_limit = -1;
+		}
+	}
+
+	/*
+	 * perf: 0|1|<sequence of event names>
+	 *   Count performance events while running the test executable. If 1,
+	 *   count a default set of events.
+	 */
+	perf = yaml_get_node(root, "test/perf/");
+	if (perf && perf->type == yaml_scalar) {
+		cfg->perf = atoi(perf->scalar.content);
+	} else if (perf && perf->type == yaml_seq) {
+		num = 0;
+		yaml_for_each(node, perf) {
+			if (!node->seq.content ||
+			    node->seq.content->type != yaml_scalar) {
+				twarn(node->filename, node->lineno,
+				      "Wrong type, expect event name");
+				continue;
+			}
+			v = node->seq.content->scalar.content;
+			misc_expand_array(&cfg->perf_events, &num);
+			cfg->perf_events[num - 1] = misc_strdup(v);
+		}
+		misc_expand_array(&cfg->perf_events, &num);
+		cfg->perf_events[num - 1] = NULL;
+		cfg->perf = 1;
+	} else if (perf) {
+		twarn(perf->filename, perf->lineno,
+		      "Wrong type, expect either sequence or scalar");
+	}
+	if (perf)
+		yaml_set_handled(perf);
+
 	// test should not contain anything besides plan
 	yaml_check_unhandled(test);
 }
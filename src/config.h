@@ -15,6 +15,9 @@ struct yaml_node;
 struct config_t {
 	int plan;
 	bool large_temp;
+	long output_limit;
+	int perf;
+	char **perf_events;
 	struct yaml_node *desc;
 };
 
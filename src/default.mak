@@ -69,6 +69,19 @@ help:
 	@echo "  PCIFMT=fid|uid  Control PCI ID format to use for 'make telarc' (default: fid)"
 	@echo "  RUNLOG=<path>   Write unprocessed test output to <path>"
 	@echo "  RESFAIL=0|1     Control exit on missing .telarc resource (default: 0)"
+	@echo "  OUTPUT_LIMIT=<size> Only log first and last <size> bytes of test output"
+	@echo "  OUTPUT_SPILL=1  Store full output of truncated tests in DATA archive"
+	@echo "  CGROUP=0|1      Record resource usage of tests using cgroup v2 (default: 1)"
+	@echo "  CGROUP_KILL=1   Kill processes left behind by tests (requires CGROUP=1)"
+	@echo "  PERF=1          Count performance events (e.g. cycles) for each test"
+	@echo "  SAMPLE=<ms>     Sample resource usage during tests every <ms> milliseconds"
+	@echo "  LOGSYNC=<mode>  Sync LOG to disk 'always', every 'interval:<ms>' or at 'end' (default: always)"
+	@echo "  HISTORY=<path>  Add test results to history file <path>"
+	@echo "  PERFCHECK=1     Warn about test durations that regressed compared to HISTORY"
+	@echo "  PERFCHECK_THRESHOLD=<n> Report regression for durations <n> deviations above median (default: 3)"
+	@echo "  PERFCHECK_CPU=1 Also check test CPU time for regressions (requires PERFCHECK=1)"
+	@echo "  PERFCHECK_FAIL=1 Fail test run if regressions were found (requires PERFCHECK=1)"
+	@echo "  TRACE=<path>    Write Chrome trace-event JSON of test run phases to <path>"
 
 clean_echo:
 	$(call echocmd, "  CLEAN   ", "")
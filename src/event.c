@@ -0,0 +1,254 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Event loop for monitoring file descriptors and timers.
+ *
+ * Copyright IBM Corp. 2023
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include "event.h"
+#include "misc.h"
+
+/* Internal flags. */
+
+/* Source is a timer created by ev_timer(). */
+#define EV_TIMER	(1 << 8)
+
+/* Source cannot be monitored using epoll (e.g. regular files) and is
+ * considered to always have pending events. */
+#define EV_ALWAYS	(1 << 9)
+
+/* Initialize event loop @loop. */
+void ev_init(struct ev_loop *loop)
+{
+	memset(loop, 0, sizeof(*loop));
+	loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (loop->epfd == -1)
+		err(EXIT_RUNTIME, "Could not create epoll instance");
+}
+
+/* Release resources associated with event loop @loop. Sources that were not
+ * removed are left unchanged. */
+void ev_exit(struct ev_loop *loop)
+{
+	close(loop->epfd);
+	loop->epfd = -1;
+}
+
+/* Add @src to the queue of sources with pending events. */
+static void ev_queue(struct ev_loop *loop, struct ev_source *src)
+{
+	if (src->queued)
+		return;
+	src->queued = true;
+	src->next = NULL;
+	src->prev = loop->last;
+	if (loop->last)
+		loop->last->next = src;
+	else
+		loop->ready = src;
+	loop->last = src;
+	loop->num_ready++;
+}
+
+/* Remove @src from the queue of sources with pending events. */
+static void ev_unqueue(struct ev_loop *loop, struct ev_source *src)
+{
+	if (!src->queued)
+		return;
+	if (src->prev)
+		src->prev->next = src->next;
+	else
+		loop->ready = src->next;
+	if (src->next)
+		src->next->prev = src->prev;
+	else
+		loop->last = src->prev;
+	src->queued = false;
+	loop->num_ready--;
+}
+
+/**
+ * ev_add - Add an event source to an event loop
+ * @loop: Event loop
+ * @src: Event source with initialized fd, handler and data fields
+ * @flags: Flags (see EV_* definitions)
+ */
+void ev_add(struct ev_loop *loop, struct ev_source *src, int flags)
+{
+	struct epoll_event ev;
+	int fl;
+
+	src->flags = flags;
+	src->queued = false;
+
+	if (flags & EV_EDGE) {
+		fl = fcntl(src->fd, F_GETFL);
+		if (fl == -1 || fcntl(src->fd, F_SETFL, fl | O_NONBLOCK) == -1)
+			src->flags &= ~EV_EDGE;
+	}
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	if (src->flags & EV_EDGE)
+		ev.events |= EPOLLET;
+	ev.data.ptr = src;
+	if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, src->fd, &ev) == -1) {
+		if (errno != EPERM)
+			err(EXIT_RUNTIME, "Could not add fd %d to epoll",
+			    src->fd);
+		/* Regular files are always readable. */
+		src->flags |= EV_ALWAYS;
+		ev_queue(loop, src);
+	}
+
+	if (!(flags & EV_NOCOUNT))
+		loop->count++;
+}
+
+/**
+ * ev_del - Remove an event source from an event loop
+ * @loop: Event loop
+ * @src: Event source
+ *
+ * After this function returns, @src is no longer accessed by @loop and may be
+ * released. The file descriptor of @src is not closed.
+ */
+void ev_del(struct ev_loop *loop, struct ev_source *src)
+{
+	int i;
+
+	if (!(src->flags & EV_ALWAYS))
+		epoll_ctl(loop->epfd, EPOLL_CTL_DEL, src->fd, NULL);
+	ev_unqueue(loop, src);
+
+	/* Drop events that were received but not yet handled. */
+	for (i = 0; i < loop->num_events; i++) {
+		if (loop->events[i].data.ptr == src)
+			loop->events[i].data.ptr = NULL;
+	}
+	if (loop->current == src)
+		loop->current = NULL;
+
+	if (!(src->flags & EV_NOCOUNT))
+		loop->count--;
+}
+
+/**
+ * ev_timer - Add a periodic timer to an event loop
+ * @loop: Event loop
+ * @src: Event source with initialized handler and data fields
+ * @interval_ms: Timer interval in milliseconds
+ *
+ * Timers do not count towards the sources that keep ev_run() running.
+ * Expirations that occur while the handler is not called are merged.
+ */
+void ev_timer(struct ev_loop *loop, struct ev_source *src,
+	      unsigned long interval_ms)
+{
+	struct itimerspec its;
+
+	src->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (src->fd == -1)
+		err(EXIT_RUNTIME, "Could not create timer");
+
+	its.it_interval.tv_sec = interval_ms / 1000;
+	its.it_interval.tv_nsec = (interval_ms % 1000) * 1000000;
+	its.it_value = its.it_interval;
+	if (timerfd_settime(src->fd, 0, &its, NULL) == -1)
+		err(EXIT_RUNTIME, "Could not start timer");
+
+	ev_add(loop, src, EV_NOCOUNT | EV_TIMER);
+}
+
+/* Remove timer @src from @loop and release associated resources. */
+void ev_timer_del(struct ev_loop *loop, struct ev_source *src)
+{
+	ev_del(loop, src);
+	close(src->fd);
+	src->fd = -1;
+}
+
+/* Call the handler of @src. Return %true if @src was not removed and asks to
+ * be called again. */
+static bool ev_call(struct ev_loop *loop, struct ev_source *src)
+{
+	uint64_t expirations;
+	bool again;
+
+	if (src->flags & EV_TIMER) {
+		if (read(src->fd, &expirations, sizeof(expirations)) == -1)
+			return false;
+	}
+
+	loop->current = src;
+	again = src->handler(loop, src);
+	if (!loop->current)
+		return false;
+	loop->current = NULL;
+
+	return again || (src->flags & EV_ALWAYS);
+}
+
+/**
+ * ev_wait - Wait for and handle events
+ * @loop: Event loop
+ *
+ * Wait until at least one source has pending events and call the associated
+ * handlers. Sources that asked to be called again are served once per call.
+ * Return %false if the wait was interrupted by a signal, %true otherwise.
+ */
+bool ev_wait(struct ev_loop *loop)
+{
+	struct ev_source *src;
+	int i, rc, num;
+
+	rc = epoll_wait(loop->epfd, loop->events, EV_BATCH,
+			loop->ready ? 0 : -1);
+	if (rc == -1) {
+		if (errno != EINTR)
+			err(EXIT_RUNTIME, "Could not wait for events");
+		return false;
+	}
+
+	loop->num_events = rc;
+	for (i = 0; i < loop->num_events; i++) {
+		src = loop->events[i].data.ptr;
+		if (!src)
+			continue;
+		loop->events[i].data.ptr = NULL;
+
+		if (src->flags & EV_EDGE)
+			ev_queue(loop, src);
+		else
+			ev_call(loop, src);
+	}
+	loop->num_events = 0;
+
+	/* Serve each source that was ready at this point once. */
+	for (num = loop->num_ready; num > 0 && loop->ready; num--) {
+		src = loop->ready;
+		ev_unqueue(loop, src);
+		if (ev_call(loop, src))
+			ev_queue(loop, src);
+	}
+
+	return true;
+}
+
+/* Handle events in @loop until all counted sources were removed, or until
+ * the stop flag is set. */
+void ev_run(struct ev_loop *loop)
+{
+	while (loop->count > 0 && !loop->stop)
+		ev_wait(loop);
+}
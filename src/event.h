@@ -0,0 +1,99 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Event loop for monitoring file descriptors and timers.
+ *
+ * Copyright IBM Corp. 2023
+ */
+
+#ifndef EVENT_H
+#define EVENT_H
+
+#include <stdbool.h>
+#include <sys/epoll.h>
+
+/* Flags for ev_add(). */
+
+/* Use edge-triggered notification. The file descriptor is set to non-blocking
+ * mode, so it must not be shared with other processes. */
+#define EV_EDGE		1
+
+/* Source does not count towards the number of sources that keep ev_run()
+ * running. */
+#define EV_NOCOUNT	2
+
+struct ev_loop;
+struct ev_source;
+
+/**
+ * ev_handler_t - Event handler function
+ * @loop: Event loop
+ * @src: Event source with pending events
+ *
+ * For edge-triggered sources, the handler must process all pending data.
+ * A handler may stop early and return %true to be called again after other
+ * sources were served. Otherwise it must return %false.
+ */
+typedef bool (*ev_handler_t)(struct ev_loop *loop, struct ev_source *src);
+
+/**
+ * struct ev_source - A source of events
+ * @fd: File descriptor to monitor
+ * @handler: Function to call when events are pending
+ * @data: Data pointer for use by @handler
+ * @flags: Flags specified for ev_add()
+ * @queued: Flag indicating that source is in ready queue
+ * @prev: Previous source in ready queue
+ * @next: Next source in ready queue
+ *
+ * Event sources are provided by callers and must stay valid until they are
+ * removed using ev_del(). A handler may remove and free its own source.
+ */
+struct ev_source {
+	int fd;
+	ev_handler_t handler;
+	void *data;
+	/* Internal state. */
+	int flags;
+	bool queued;
+	struct ev_source *prev;
+	struct ev_source *next;
+};
+
+/* Maximum number of events to receive per epoll_wait() call. */
+#define EV_BATCH	64
+
+/**
+ * struct ev_loop - Event loop state
+ * @epfd: File descriptor of epoll instance
+ * @count: Number of sources that keep ev_run() running
+ * @stop: Flag indicating that ev_run() should return
+ * @ready: First source in queue of sources with pending events
+ * @last: Last source in @ready queue
+ * @num_ready: Number of sources in @ready queue
+ * @current: Source whose handler is running, reset when it is removed
+ * @events: Events received by the most recent epoll_wait() call
+ * @num_events: Number of valid entries in @events
+ */
+struct ev_loop {
+	int epfd;
+	int count;
+	bool stop;
+	struct ev_source *ready;
+	struct ev_source *last;
+	int num_ready;
+	struct ev_source *current;
+	struct epoll_event events[EV_BATCH];
+	int num_events;
+};
+
+void ev_init(struct ev_loop *loop);
+void ev_exit(struct ev_loop *loop);
+void ev_add(struct ev_loop *loop, struct ev_source *src, int flags);
+void ev_del(struct ev_loop *loop, struct ev_source *src);
+void ev_timer(struct ev_loop *loop, struct ev_source *src,
+	      unsigned long interval_ms);
+void ev_timer_del(struct ev_loop *loop, struct ev_source *src);
+bool ev_wait(struct ev_loop *loop);
+void ev_run(struct ev_loop *loop);
+
+#endif /* EVENT_H */
@@ -0,0 +1,743 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Functions for storing and querying test results across test runs.
+ *
+ * Copyright IBM Corp. 2023
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "history.h"
+#include "log.h"
+#include "misc.h"
+
+/* Size of chunk data is padded to a multiple of this value. */
+#define HIST_ALIGN	8
+
+/* Add a record for a testcase named @name with result @result to @data. */
+void hist_add(struct hist_data *data, const char *name,
+	      enum tela_result_t result)
+{
+	struct hist_record *r;
+
+	data->records = misc_realloc(data->records, sizeof(*data->records) *
+				     (data->num + 1));
+	data->names = misc_realloc(data->names, sizeof(*data->names) *
+				   (data->num + 1));
+	data->names[data->num] = misc_strdup(name);
+	r = &data->records[data->num++];
+	r->name = 0;
+	r->result = result;
+	r->duration_us = HIST_UNKNOWN;
+	r->utime_us = HIST_UNKNOWN;
+	r->stime_us = HIST_UNKNOWN;
+	r->maxrss_kb = HIST_UNKNOWN;
+	log_metrics_init(&data->metrics);
+}
+
+/* Update the most recently added record in @data with data from YAML data
+ * @line. */
+void hist_parse(struct hist_data *data, const char *line)
+{
+	struct log_metrics *m = &data->metrics;
+	struct hist_record *r;
+
+	if (data->num == 0 || !log_metrics_parse(m, line))
+		return;
+	r = &data->records[data->num - 1];
+
+	if (m->duration_ms >= 0)
+		r->duration_us = m->duration_ms * 1000;
+	if (m->utime_ms >= 0)
+		r->utime_us = m->utime_ms * 1000;
+	if (m->stime_ms >= 0)
+		r->stime_us = m->stime_ms * 1000;
+	if (m->maxrss_kb >= 0)
+		r->maxrss_kb = m->maxrss_kb;
+}
+
+/* Release resources associated with @data. */
+void hist_data_free(struct hist_data *data)
+{
+	int i;
+
+	for (i = 0; i < data->num; i++)
+		free(data->names[i]);
+	free(data->names);
+	free(data->records);
+	memset(data, 0, sizeof(*data));
+}
+
+/* Add strings in chunk data @s of size @size to @h. Return %false if the
+ * chunk is malformed. */
+static bool hist_load_strings(struct hist_file *h, const char *s, size_t size)
+{
+	const char *end = s + size, *nul;
+	uint32_t num_strings = h->num_strings;
+	uint32_t count;
+
+	if (size < sizeof(count))
+		return false;
+	memcpy(&count, s, sizeof(count));
+	s += sizeof(count);
+	if (count > size)
+		return false;
+
+	h->strings = misc_realloc(h->strings, sizeof(*h->strings) *
+				  (h->num_strings + count));
+	for (; count > 0; count--) {
+		nul = memchr(s, 0, end - s);
+		if (!nul) {
+			/* Drop strings already added from this chunk. */
+			h->num_strings = num_strings;
+			return false;
+		}
+		h->strings[h->num_strings++] = s;
+		s = nul + 1;
+	}
+
+	return true;
+}
+
+/* Add test run in chunk data @run of size @size to @h. Return %false if the
+ * chunk is malformed. */
+static bool hist_load_run(struct hist_file *h, struct hist_run *run,
+			  size_t size)
+{
+	if (size < sizeof(*run) ||
+	    (size - sizeof(*run)) / sizeof(struct hist_record) < run->num)
+		return false;
+	h->runs = misc_realloc(h->runs, sizeof(*h->runs) * (h->num_runs + 1));
+	h->runs[h->num_runs++] = run;
+
+	return true;
+}
+
+/* Read the contents of the history file opened as @h->fd. An incomplete
+ * chunk at the end of the file is ignored. Return %false if the file is not
+ * a valid history file. */
+static bool hist_load(struct hist_file *h, const char *path)
+{
+	struct hist_header *hdr;
+	struct hist_chunk *c;
+	struct stat st;
+	size_t off;
+	char *data;
+
+	if (fstat(h->fd, &st) == -1) {
+		warn("Could not access history file '%s'", path);
+		return false;
+	}
+	if (st.st_size == 0)
+		return true;
+	if ((size_t) st.st_size < sizeof(*hdr))
+		goto invalid;
+
+	h->map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, h->fd, 0);
+	if (h->map == MAP_FAILED) {
+		h->map = NULL;
+		warn("Could not read history file '%s'", path);
+		return false;
+	}
+	h->map_size = st.st_size;
+	h->size = st.st_size;
+
+	hdr = h->map;
+	if (memcmp(hdr->magic, HIST_MAGIC, sizeof(hdr->magic)) != 0 ||
+	    hdr->version != HIST_VERSION)
+		goto invalid;
+	if (hdr->bom != HIST_BOM) {
+		warnx("History file '%s' uses a different byte order", path);
+		return false;
+	}
+
+	data = h->map;
+	for (off = sizeof(*hdr); off + sizeof(*c) <= h->size;
+	     off += sizeof(*c) + c->size) {
+		c = (struct hist_chunk *) (data + off);
+		if (c->size % HIST_ALIGN != 0 ||
+		    c->size > h->size - off - sizeof(*c))
+			break;
+		if (c->type == HIST_STRINGS &&
+		    !hist_load_strings(h, (char *) (c + 1), c->size))
+			break;
+		if (c->type == HIST_RUN &&
+		    !hist_load_run(h, (struct hist_run *) (c + 1), c->size))
+			break;
+	}
+	if (off < h->size) {
+		debug("%s: ignoring %zu bytes of incomplete data", path,
+		      h->size - off);
+	}
+	h->size = off;
+
+	return true;
+
+invalid:
+	warnx("File '%s' is not a valid history file", path);
+
+	return false;
+}
+
+/* Open history file @path with open flags @flags and lock it using @lock.
+ * Return %true on success. */
+static bool hist_do_open(struct hist_file *h, const char *path, int flags,
+			 int lock)
+{
+	memset(h, 0, sizeof(*h));
+	h->fd = open(path, flags | O_CLOEXEC, 0644);
+	if (h->fd == -1) {
+		warn("Could not open history file '%s'", path);
+		return false;
+	}
+	if (flock(h->fd, lock) == -1) {
+		warn("Could not lock history file '%s'", path);
+		hist_close(h);
+		return false;
+	}
+	if (!hist_load(h, path)) {
+		hist_close(h);
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * hist_open - Open a history file for reading
+ * @h: History file to initialize
+ * @path: Path to history file
+ *
+ * Return %true on success, %false otherwise.
+ */
+bool hist_open(struct hist_file *h, const char *path)
+{
+	return hist_do_open(h, path, O_RDONLY, LOCK_SH);
+}
+
+/* Release resources associated with @h. */
+void hist_close(struct hist_file *h)
+{
+	if (h->map)
+		munmap(h->map, h->map_size);
+	free(h->strings);
+	free(h->runs);
+	if (h->fd != -1)
+		close(h->fd);
+	memset(h, 0, sizeof(*h));
+	h->fd = -1;
+}
+
+/* Return the ID of string @s in @h. If @s is not yet known, add it to
+ * @strings and @htab and assign a new ID. */
+static uint32_t hist_string_id(struct hist_file *h, struct misc_htab *htab,
+			       FILE *strings, uint32_t *count, const char *s)
+{
+	uintptr_t id;
+
+	id = (uintptr_t) misc_htab_get(htab, s);
+	if (id)
+		return id - 1;
+	id = h->num_strings + (*count)++;
+	misc_htab_put(htab, s, (void *) (id + 1));
+	fwrite(s, 1, strlen(s) + 1, strings);
+
+	return id;
+}
+
+/* Write chunk of type @type containing @size bytes of @data to @out,
+ * optionally preceded by @size_pre bytes of @pre. */
+static void hist_write_chunk(FILE *out, uint32_t type, const void *pre,
+			     size_t size_pre, const void *data, size_t size)
+{
+	static const char pad[HIST_ALIGN];
+	struct hist_chunk c;
+	size_t total = size_pre + size;
+
+	c.type = type;
+	c.size = (total + HIST_ALIGN - 1) / HIST_ALIGN * HIST_ALIGN;
+	fwrite(&c, sizeof(c), 1, out);
+	fwrite(pre, 1, size_pre, out);
+	fwrite(data, 1, size, out);
+	fwrite(pad, 1, c.size - total, out);
+}
+
+/**
+ * hist_append - Add a test run to a history file
+ * @path: Path to history file
+ * @data: Testcase results of test run
+ * @host: Name of host on which tests were run
+ * @os: Identification of OS on which tests were run
+ *
+ * Append the results in @data to the history file at @path. The file is
+ * created if it does not exist. Return %true on success, %false otherwise.
+ */
+bool hist_append(const char *path, struct hist_data *data, const char *host,
+		 const char *os)
+{
+	struct hist_header hdr;
+	struct misc_htab htab;
+	struct hist_file h;
+	struct hist_run run;
+	FILE *strings, *out;
+	char *sbuf, *obuf;
+	size_t ssize, osize;
+	uint32_t i, count = 0;
+	bool rc = false;
+	ssize_t w;
+
+	if (!hist_do_open(&h, path, O_RDWR | O_CREAT, LOCK_EX))
+		return false;
+
+	/* Assign string IDs. */
+	misc_htab_init(&htab, h.num_strings + data->num + 2);
+	for (i = 0; i < h.num_strings; i++)
+		misc_htab_put(&htab, h.strings[i],
+			      (void *) (uintptr_t) (i + 1));
+	strings = open_memstream(&sbuf, &ssize);
+	if (!strings)
+		oom();
+	memset(&run, 0, sizeof(run));
+	run.time = time(NULL);
+	run.host = hist_string_id(&h, &htab, strings, &count, host);
+	run.os = hist_string_id(&h, &htab, strings, &count, os);
+	run.num = data->num;
+	for (i = 0; i < run.num; i++) {
+		data->records[i].name = hist_string_id(&h, &htab, strings,
+						       &count, data->names[i]);
+	}
+	fclose(strings);
+
+	/* Write all new data at once. */
+	out = open_memstream(&obuf, &osize);
+	if (!out)
+		oom();
+	if (h.size == 0) {
+		memset(&hdr, 0, sizeof(hdr));
+		memcpy(hdr.magic, HIST_MAGIC, sizeof(hdr.magic));
+		hdr.version = HIST_VERSION;
+		hdr.bom = HIST_BOM;
+		fwrite(&hdr, sizeof(hdr), 1, out);
+	}
+	if (count > 0) {
+		hist_write_chunk(out, HIST_STRINGS, &count, sizeof(count),
+				 sbuf, ssize);
+	}
+	hist_write_chunk(out, HIST_RUN, &run, sizeof(run), data->records,
+			 sizeof(*data->records) * run.num);
+	fclose(out);
+
+	/* Discard incomplete data from previous writes. */
+	if (ftruncate(h.fd, h.size) == -1) {
+		warn("Could not write history file '%s'", path);
+		goto out;
+	}
+	w = pwrite(h.fd, obuf, osize, h.size);
+	if (w != (ssize_t) osize) {
+		if (w >= 0)
+			errno = ENOSPC;
+		warn("Could not write history file '%s'", path);
+		goto out;
+	}
+	fdatasync(h.fd);
+	rc = true;
+
+out:
+	free(obuf);
+	free(sbuf);
+	misc_htab_free(&htab);
+	hist_close(&h);
+
+	return rc;
+}
+
+/* Return the string with ID @id from @h. */
+static const char *hist_str(struct hist_file *h, uint32_t id)
+{
+	return id < h->num_strings ? h->strings[id] : "?";
+}
+
+/* Print end time of @run to @fd. */
+static void hist_print_time(FILE *fd, struct hist_run *run)
+{
+	time_t t = run->time;
+	char buf[32];
+	struct tm tm;
+
+	gmtime_r(&t, &tm);
+	strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm);
+	fprintf(fd, "%s", buf);
+}
+
+/* Return the index of the first of the @last most recent runs in @h. */
+static int hist_first(struct hist_file *h, int last)
+{
+	return last > 0 && last < h->num_runs ? h->num_runs - last : 0;
+}
+
+/* Return the records of test run @run. */
+static struct hist_record *hist_records(struct hist_run *run)
+{
+	return (struct hist_record *) (run + 1);
+}
+
+/* Print an overview of the @last most recent test runs in @h to @fd. */
+void hist_print_runs(FILE *fd, struct hist_file *h, int last)
+{
+	struct hist_record *r;
+	int i, counts[TELA_TODO + 1];
+	uint32_t j;
+
+	for (i = hist_first(h, last); i < h->num_runs; i++) {
+		memset(counts, 0, sizeof(counts));
+		r = hist_records(h->runs[i]);
+		for (j = 0; j < h->runs[i]->num; j++) {
+			if (r[j].result <= TELA_TODO)
+				counts[r[j].result]++;
+		}
+		fprintf(fd, "%d ", i + 1);
+		hist_print_time(fd, h->runs[i]);
+		fprintf(fd, " %u %d %d %d %s %s\n", h->runs[i]->num,
+			counts[TELA_PASS], counts[TELA_FAIL],
+			counts[TELA_SKIP] + counts[TELA_TODO],
+			hist_str(h, h->runs[i]->host),
+			hist_str(h, h->runs[i]->os));
+	}
+}
+
+/* Return the ID of string @s in @h, or -1 if @s is not known. */
+static long hist_find(struct hist_file *h, const char *s)
+{
+	uint32_t i;
+
+	for (i = 0; i < h->num_strings; i++) {
+		if (strcmp(h->strings[i], s) == 0)
+			return i;
+	}
+
+	return -1;
+}
+
+/**
+ * hist_print_duration - Print durations of a testcase
+ * @fd: Output stream
+ * @h: History file
+ * @name: Testcase name
+ * @last: Number of most recent test runs to consider
+ *
+ * Print the result and duration of testcase @name for each of the @last most
+ * recent test runs in @h that include this testcase. Return %false if no
+ * result for @name was found.
+ */
+bool hist_print_duration(FILE *fd, struct hist_file *h, const char *name,
+			 int last)
+{
+	struct hist_record *r;
+	bool found = false;
+	uint32_t j;
+	long id;
+	int i;
+
+	id = hist_find(h, name);
+	if (id == -1)
+		return false;
+
+	for (i = hist_first(h, last); i < h->num_runs; i++) {
+		r = hist_records(h->runs[i]);
+		for (j = 0; j < h->runs[i]->num; j++) {
+			if (r[j].name != id)
+				continue;
+			fprintf(fd, "%d ", i + 1);
+			hist_print_time(fd, h->runs[i]);
+			fprintf(fd, " %s ", log_result_str(r[j].result));
+			if (r[j].duration_us == HIST_UNKNOWN)
+				fprintf(fd, "-\n");
+			else
+				fprintf(fd, "%.3f\n",
+					r[j].duration_us / 1000.0);
+			found = true;
+		}
+	}
+
+	return found;
+}
+
+/**
+ * struct hist_flaky - Result changes of a testcase
+ * @name: String ID of testcase name
+ * @last: Most recent result or -1 if there was none
+ * @flips: Number of changes between pass and fail results
+ * @fails: Number of fail results
+ * @runs: Number of pass and fail results
+ */
+struct hist_flaky {
+	uint32_t name;
+	int last;
+	int flips;
+	int fails;
+	int runs;
+};
+
+static int hist_flaky_cmp(const void *a, const void *b)
+{
+	const struct hist_flaky *fa = a, *fb = b;
+
+	if (fa->flips != fb->flips)
+		return fb->flips - fa->flips;
+	if (fa->fails != fb->fails)
+		return fb->fails - fa->fails;
+
+	return (fa->name > fb->name) - (fa->name < fb->name);
+}
+
+/**
+ * hist_print_flaky - Print testcases with changing results
+ * @fd: Output stream
+ * @h: History file
+ * @last: Number of most recent test runs to consider
+ * @top: Maximum number of testcases to print
+ *
+ * Print the @top testcases with the highest number of changes between pass
+ * and fail results within the @last most recent test runs in @h.
+ */
+void hist_print_flaky(FILE *fd, struct hist_file *h, int last, int top)
+{
+	struct hist_flaky *f, *flaky;
+	struct hist_record *r;
+	uint32_t j;
+	int i, num;
+
+	flaky = misc_malloc(sizeof(*flaky) * (h->num_strings + 1));
+	for (j = 0; j < h->num_strings; j++) {
+		flaky[j].name = j;
+		flaky[j].last = -1;
+	}
+
+	for (i = hist_first(h, last); i < h->num_runs; i++) {
+		r = hist_records(h->runs[i]);
+		for (j = 0; j < h->runs[i]->num; j++) {
+			if (r[j].name >= h->num_strings ||
+			    (r[j].result != TELA_PASS &&
+			     r[j].result != TELA_FAIL))
+				continue;
+			f = &flaky[r[j].name];
+			if (f->last != -1 && f->last != (int) r[j].result)
+				f->flips++;
+			f->last = r[j].result;
+			f->runs++;
+			if (r[j].result == TELA_FAIL)
+				f->fails++;
+		}
+	}
+
+	qsort(flaky, h->num_strings, sizeof(*flaky), hist_flaky_cmp);
+	for (num = 0; num < (int) h->num_strings && num < top; num++) {
+		f = &flaky[num];
+		if (f->flips == 0)
+			break;
+		fprintf(fd, "%d %d/%d %s\n", f->flips, f->fails, f->runs,
+			hist_str(h, f->name));
+	}
+	free(flaky);
+}
+
+/**
+ * struct hist_samples - Metric values of a testcase in previous test runs
+ * @name: Testcase name
+ * @values: Arrays of metric values in microseconds per metric
+ * @num: Number of values per metric
+ */
+struct hist_samples {
+	char *name;
+	uint64_t *values[HIST_NUM_METRICS];
+	int num[HIST_NUM_METRICS];
+};
+
+/* Return the value of @metric in @r or %HIST_UNKNOWN if it is not known. */
+static uint64_t hist_metric_value(struct hist_record *r,
+				  enum hist_metric metric)
+{
+	switch (metric) {
+	case HIST_DURATION:
+		return r->duration_us;
+	case HIST_CPU:
+		if (r->utime_us == HIST_UNKNOWN || r->stime_us == HIST_UNKNOWN)
+			return HIST_UNKNOWN;
+		return r->utime_us + r->stime_us;
+	default:
+		return HIST_UNKNOWN;
+	}
+}
+
+/* Add known metric values of record @r to @samples unless @samples already
+ * contains @max values of a metric. */
+static void hist_samples_add(struct hist_samples *samples,
+			     struct hist_record *r, int max)
+{
+	enum hist_metric m;
+	uint64_t v;
+
+	for (m = 0; m < HIST_NUM_METRICS; m++) {
+		v = hist_metric_value(r, m);
+		if (v == HIST_UNKNOWN || samples->num[m] >= max)
+			continue;
+		samples->values[m] = misc_realloc(samples->values[m],
+						  sizeof(v) *
+						  (samples->num[m] + 1));
+		samples->values[m][samples->num[m]++] = v;
+	}
+}
+
+/**
+ * hist_baseline_init - Collect testcase metrics from previous test runs
+ * @b: Baseline to initialize
+ * @path: Path to history file
+ * @last: Maximum number of values to collect per testcase and metric
+ *
+ * Collect the @last most recent metric values of each passed testcase in
+ * the test runs stored in history file @path. Runs are scanned from newest
+ * to oldest so that testcases that are not part of every run, for example
+ * when multiple test suites share a history file, still get a full
+ * baseline. If the file does not exist, the baseline is empty. Return
+ * %false if the file could not be read.
+ */
+bool hist_baseline_init(struct hist_baseline *b, const char *path, int last)
+{
+	struct hist_samples *samples;
+	struct hist_record *r;
+	struct hist_file h;
+	const char *name;
+	uint32_t j;
+	int i;
+
+	misc_htab_init(&b->names, 0);
+	if (access(path, F_OK) != 0 && errno == ENOENT)
+		return true;
+	if (!hist_open(&h, path))
+		return false;
+
+	for (i = h.num_runs - 1; i >= 0; i--) {
+		r = hist_records(h.runs[i]);
+		for (j = h.runs[i]->num; j-- > 0; ) {
+			if (r[j].result != TELA_PASS ||
+			    r[j].name >= h.num_strings)
+				continue;
+			name = h.strings[r[j].name];
+			samples = misc_htab_get(&b->names, name);
+			if (!samples) {
+				samples = misc_malloc(sizeof(*samples));
+				samples->name = misc_strdup(name);
+				misc_htab_put(&b->names, samples->name,
+					      samples);
+			}
+			hist_samples_add(samples, &r[j], last);
+		}
+	}
+	hist_close(&h);
+
+	return true;
+}
+
+/* Release resources associated with @b. */
+void hist_baseline_free(struct hist_baseline *b)
+{
+	struct hist_samples *samples;
+	enum hist_metric m;
+	size_t i;
+
+	for (i = 0; i < b->names.size; i++) {
+		samples = b->names.entries[i].value;
+		if (!b->names.entries[i].key || !samples)
+			continue;
+		for (m = 0; m < HIST_NUM_METRICS; m++)
+			free(samples->values[m]);
+		free(samples->name);
+		free(samples);
+	}
+	misc_htab_free(&b->names);
+}
+
+static int hist_u64_cmp(const void *a, const void *b)
+{
+	uint64_t va = *(const uint64_t *) a, vb = *(const uint64_t *) b;
+
+	return (va > vb) - (va < vb);
+}
+
+/* Return the median of @num values in @v. Note: @v is sorted. */
+static double hist_median(uint64_t *v, int num)
+{
+	qsort(v, num, sizeof(*v), hist_u64_cmp);
+	if (num % 2)
+		return v[num / 2];
+
+	return (v[num / 2 - 1] + v[num / 2]) / 2.0;
+}
+
+/**
+ * hist_check - Check testcase metric for a regression
+ * @b: Baseline
+ * @name: Testcase name
+ * @metric: Metric to check
+ * @r: Record containing testcase metrics
+ * @threshold: Number of deviations above median that indicate a regression
+ * @reg: Result of check
+ *
+ * Compare the value of @metric in @r with values of the same testcase in
+ * @b. The deviation is estimated as median absolute deviation (MAD) scaled
+ * to match the standard deviation of normally distributed values, but at
+ * least 5% of the median and 1 ms, to prevent false alarms for testcases
+ * with very stable or very short durations. Return %true if the value
+ * exceeds the median by more than @threshold deviations.
+ */
+bool hist_check(struct hist_baseline *b, const char *name,
+		enum hist_metric metric, struct hist_record *r,
+		double threshold, struct hist_regression *reg)
+{
+	struct hist_samples *samples;
+	double median, dev, mad;
+	uint64_t value, *v;
+	int i, num;
+
+	value = hist_metric_value(r, metric);
+	samples = misc_htab_get(&b->names, name);
+	if (value == HIST_UNKNOWN || !samples)
+		return false;
+	num = samples->num[metric];
+	if (num < HIST_MIN_SAMPLES)
+		return false;
+
+	v = misc_malloc(sizeof(*v) * num);
+	memcpy(v, samples->values[metric], sizeof(*v) * num);
+	median = hist_median(v, num);
+	for (i = 0; i < num; i++)
+		v[i] = v[i] > median ? v[i] - median : median - v[i];
+	mad = hist_median(v, num);
+	free(v);
+
+	dev = 1.4826 * mad;
+	if (dev < 0.05 * median)
+		dev = 0.05 * median;
+	if (dev < 1000)
+		dev = 1000;
+
+	reg->value_ms = value / 1000.0;
+	reg->median_ms = median / 1000.0;
+	reg->mad_ms = mad / 1000.0;
+	reg->limit_ms = (median + threshold * dev) / 1000.0;
+	reg->samples = num;
+
+	return reg->value_ms > reg->limit_ms;
+}
@@ -0,0 +1,201 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Functions for storing and querying test results across test runs.
+ *
+ * Copyright IBM Corp. 2023
+ */
+
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+#include "log.h"
+#include "misc.h"
+
+/*
+ * A history file consists of a header followed by a sequence of chunks.
+ * New data is only ever appended as a whole, so that a history file that
+ * ends with an incomplete chunk, e.g. after a crash, can be repaired by
+ * discarding that chunk. All values are stored in host byte order, and all
+ * chunks start at an offset that is a multiple of 8.
+ */
+#define HIST_MAGIC	"TELAHIST"
+#define HIST_VERSION	1
+#define HIST_BOM	0x01020304
+
+/* Value of struct hist_record fields that are not known. */
+#define HIST_UNKNOWN	UINT64_MAX
+
+/**
+ * struct hist_header - History file header
+ * @magic: File type identification (%HIST_MAGIC)
+ * @version: File format version (%HIST_VERSION)
+ * @bom: Byte order mark (%HIST_BOM)
+ */
+struct hist_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t bom;
+};
+
+/* Types of history file chunks. */
+enum hist_chunk_type {
+	/* Strings that are referenced by ID in later chunks. */
+	HIST_STRINGS = 1,
+	/* Results of a test run. */
+	HIST_RUN = 2,
+};
+
+/**
+ * struct hist_chunk - Header of a history file chunk
+ * @type: Chunk type (enum hist_chunk_type)
+ * @size: Size of chunk data following this header in bytes
+ *
+ * A %HIST_STRINGS chunk contains a 32 bit number of strings followed by that
+ * number of %NULL-terminated strings. String IDs are assigned in the order in
+ * which strings occur in the file, starting with 0. A %HIST_RUN chunk
+ * contains a struct hist_run followed by the number of struct hist_record
+ * specified there.
+ */
+struct hist_chunk {
+	uint32_t type;
+	uint32_t size;
+};
+
+/**
+ * struct hist_run - Test run description
+ * @time: Time at which the test run ended in seconds since the Epoch
+ * @host: String ID of host name
+ * @os: String ID of OS identification
+ * @num: Number of records
+ * @reserved: Reserved for future use
+ */
+struct hist_run {
+	uint64_t time;
+	uint32_t host;
+	uint32_t os;
+	uint32_t num;
+	uint32_t reserved;
+};
+
+/**
+ * struct hist_record - Result of a single testcase
+ * @name: String ID of testcase name
+ * @result: Testcase result (enum tela_result_t)
+ * @duration_us: Testcase duration in microseconds
+ * @utime_us: CPU time spent in user mode in microseconds
+ * @stime_us: CPU time spent in kernel mode in microseconds
+ * @maxrss_kb: Maximum resident set size in kilobytes
+ *
+ * Fields that are not known are set to %HIST_UNKNOWN.
+ */
+struct hist_record {
+	uint32_t name;
+	uint32_t result;
+	uint64_t duration_us;
+	uint64_t utime_us;
+	uint64_t stime_us;
+	uint64_t maxrss_kb;
+};
+
+/**
+ * struct hist_data - Testcase results of a test run to be stored
+ * @records: Array of @num records
+ * @names: Array of @num testcase names
+ * @num: Number of records
+ * @metrics: Metrics parsed from YAML data of the most recent record
+ */
+struct hist_data {
+	struct hist_record *records;
+	char **names;
+	int num;
+	struct log_metrics metrics;
+};
+
+/**
+ * struct hist_file - Opened history file
+ * @fd: File descriptor
+ * @map: File contents
+ * @map_size: Size of @map in bytes
+ * @size: Size of valid file contents in bytes
+ * @strings: Array of @num_strings strings in @map
+ * @num_strings: Number of strings
+ * @runs: Array of @num_runs pointers to test runs in @map
+ * @num_runs: Number of test runs
+ */
+struct hist_file {
+	int fd;
+	void *map;
+	size_t map_size;
+	size_t size;
+	const char **strings;
+	uint32_t num_strings;
+	struct hist_run **runs;
+	int num_runs;
+};
+
+/* Number of most recent results per testcase used as baseline for
+ * regression checks. */
+#define HIST_BASELINE_SAMPLES	20
+
+/* Minimum number of samples required for regression checks. */
+#define HIST_MIN_SAMPLES	5
+
+/* Testcase metrics that can be checked for regressions. */
+enum hist_metric {
+	/* Testcase duration. */
+	HIST_DURATION,
+	/* CPU time spent in user and kernel mode. */
+	HIST_CPU,
+	HIST_NUM_METRICS,
+};
+
+/**
+ * struct hist_baseline - Metrics of testcases in previous test runs
+ * @names: Hash table mapping testcase names to struct hist_samples
+ */
+struct hist_baseline {
+	struct misc_htab names;
+};
+
+/**
+ * struct hist_regression - Result of a regression check
+ * @value_ms: Metric value in milliseconds
+ * @median_ms: Median of metric values in previous test runs
+ * @mad_ms: Median absolute deviation of metric values in previous test runs
+ * @limit_ms: Maximum metric value not considered a regression
+ * @samples: Number of metric values in previous test runs
+ */
+struct hist_regression {
+	double value_ms;
+	double median_ms;
+	double mad_ms;
+	double limit_ms;
+	int samples;
+};
+
+void hist_add(struct hist_data *data, const char *name,
+	      enum tela_result_t result);
+void hist_parse(struct hist_data *data, const char *line);
+void hist_data_free(struct hist_data *data);
+bool hist_append(const char *path, struct hist_data *data, const char *host,
+		 const char *os);
+
+bool hist_open(struct hist_file *h, const char *path);
+void hist_close(struct hist_file *h);
+void hist_print_runs(FILE *fd, struct hist_file *h, int last);
+bool hist_print_duration(FILE *fd, struct hist_file *h, const char *name,
+			 int last);
+void hist_print_flaky(FILE *fd, struct hist_file *h, int last, int top);
+
+bool hist_baseline_init(struct hist_baseline *b, const char *path, int last);
+void hist_baseline_free(struct hist_baseline *b);
+bool hist_check(struct hist_baseline *b, const char *name,
+		enum hist_metric metric, struct hist_record *r,
+		double threshold, struct hist_regression *reg);
+
+#endif /* HISTORY_H */
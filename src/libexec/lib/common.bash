@@ -238,3 +238,136 @@ function check_pnetids() {
 	done
 	[[ -n "$count_text" ]] && echo "${indent}${count_text}: $num"
 }
+
+#
+# yamlserve_start - Start a YAML query server
+#
+# @file: YAML file
+#
+# Start a 'tela yamlserve' coprocess that parses @file once and then answers
+# queries issued via yamlserve_get and yamlserve_scalar. This is much faster
+# than calling 'tela yamlget' for each query. Only one server can be active at
+# a time. The server is stopped by yamlserve_stop or when the calling script
+# exits. Queries can be issued from the calling shell and from command and
+# process substitutions, but not from other subshells.
+#
+function yamlserve_start() {
+	local file="$1" tool="${TELA_TOOL:-$TELA_FRAMEWORK/src/tela}"
+
+	yamlserve_stop
+	coproc _YAMLSERVE { exec "$tool" yamlserve "$file" ; }
+}
+
+#
+# yamlserve_stop - Stop the YAML query server
+#
+function yamlserve_stop() {
+	[[ -z "$_YAMLSERVE_PID" ]] && return
+
+	printf "quit\n" >&"${_YAMLSERVE[1]}" 2>/dev/null
+	wait "$_YAMLSERVE_PID" 2>/dev/null
+	unset _YAMLSERVE_PID
+}
+
+#
+# _yamlserve_request - Send request to YAML query server
+#
+# @var: Name of output variable
+# @request: Request line
+#
+# Send @request to the YAML query server and store the number of response lines
+# that follow in the variable named @var. Return 0 on success, non-zero
+# otherwise.
+#
+function _yamlserve_request() {
+	local _var="$1" _request="$2" _line
+
+	if [[ -z "$_YAMLSERVE_PID" ]] ; then
+		warn "YAML query server not running"
+		return 1
+	fi
+
+	printf "%s\n" "$_request" >&"${_YAMLSERVE[1]}" || return 1
+	IFS= read -r _line <&"${_YAMLSERVE[0]}" || return 1
+
+	case "$_line" in
+	"OK "*)
+		printf -v "$_var" "%s" "${_line#OK }"
+		;;
+	*)
+		warn "${_line#ERROR }"
+		return 1
+		;;
+	esac
+
+	return 0
+}
+
+#
+# yamlserve_get - Query YAML query server for paths
+#
+# @pattern: Path pattern
+#
+# Print YAML nodes matching each specified @pattern in the same format as
+# 'tela yamlget <file> <pattern> ...'.
+#
+function yamlserve_get() {
+	local _pattern _line _n
+
+	for _pattern in "$@" ; do
+		_yamlserve_request _n "get $_pattern" || return 1
+		while (( _n-- > 0 )) ; do
+			IFS= read -r _line <&"${_YAMLSERVE[0]}" || return 1
+			printf "%s\n" "$_line"
+		done
+	done
+
+	return 0
+}
+
+#
+# yamlserve_value - Get scalar value from YAML query server
+#
+# @var: Name of output variable
+# @path: Path of scalar node without trailing slash
+#
+# Store the content of the first scalar found at @path in the variable named
+# @var. Return 0 if a scalar was found, non-zero otherwise.
+#
+function yamlserve_value() {
+	local _var="$1" _path="$2" _line _n _found=0 YAMLPATH VALUE TYPE
+
+	_yamlserve_request _n "get $_path/" || return 1
+	while (( _n-- > 0 )) ; do
+		IFS= read -r _line <&"${_YAMLSERVE[0]}" || return 1
+		if [[ $_found == 0 ]] ; then
+			eval "$_line"
+			printf -v "$_var" "%s" "$VALUE"
+			_found=1
+		fi
+	done
+
+	[[ $_found == 1 ]]
+}
+
+#
+# yamlserve_scalar - Convert text file to YAML block scalar
+#
+# @file: Text file
+# @indent: Indentation level
+# @escape: Flag indicating whether to escape non-printable characters
+#
+# Print the contents of @file in the same format as
+# 'tela yamlscalar <file> <indent> <escape>'.
+#
+function yamlserve_scalar() {
+	local _file="$1" _indent="${2:-0}" _escape="${3:-0}" _line _n
+
+	_yamlserve_request _n "scalar $_indent $_escape $_file" || return 1
+	while (( _n-- > 0 )) ; do
+		IFS= read -r _line <&"${_YAMLSERVE[0]}" || return 1
+		printf "%s\n" "$_line"
+	done
+
+	return 0
+}
@@ -16,6 +16,7 @@ shift
 TESTS=( "$@" )
 
 source "$TELA_FRAMEWORK/src/libexec/skipfile.bash" || exit 1
+source "$TELA_FRAMEWORK/src/libexec/trace.bash" || exit 1
 
 declare -r EXIT_FAIL="${EXIT_FAIL:-1}"
 
@@ -59,9 +60,20 @@ function runscripts() {
 	done <"$out"
 }
 
+# Add the time passed since @start (in microseconds) to variable phases
+# as phase @name
+function add_phase() {
+	local name=$1 start=$2 us=${EPOCHREALTIME/[.,]/}
+
+	[[ -z "$us" ]] && return
+	(( us -= start ))
+	printf -v phases "%s%s=%d.%03d " "$phases" "$name" $(( us / 1000 )) \
+		$(( us % 1000 ))
+}
+
 function runtests() {
 	local t tests="$*" abs testdir matchearly=0 matchout=""  matcherr=""
-	local rc err last
+	local rc err last phases start
 
 	# Determine test directory relative to test base directory
 	[[ "$PWD" != "$TELA_TESTBASE" ]] && testdir="${PWD##$TELA_TESTBASE/}/"
@@ -76,18 +88,25 @@ function runtests() {
 
 		if [[ -d "$t" ]] ; then
 			# Enter sub-directory
+			trace_begin "make" "$testdir$t"
 			$MAKE -C "$t" check
+			trace_end "make" "$testdir$t"
 		else
 			abs="$PWD/$t"
 			abs="${abs##$TELA_TESTBASE/}"
+			phases=""
 
 			if [[ "$matchearly" -eq 1 ]] ; then
 				# Obtain resource match data for use in scripts
 				matchout="$_TELA_TMPDIR/runtests.matchout"
 				matcherr="$_TELA_TMPDIR/runtests.matcherr"
+				trace_begin "match" "$abs"
+				start=${EPOCHREALTIME/[.,]/}
 				TELA_DEBUG=0 "$TELA_TOOL" match "${t}.yaml" "" 1 \
 					>"$matchout" 2>"$matcherr"
 				rc=$?
+				add_phase "resolve" "$start"
+				trace_end "match" "$abs"
 				readarray -t err <"$matcherr"
 
 				if [[ "$rc" -ne 0 ]] ; then
@@ -115,12 +134,21 @@ function runtests() {
 			fi
 
 			# Run test
+			trace_begin "before" "$abs"
+			start=${EPOCHREALTIME/[.,]/}
 			runscripts "$TELA_BEFORE" "$TELA_TESTSUITE" "$abs" \
 				   "$matchout" "$matcherr"
-			$TELA_TOOL run "$t" "" "$matchout" "$matcherr" \
+			[[ -n "$TELA_BEFORE" ]] && add_phase "before" "$start"
+			trace_end "before" "$abs"
+			trace_begin "test" "$abs"
+			_TELA_PHASES="$phases" \
+				$TELA_TOOL run "$t" "" "$matchout" "$matcherr" \
 				   </dev/null || exit 1
+			trace_end "test" "$abs"
+			trace_begin "after" "$abs"
 			runscripts "$TELA_AFTER" "$TELA_TESTSUITE" "$abs" \
 				   "$matchout" "$matcherr"
+			trace_end "after" "$abs"
 		fi
 	done
 }
@@ -156,6 +184,9 @@ if [[ -z "$_TELA_RUNNING" ]] ; then
 	export _TELA_TMPDIR
 	export _TELA_FILE_ARCHIVE="$_TELA_TMPDIR/archive"
 
+	# Output of 'tela run' is consumed by 'tela format'
+	export _TELA_FORMAT_BLOCKS=1
+
 	# Announce run-log
 	if [[ -n "$TELA_RUNLOG" ]] ; then
 		# Reset here since each tela process only appends to this log
@@ -164,15 +195,27 @@ if [[ -z "$_TELA_RUNNING" ]] ; then
 		echo "Writing unprocessed test output to $TELA_RUNLOG"
 	fi
 
+	# Start trace file
+	if [[ -n "$TELA_TRACE" ]] ; then
+		echo "[" 2>/dev/null >"$TELA_TRACE" ||
+			die "Could not create trace file $TELA_TRACE"
+		echo "Writing trace events to $TELA_TRACE"
+	fi
+	trace_begin "testsuite" "$TELA_TESTSUITE"
+
 	# Get total number of tests
+	trace_begin "count"
 	NUM=$($MAKE --no-print-directory count TESTS="${TESTS[*]}")
+	trace_end "count"
 	if [[ "${#TESTS[@]}" -eq 0 ]] ; then
 		P="$PWD/Makefile"
 		P=${P##$TELA_TESTBASE/}
 		die "$P: Empty TESTS variable"
 	fi
 
+	trace_begin "preexec"
 	runscripts "$TELA_PREEXEC" "$TELA_TESTSUITE" "$TELA_WRITELOG"
+	trace_end "preexec"
 
 	runtests "${TESTS[@]}" | $TELA_TOOL format - "$NUM" 1 || exit 1
 	if [[ -d "$_TELA_FILE_ARCHIVE" ]]; then
@@ -182,11 +225,24 @@ if [[ -z "$_TELA_RUNNING" ]] ; then
 
 	if grep -q '^not ok' "${TELA_WRITELOG}"; then
 		TESTS_FAILED=1
+	elif [[ "$TELA_PERFCHECK_FAIL" == 1 ]] &&
+	     grep -q '^  perf_regression:' "${TELA_WRITELOG}"; then
+		echo 'Performance regressions were detected' >&2
+		TESTS_FAILED=1
 	else
 		TESTS_FAILED=0
 	fi
 
+	trace_begin "postexec"
 	runscripts "$TELA_POSTEXEC" "$TELA_TESTSUITE" "$TELA_WRITELOG" "$TESTS_FAILED"
+	trace_end "postexec"
+
+	# Complete JSON array of trace events
+	trace_end "testsuite" "$TELA_TESTSUITE"
+	if [[ -n "$TELA_TRACE" ]] ; then
+		printf '{"name":"process_name","ph":"M","pid":%d,%s}\n]\n' $$ \
+			'"args":{"name":"runtests.sh"}' >>"$TELA_TRACE"
+	fi
 
 	if [[ "$TESTS_FAILED" -ne 0 ]] ; then
 		echo 'Tests have failed' >&2
@@ -0,0 +1,54 @@
+#
+# SPDX-License-Identifier: MIT
+# trace.bash - Bash functions for writing trace events in Chrome trace-event
+# format.
+#
+# Copyright IBM Corp. 2023
+#
+# If TELA_TRACE is set, events are appended to the trace file that is shared
+# with the tela tool. Time stamps are in microseconds relative to the start
+# time used for debug output.
+#
+
+if [[ -n "$TELA_TRACE" ]] ; then
+	_TRACE_FMT='{"name":"%s","cat":"tela","ph":"%s","ts":%s,"pid":%d,'
+	_TRACE_FMT+='"tid":%d%s},\n'
+
+	function _trace_event() {
+		local ph=$1 name=$2 test=$3 args="" ts=${EPOCHREALTIME/[.,]/}
+
+		[[ -z "$ts" ]] && ts=$(date +%s%6N)
+		(( ts -= ${_TELA_STARTTIME:-0} * 1000 ))
+		if [[ -n "$test" ]] ; then
+			test=${test//\\/\\\\}
+			args=",\"args\":{\"test\":\"${test//\"/\\\"}\"}"
+		fi
+
+		printf "$_TRACE_FMT" "$name" "$ph" "$ts" $$ "$BASHPID" \
+			"$args" >>"$TELA_TRACE"
+	}
+else
+	function _trace_event() {
+		:
+	}
+fi
+
+#
+# trace_begin - Write trace event for the begin of a phase
+#
+# @name: Phase name
+# @test: Testcase name (optional)
+#
+function trace_begin() {
+	_trace_event B "$1" "$2"
+}
+
+#
+# trace_end - Write trace event for the end of a phase
+#
+# @name: Phase name
+# @test: Testcase name (optional)
+#
+function trace_end() {
+	_trace_event E "$1" "$2"
+}
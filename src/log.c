@@ -15,6 +15,7 @@
 
 #include "log.h"
 #include "misc.h"
+#include "phase.h"
 #include "record.h"
 #include "yaml.h"
 
@@ -80,7 +81,8 @@ void log_line(FILE *fd, int num, const char *name, enum tela_result_t result,
 	}
 }
 
-static const char *get_result_str(enum tela_result_t result)
+/* Return textual representation of @result. */
+const char *log_result_str(enum tela_result_t result)
 {
 	switch (result) {
 	case TELA_PASS:
@@ -96,8 +98,8 @@ static const char *get_result_str(enum tela_result_t result)
 
 void log_result(FILE *fd, const char *name, const char *testexec, int num,
 		enum tela_result_t result, const char *reason,
-		struct rec_result *res, struct yaml_node *desc,
-		const char *testrexec)
+		struct rec_result *res, struct phase_data *phases,
+		struct yaml_node *desc, const char *testrexec)
 {
 	char *v, *s, *quoted;
 
@@ -115,10 +117,12 @@ void log_result(FILE *fd, const char *name, const char *testexec, int num,
 		fprintf(fd, "  desc: \"%s\"\n", quoted);
 		free(quoted);
 	}
-	fprintf(fd, "  testresult: \"%s\"\n", get_result_str(result));
+	fprintf(fd, "  testresult: \"%s\"\n", log_result_str(result));
 	if (reason)
 		fprintf(fd, "  reason: \"%s\"\n", reason);
 	fprintf(fd, "  testexec: \"%s\"\n", testexec);
+	if (phases)
+		phase_print(fd, phases, 2);
 	if (res)
 		rec_print(fd, res, 2);
 
@@ -269,20 +273,60 @@ const char *log_parse_warning(const char *line)
 	return NULL;
 }
 
+/* Reset all metrics in @m to unknown. */
+void log_metrics_init(struct log_metrics *m)
+{
+	m->duration_ms = -1;
+	m->utime_ms = -1;
+	m->stime_ms = -1;
+	m->maxrss_kb = -1;
+	m->in_rusage = false;
+}
+
+/**
+ * log_metrics_parse - Update metrics from a line of result YAML data
+ * @m: Metrics of the current testcase result
+ * @line: Line of YAML data following the result line
+ *
+ * Parse the testcase duration and the resource usage keys of the rusage
+ * mapping. Keys with the same names in test output or other YAML data are
+ * ignored. Return %true if @line contained one of these metrics.
+ */
+bool log_metrics_parse(struct log_metrics *m, const char *line)
+{
+	/* Quickly skip testcase output and unrelated data. */
+	if (line[0] != ' ' || line[1] != ' ')
+		return false;
+
+	if (line[2] == ' ') {
+		if (!m->in_rusage || line[3] != ' ' || line[4] == ' ')
+			return false;
+		return sscanf(line, "    utime_ms: %lf", &m->utime_ms) == 1 ||
+		       sscanf(line, "    stime_ms: %lf", &m->stime_ms) == 1 ||
+		       sscanf(line, "    maxrss_kb: %ld", &m->maxrss_kb) == 1;
+	}
+	m->in_rusage = strcmp(line, "  rusage:\n") == 0;
+
+	return sscanf(line, "  duration_ms: %lf", &m->duration_ms) == 1;
+}
+
 void log_all_result(FILE *fd, const char *testexec, enum tela_result_t result,
 		    const char *reason, struct rec_result *res,
-		    const char *testrexec, struct yaml_node *desc, int num,
-		    int plan)
+		    struct phase_data *phases, const char *testrexec,
+		    struct yaml_node *desc, int num, int plan)
 {
 	int i = num;
 	char *name;
 	bool base;
 	struct yaml_node *node, *key;
 
+	/* Note: @phases are only reported for the first result to prevent
+	 * repeating the same data for each result. */
+
 	/* Log single result with executable name in case of no plan. */
 	if (plan == -1) {
 		log_result(fd, testrexec, testexec, num, result,
-			   reason, res, desc, NULL);
+			   reason, res, phases, desc, NULL);
 		return;
 	}
 
@@ -303,7 +347,8 @@ void log_all_result(FILE *fd, const char *testexec, enum tela_result_t result,
 			base = false;
 
 		log_result(fd, name, testexec, i + 1, result, reason, res,
-			   desc, base ? testrexec : NULL);
+			   phases, desc, base ? testrexec : NULL);
+		phases = NULL;
 		node->handled = true;
 		i++;
 	}
@@ -311,7 +356,101 @@ void log_all_result(FILE *fd, const char *testexec, enum tela_result_t result,
 	for (; i < plan; i++) {
 		name = misc_asprintf("missing_name_%d", i + 1);
 		log_result(fd, name, testexec, i + 1, result,
-			   reason, res, desc, testrexec);
+			   reason, res, phases, desc, testrexec);
+		phases = NULL;
 		free(name);
 	}
 }
+
+/* Write index @entry to @fd. */
+void log_index_write(FILE *fd, struct log_index_entry *entry)
+{
+	fprintf(fd, "%d %s %lld %zu ", entry->num,
+		log_result_str(entry->result), (long long) entry->offset,
+		entry->length);
+	if (entry->duration_ms < 0)
+		fprintf(fd, "-");
+	else
+		fprintf(fd, "%.3f", entry->duration_ms);
+	fprintf(fd, " %s\n", entry->name);
+}
+
+/* Parse textual result representation @str into @result_p. */
+static bool parse_result_str(const char *str, enum tela_result_t *result_p)
+{
+	enum tela_result_t r;
+
+	for (r = TELA_PASS; r <= TELA_TODO; r++) {
+		if (strcmp(str, log_result_str(r)) == 0) {
+			*result_p = r;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * log_index_read - Read log index file
+ * @path: Path to index file
+ * @entries_p: Pointer to array for storing index entries
+ * @num_p: Pointer to integer for storing number of entries
+ *
+ * Read entries from the index file at @path. Return %true on success,
+ * %false if the file could not be read or has an invalid format.
+ */
+bool log_index_read(const char *path, struct log_index_entry **entries_p,
+		    int *num_p)
+{
+	struct log_index_entry *entries = NULL, *e;
+	char *line = NULL, result[8], duration[32];
+	long long offset;
+	int num = 0, pos;
+	bool valid;
+	size_t n = 0;
+	FILE *fd;
+
+	fd = fopen(path, "r");
+	if (!fd)
+		return false;
+
+	valid = getline(&line, &n, fd) != -1 &&
+		strcmp(line, LOG_INDEX_HEADER) == 0;
+	while (valid && getline(&line, &n, fd) != -1) {
+		misc_expand_array(&entries, &num);
+		e = &entries[num - 1];
+		memset(e, 0, sizeof(*e));
+		if (sscanf(line, "%d %7s %lld %zu %31s %n", &e->num, result,
+			   &offset, &e->length, duration, &pos) != 5 ||
+		    !parse_result_str(result, &e->result)) {
+			valid = false;
+			break;
+		}
+		e->offset = offset;
+		e->duration_ms = strcmp(duration, "-") == 0 ? -1 :
+							     atof(duration);
+		line[strcspn(line, "\n")] = 0;
+		e->name = misc_strdup(line + pos);
+	}
+	free(line);
+	fclose(fd);
+
+	if (!valid) {
+		log_index_free(entries, num);
+		return false;
+	}
+	*entries_p = entries;
+	*num_p = num;
+
+	return true;
+}
+
+/* Release memory used by @entries. */
+void log_index_free(struct log_index_entry *entries, int num)
+{
+	int i;
+
+	for (i = 0; i < num; i++)
+		free(entries[i].name);
+	free(entries);
+}
@@ -10,12 +10,53 @@
 
 #include <stdbool.h>
 #include <stdio.h>
+#include <sys/types.h>
 
 #include "misc.h"
 #include "yaml.h"
 
 #define TAP13_HEADER	"TAP version 13\n"
 
+/* Suffix of index file name relative to log file name. */
+#define LOG_INDEX_SUFFIX	".idx"
+#define LOG_INDEX_HEADER	"# tela log index 1\n"
+
+/**
+ * struct log_index_entry - Location of a testcase result in a TAP13 log
+ * @num: Test number
+ * @result: Testcase result
+ * @offset: Byte offset of test result line in log
+ * @length: Length in bytes of test result line and YAML data
+ * @duration_ms: Testcase duration in milliseconds or -1 if not known
+ * @name: Testcase name
+ */
+struct log_index_entry {
+	int num;
+	enum tela_result_t result;
+	off_t offset;
+	size_t length;
+	double duration_ms;
+	char *name;
+};
+
+/**
+ * struct log_metrics - Metrics found in the YAML data of a testcase result
+ * @duration_ms: Duration in milliseconds or -1 if unknown
+ * @utime_ms: CPU time spent in user mode in milliseconds or -1 if unknown
+ * @stime_ms: CPU time spent in kernel mode in milliseconds or -1 if unknown
+ * @maxrss_kb: Maximum resident set size in kilobytes or -1 if unknown
+ * @in_rusage: Flag indicating that parsed YAML data is inside the rusage
+ *             mapping
+ */
+struct log_metrics {
+	double duration_ms;
+	double utime_ms;
+	double stime_ms;
+	long maxrss_kb;
+	bool in_rusage;
+};
+
+struct phase_data;
 struct rec_result;
 
 void log_diag(FILE *log);
@@ -23,18 +64,25 @@ void log_header(FILE *fd);
 void log_plan(FILE *fd, int numtests);
 void log_result(FILE *fd, const char *name, const char *testexec, int num,
 		enum tela_result_t result, const char *reason,
-		struct rec_result *res, struct yaml_node *desc,
-		const char *testrexec);
+		struct rec_result *res, struct phase_data *phases,
+		struct yaml_node *desc, const char *testrexec);
 void log_all_result(FILE *fd, const char *testexec, enum tela_result_t result,
 		const char *reason, struct rec_result *res,
-		const char *testrexec, struct yaml_node *desc, int num,
-		int plan);
+		struct phase_data *phases, const char *testrexec,
+		struct yaml_node *desc, int num, int plan);
 bool log_parse_plan(const char *s, int *numtests);
 bool log_parse_line(const char *s, char **name_p, int *num_p,
 		    enum tela_result_t *result_p, char **reason_p);
 bool log_parse_bail(const char *line);
 const char *log_parse_warning(const char *line);
+void log_metrics_init(struct log_metrics *m);
+bool log_metrics_parse(struct log_metrics *m, const char *line);
 void log_line(FILE *fd, int num, const char *name, enum tela_result_t result,
 	      const char *reason);
+const char *log_result_str(enum tela_result_t result);
+void log_index_write(FILE *fd, struct log_index_entry *entry);
+bool log_index_read(const char *path, struct log_index_entry **entries_p,
+		    int *num_p);
+void log_index_free(struct log_index_entry *entries, int num);
 
 #endif /* LOG_H */
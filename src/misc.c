@@ -784,3 +784,172 @@ void misc_cloexec(int fd)
 	if (fcntl(fd, F_SETFD, FD_CLOEXEC) != 0)
 		warn("Could not set FD_CLOEXEC on fd %d", fd);
 }
+
+/*
+ * Parse decimal and binary unit prefixes in @s and return the resulting
+ * factor. Decimal prefixes include 'k', 'm', 'g', and 't', binary prefixes
+ * include 'ki', 'mi', 'gi', 'ti'.
+ */
+unsigned long misc_parse_scale(char **s)
+{
+	char unit = tolower((*s)[0]), unit2 = unit ? tolower((*s)[1]) : 0;
+
+	switch (unit) {
+	case 'k':
+		(*s)++;
+		if (unit2 == 'i') {
+			(*s)++;
+			return 1UL << 10;
+		}
+		return 1000UL;
+	case 'm':
+		(*s)++;
+		if (unit2 == 'i') {
+			(*s)++;
+			return 1UL << 20;
+		}
+		return 1000000UL;
+	case 'g':
+		(*s)++;
+		if (unit2 == 'i') {
+			(*s)++;
+			return 1UL << 30;
+		}
+		return 1000000000UL;
+	case 't':
+		(*s)++;
+		if (unit2 == 'i') {
+			(*s)++;
+			return 1UL << 40;
+		}
+		return 1000000000000UL;
+	}
+
+	return 1;
+}
+
+/*
+ * Parse size specification @s consisting of a number followed by an optional
+ * unit prefix (see misc_parse_scale()) and an optional 'b' or 'B'. Store
+ * the resulting number of bytes in @size. Return %true on success, %false
+ * if @s is not a valid size specification.
+ */
+bool misc_parse_size(const char *s, long *size)
+{
+	char *next;
+	long value;
+
+	value = strtol(s, &next, 0);
+	if (next == s || value < 0)
+		return false;
+	misc_skip_space(next);
+	value *= misc_parse_scale(&next);
+	if (tolower(*next) == 'b')
+		next++;
+	misc_skip_space(next);
+	if (*next)
+		return false;
+	*size = value;
+
+	return true;
+}
+
+/* Return a FNV-1a hash value for string @s. */
+unsigned long misc_hash_str(const char *s)
+{
+	unsigned long hash = 14695981039346656037UL;
+
+	for (; *s; s++) {
+		hash ^= (unsigned char) *s;
+		hash *= 1099511628211UL;
+	}
+
+	return hash;
+}
+
+/*
+ * misc_htab_init - Initialize hash table
+ * @htab: Hash table
+ * @num: Expected number of entries
+ */
+void misc_htab_init(struct misc_htab *htab, size_t num)
+{
+	/* Keep load factor below 50% to keep probe sequences short. */
+	for (htab->size = 8; htab->size < num * 2; htab->size *= 2)
+		;
+	htab->entries = misc_malloc(htab->size * sizeof(*htab->entries));
+	htab->num = 0;
+}
+
+/* Return slot for @key with @hash in @htab. */
+static struct misc_htab_entry *htab_slot(struct misc_htab *htab,
+					 const char *key, unsigned long hash)
+{
+	struct misc_htab_entry *e;
+	size_t i;
+
+	for (i = hash & (htab->size - 1);; i = (i + 1) & (htab->size - 1)) {
+		e = &htab->entries[i];
+		if (!e->key || (e->hash == hash && strcmp(e->key, key) == 0))
+			return e;
+	}
+}
+
+/*
+ * misc_htab_get - Look up string in hash table
+ * @htab: Hash table
+ * @key: Key string
+ *
+ * Return value stored for @key or %NULL if @key was not found.
+ */
+void *misc_htab_get(struct misc_htab *htab, const char *key)
+{
+	return htab_slot(htab, key, misc_hash_str(key))->value;
+}
+
+/*
+ * misc_htab_put - Store value in hash table
+ * @htab: Hash table
+ * @key: Key string
+ * @value: Value
+ *
+ * Store @value for @key, replacing any value previously stored for @key.
+ */
+void misc_htab_put(struct misc_htab *htab, const char *key, void *value)
+{
+	struct misc_htab_entry *old, *e;
+	unsigned long hash;
+	size_t i, size;
+
+	if ((htab->num + 1) * 2 > htab->size) {
+		old = htab->entries;
+		size = htab->size;
+		misc_htab_init(htab, size);
+		for (i = 0; i < size; i++) {
+			if (!old[i].key)
+				continue;
+			e = htab_slot(htab, old[i].key, old[i].hash);
+			*e = old[i];
+			htab->num++;
+		}
+		free(old);
+	}
+
+	hash = misc_hash_str(key);
+	e = htab_slot(htab, key, hash);
+	if (!e->key) {
+		e->key = key;
+		e->hash = hash;
+		htab->num++;
+	}
+	e->value = value;
+}
+
+/* Release resources associated with hash table @htab. */
+void misc_htab_free(struct misc_htab *htab)
+{
+	free(htab->entries);
+	htab->entries = NULL;
+	htab->size = 0;
+	htab->num = 0;
+}
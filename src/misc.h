@@ -101,6 +101,27 @@ struct misc_map {
 	const char *to;
 };
 
+struct misc_htab_entry {
+	const char *key;
+	unsigned long hash;
+	void *value;
+};
+
+/**
+ * struct misc_htab - Open-addressing hash table mapping strings to pointers
+ * @entries: Array of @size slots, a slot is unused if its key is %NULL
+ * @size: Number of slots, always a power of 2
+ * @num: Number of used slots
+ *
+ * Keys are not copied - callers must make sure that a key string stays
+ * valid for as long as it is stored in the table.
+ */
+struct misc_htab {
+	struct misc_htab_entry *entries;
+	size_t size;
+	size_t num;
+};
+
 /* Contains codes for controlling colored output on stdout and stderr. */
 extern struct color_t color, color_stderr;
 
@@ -165,5 +186,12 @@ void misc_add_one_env(char ***env_ptr, int *num_ptr, const char *key,
 bool misc_unquote(char *str, struct misc_map *single_map,
 		  struct misc_map *double_map);
 void misc_cloexec(int fd);
+unsigned long misc_parse_scale(char **s);
+bool misc_parse_size(const char *s, long *size);
+unsigned long misc_hash_str(const char *s);
+void misc_htab_init(struct misc_htab *htab, size_t num);
+void *misc_htab_get(struct misc_htab *htab, const char *key);
+void misc_htab_put(struct misc_htab *htab, const char *key, void *value);
+void misc_htab_free(struct misc_htab *htab);
 
 #endif /* MISC_H */
@@ -0,0 +1,233 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Functions for counting performance events using perf_event_open().
+ *
+ * Copyright IBM Corp. 2023
+ */
+
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "misc.h"
+#include "perf.h"
+
+/**
+ * struct perf_event_def - Definition of a named performance event
+ * @name: Event name as used by the perf tool
+ * @type: Event type (PERF_TYPE_*)
+ * @config: Type-specific event configuration
+ * @fallback: Name of event to use if this event is not available
+ */
+struct perf_event_def {
+	const char *name;
+	uint32_t type;
+	uint64_t config;
+	const char *fallback;
+};
+
+#define HW(n, c, f)	{ (n), PERF_TYPE_HARDWARE, PERF_COUNT_HW_##c, (f) }
+#define SW(n, c)	{ (n), PERF_TYPE_SOFTWARE, PERF_COUNT_SW_##c, NULL }
+
+static const struct perf_event_def perf_events[] = {
+	HW("cycles",			CPU_CYCLES, "cpu-clock"),
+	HW("instructions",		INSTRUCTIONS, NULL),
+	HW("cache-references",		CACHE_REFERENCES, NULL),
+	HW("cache-misses",		CACHE_MISSES, NULL),
+	HW("branches",			BRANCH_INSTRUCTIONS, NULL),
+	HW("branch-misses",		BRANCH_MISSES, NULL),
+	HW("bus-cycles",		BUS_CYCLES, NULL),
+	HW("ref-cycles",		REF_CPU_CYCLES, NULL),
+	HW("stalled-cycles-frontend",	STALLED_CYCLES_FRONTEND, NULL),
+	HW("stalled-cycles-backend",	STALLED_CYCLES_BACKEND, NULL),
+	SW("cpu-clock",			CPU_CLOCK),
+	SW("task-clock",		TASK_CLOCK),
+	SW("page-faults",		PAGE_FAULTS),
+	SW("context-switches",		CONTEXT_SWITCHES),
+	SW("cpu-migrations",		CPU_MIGRATIONS),
+	SW("minor-faults",		PAGE_FAULTS_MIN),
+	SW("major-faults",		PAGE_FAULTS_MAJ),
+	SW("alignment-faults",		ALIGNMENT_FAULTS),
+	SW("emulation-faults",		EMULATION_FAULTS),
+};
+
+/* Events counted if no events are specified explicitly. */
+const char *perf_default_events[] = {
+	"task-clock", "context-switches", "cpu-migrations", "page-faults",
+	"cycles", "instructions", "branches", "branch-misses", NULL
+};
+
+/* Return the definition of event @name, or %NULL if @name is unknown. */
+static const struct perf_event_def *perf_find(const char *name)
+{
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(perf_events); i++) {
+		if (strcmp(perf_events[i].name, name) == 0)
+			return &perf_events[i];
+	}
+
+	return NULL;
+}
+
+/* Check if @name is the name of a supported event. */
+bool perf_known(const char *name)
+{
+	return perf_find(name);
+}
+
+/* Open a counter for event @def that counts for process @pid and all of its
+ * future child processes once @pid calls exec(). Return the file descriptor
+ * of the counter, or -1 on error. */
+static int perf_open_event(const struct perf_event_def *def, pid_t pid)
+{
+	struct perf_event_attr attr;
+	int fd;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = def->type;
+	attr.config = def->config;
+	attr.disabled = 1;
+	attr.enable_on_exec = 1;
+	attr.inherit = 1;
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+			   PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+	fd = syscall(SYS_perf_event_open, &attr, pid, -1, -1,
+		     PERF_FLAG_FD_CLOEXEC);
+	if (fd == -1 && (errno == EACCES || errno == EPERM)) {
+		/* Retry with counting restricted to user space as required
+		 * by higher perf_event_paranoid settings. */
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		fd = syscall(SYS_perf_event_open, &attr, pid, -1, -1,
+			     PERF_FLAG_FD_CLOEXEC);
+	}
+
+	return fd;
+}
+
+/* Check if @perf contains a counter for event @name. */
+static bool perf_has(struct perf_data *perf, const char *name)
+{
+	int i;
+
+	for (i = 0; i < perf->num; i++) {
+		if (strcmp(perf->counters[i].name, name) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+/**
+ * perf_open - Start counting performance events for a process
+ * @perf: Counter set to initialize
+ * @events: %NULL-terminated list of event names
+ * @pid: Process ID
+ *
+ * Open counters for each event in @events that start counting when process
+ * @pid calls exec(), and that include child processes created after that
+ * point. Events that are unknown or not available are skipped. If a hardware
+ * event is not available, a similar software event is used instead where
+ * possible. Return the number of counters opened.
+ */
+int perf_open(struct perf_data *perf, const char **events, pid_t pid)
+{
+	const struct perf_event_def *def;
+	struct perf_counter *c;
+	int i, fd;
+
+	memset(perf, 0, sizeof(*perf));
+	for (i = 0; events[i]; i++) {
+		def = perf_find(events[i]);
+		fd = -1;
+		while (def && !perf_has(perf, def->name)) {
+			fd = perf_open_event(def, pid);
+			if (fd != -1)
+				break;
+			debug("%s: event %s not available: %s\n", __func__,
+			      def->name, strerror(errno));
+			def = def->fallback ? perf_find(def->fallback) : NULL;
+		}
+		if (fd == -1)
+			continue;
+
+		perf->counters = misc_realloc(perf->counters,
+					      sizeof(*c) * (perf->num + 1));
+		c = &perf->counters[perf->num++];
+		memset(c, 0, sizeof(*c));
+		c->name = def->name;
+		c->fd = fd;
+	}
+
+	return perf->num;
+}
+
+/* Read final counter values of @perf and close associated counters. */
+void perf_read(struct perf_data *perf)
+{
+	struct perf_counter *c;
+	uint64_t data[3];
+	int i;
+
+	for (i = 0; i < perf->num; i++) {
+		c = &perf->counters[i];
+		if (c->fd == -1)
+			continue;
+		if (read(c->fd, data, sizeof(data)) == sizeof(data)) {
+			c->value = data[0];
+			c->enabled = data[1];
+			c->running = data[2];
+		}
+		close(c->fd);
+		c->fd = -1;
+	}
+}
+
+/* Print counter values of @perf indented by @indent spaces. Values of
+ * counters that were not running all of the time because of counter
+ * multiplexing are scaled up accordingly. */
+void perf_print(FILE *fd, struct perf_data *perf, int indent)
+{
+	struct perf_counter *c;
+	double value;
+	int i;
+
+	for (i = 0; i < perf->num; i++) {
+		c = &perf->counters[i];
+		if (c->running == 0) {
+			fprintf(fd, "%*s%s: 0 # not counted\n", indent, "",
+				c->name);
+		} else if (c->running < c->enabled) {
+			value = (double) c->value * c->enabled / c->running;
+			fprintf(fd, "%*s%s: %.0f # scaled, counted %.2f%%\n",
+				indent, "", c->name, value,
+				100.0 * c->running / c->enabled);
+		} else {
+			fprintf(fd, "%*s%s: %llu\n", indent, "", c->name,
+				(unsigned long long) c->value);
+		}
+	}
+}
+
+/* Release resources associated with @perf. */
+void perf_free(struct perf_data *perf)
+{
+	int i;
+
+	for (i = 0; i < perf->num; i++) {
+		if (perf->counters[i].fd != -1)
+			close(perf->counters[i].fd);
+	}
+	free(perf->counters);
+	perf->counters = NULL;
+	perf->num = 0;
+}
@@ -0,0 +1,50 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Functions for counting performance events using perf_event_open().
+ *
+ * Copyright IBM Corp. 2023
+ */
+
+#ifndef PERF_H
+#define PERF_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+/**
+ * struct perf_counter - A performance event counter
+ * @name: Name of event
+ * @fd: File descriptor of counter, or -1 if closed
+ * @value: Counter value
+ * @enabled: Time in nanoseconds that the counter was enabled
+ * @running: Time in nanoseconds that the counter was running
+ */
+struct perf_counter {
+	const char *name;
+	int fd;
+	uint64_t value;
+	uint64_t enabled;
+	uint64_t running;
+};
+
+/**
+ * struct perf_data - Set of performance event counters
+ * @num: Number of counters
+ * @counters: Array of @num counters
+ */
+struct perf_data {
+	int num;
+	struct perf_counter *counters;
+};
+
+extern const char *perf_default_events[];
+
+bool perf_known(const char *name);
+int perf_open(struct perf_data *perf, const char **events, pid_t pid);
+void perf_read(struct perf_data *perf);
+void perf_print(FILE *fd, struct perf_data *perf, int indent);
+void perf_free(struct perf_data *perf);
+
+#endif /* PERF_H */
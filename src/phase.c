@@ -0,0 +1,113 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Functions for measuring the duration of framework phases of a test run.
+ *
+ * Copyright IBM Corp. 2023
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "misc.h"
+#include "phase.h"
+
+/* Store the current time of a monotonic clock in @start. */
+void phase_start(struct timespec *start)
+{
+	clock_gettime(CLOCK_MONOTONIC, start);
+}
+
+/* Return the number of milliseconds passed since @start. */
+double phase_elapsed(struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (now.tv_sec - start->tv_sec) * 1000.0 +
+	       (now.tv_nsec - start->tv_nsec) / 1000000.0;
+}
+
+/* Add the time passed since @start to the duration of phase @name in @p.
+ * If @p is %NULL, do nothing. */
+void phase_stop(struct phase_data *p, const char *name,
+		struct timespec *start)
+{
+	if (p)
+		phase_add(p, name, phase_elapsed(start));
+}
+
+/* Add @ms milliseconds to the duration of phase @name in @p. */
+void phase_add(struct phase_data *p, const char *name, double ms)
+{
+	int i, num;
+
+	for (i = 0; i < p->num; i++) {
+		if (strcmp(p->names[i], name) == 0) {
+			p->ms[i] += ms;
+			return;
+		}
+	}
+
+	num = p->num;
+	misc_expand_array(&p->names, &num);
+	misc_expand_array(&p->ms, &p->num);
+	p->names[i] = misc_strdup(name);
+	p->ms[i] = ms;
+}
+
+/* Add phase durations from string @str in format "<name>=<ms> ..." to @p.
+ * Return %false if @str contains invalid data. */
+bool phase_parse(struct phase_data *p, const char *str)
+{
+	char *copy, *token, *save, *value, *end;
+	bool rc = true;
+	double ms;
+
+	copy = misc_strdup(str);
+	for (token = strtok_r(copy, " ", &save); token;
+	     token = strtok_r(NULL, " ", &save)) {
+		value = strchr(token, '=');
+		if (!value || value == token) {
+			rc = false;
+			continue;
+		}
+		*value++ = 0;
+		ms = strtod(value, &end);
+		if (*end || end == value || ms < 0) {
+			rc = false;
+			continue;
+		}
+		phase_add(p, token, ms);
+	}
+	free(copy);
+
+	return rc;
+}
+
+/* Print phase durations in @p as YAML mapping indented by @indent spaces. */
+void phase_print(FILE *fd, struct phase_data *p, int indent)
+{
+	int i;
+
+	if (p->num == 0)
+		return;
+
+	fprintf(fd, "%*sphases:\n", indent, "");
+	for (i = 0; i < p->num; i++) {
+		fprintf(fd, "%*s%s_ms: %.3f\n", indent + 2, "", p->names[i],
+			p->ms[i]);
+	}
+}
+
+/* Release resources associated with @p. */
+void phase_free(struct phase_data *p)
+{
+	int i;
+
+	for (i = 0; i < p->num; i++)
+		free(p->names[i]);
+	free(p->names);
+	free(p->ms);
+	memset(p, 0, sizeof(*p));
+}
@@ -0,0 +1,38 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Functions for measuring the duration of framework phases of a test run.
+ *
+ * Copyright IBM Corp. 2023
+ */
+
+#ifndef PHASE_H
+#define PHASE_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <time.h>
+
+/**
+ * struct phase_data - Durations of framework phases of a test run
+ * @names: Array of @num phase names
+ * @ms: Array of @num phase durations in milliseconds
+ * @num: Number of phases
+ *
+ * Phases are kept in the order in which they were first added.
+ */
+struct phase_data {
+	char **names;
+	double *ms;
+	int num;
+};
+
+void phase_start(struct timespec *start);
+double phase_elapsed(struct timespec *start);
+void phase_stop(struct phase_data *p, const char *name,
+		struct timespec *start);
+void phase_add(struct phase_data *p, const char *name, double ms);
+bool phase_parse(struct phase_data *p, const char *str);
+void phase_print(FILE *fd, struct phase_data *p, int indent);
+void phase_free(struct phase_data *p);
+
+#endif /* PHASE_H */
@@ -11,15 +11,18 @@
 #include <poll.h>
 #include <signal.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/resource.h>
+#include <sys/sendfile.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include "event.h"
 #include "misc.h"
 #include "record.h"
 
@@ -32,16 +35,25 @@ struct rec_mon {
 	int orig_stderr;
 	int stdout_p[2];
 	int stderr_p[2];
+	struct rec_opts opts;
 	linehandler_t handler;
 	void *data;
 	FILE *log;
+	FILE *index;
+	struct cg_group cg;
+	int sync_p[2];
 };
 
+/* Names of streams recorded by rec_record() and rec_start(). */
+static char *rec_names[] = { "stderr", "stdout" };
+
 /* Initialize monitoring data structure @mon. */
-static void rec_mon_init(struct rec_mon *mon, int scope, linehandler_t handler,
-			 void *data)
+static void rec_mon_init(struct rec_mon *mon, int scope, struct rec_opts *opts,
+			 linehandler_t handler, void *data)
 {
 	memset(mon, 0, sizeof(*mon));
+	if (opts)
+		mon->opts = *opts;
 
 	if (pipe(mon->stdout_p) == -1 || pipe(mon->stderr_p) == -1)
 		err(1, "Could not create pipes");
@@ -50,7 +62,8 @@ static void rec_mon_init(struct rec_mon *mon, int scope, linehandler_t handler,
 	mon->handler = handler;
 	mon->data = data;
 	mon->log = tmpfile();
-	if (!mon->log)
+	mon->index = tmpfile();
+	if (!mon->log || !mon->index)
 		err(1, "Could not create temporary file");
 
 	/* There's no need to keep these fds open in exec'd processes. */
@@ -59,6 +72,7 @@ static void rec_mon_init(struct rec_mon *mon, int scope, linehandler_t handler,
 	misc_cloexec(mon->stderr_p[0]);
 	misc_cloexec(mon->stderr_p[1]);
 	misc_cloexec(fileno(mon->log));
+	misc_cloexec(fileno(mon->index));
 }
 
 /* Prepare monitoring data structure @mon. If @source is true, the calling
@@ -98,6 +112,7 @@ static void rec_mon_cleanup(struct rec_mon *mon)
 		close(mon->stderr_p[PREAD]);
 	}
 	fflush(mon->log);
+	fflush(mon->index);
 }
 
 /* Redirect stdout and stderr to @new_stdout and @new_stderr. */
@@ -124,8 +139,19 @@ static void rec_redirect(int scope, int new_stdout, int new_stderr)
 static void rec_child(struct rec_mon *mon, char *cmd, char *argv[])
 {
 	int e;
+	char c;
 
 	/* Child: Run command.  */
+	if (mon->cg.path)
+		cg_enter(&mon->cg);
+	if (mon->opts.perf_events) {
+		/* Wait until parent has set up performance counters. */
+		close(mon->sync_p[PWRITE]);
+		while (read(mon->sync_p[PREAD], &c, 1) == -1 &&
+		       errno == EINTR)
+			;
+		close(mon->sync_p[PREAD]);
+	}
 	rec_mon_prepare(mon, true);
 	rec_redirect(mon->scope, mon->stdout_p[PWRITE], mon->stderr_p[PWRITE]);
 	execv(cmd, argv);
@@ -159,7 +185,7 @@ static void handle_line(FILE *log, struct rec_stream *stream,
 	char *copy;
 
 	/* Call handler if set. */
-	if (handler) {
+	if (handler && !stream->raw) {
 		copy = strndup(buf, len);
 		if (!copy)
 			oom();
@@ -172,6 +198,237 @@ static void handle_line(FILE *log, struct rec_stream *stream,
 		do_log_buf(log, tv, stream->name,  buf, len);
 }
 
+/**
+ * struct rec_index - Side index entry for captured output
+ * @offset: Offset of first data byte in capture file
+ * @sec: Timestamp seconds
+ * @usec: Timestamp microseconds
+ * @stream: Stream number
+ * @eof: Non-zero if the stream was closed
+ *
+ * An entry describes all data up to the offset of the next entry. A line is
+ * assigned the timestamp of the entry that contains its newline character.
+ * Offsets count all output bytes, including those that were not kept due
+ * to an output limit. The last entry in an index is a terminating entry
+ * with stream number %INDEX_END that marks the end of output.
+ */
+struct rec_index {
+	uint64_t offset;
+	uint32_t sec;
+	uint32_t usec;
+	uint16_t stream;
+	uint16_t eof;
+};
+
+/* Stream number of the terminating side index entry. */
+#define INDEX_END	0xffff
+
+/**
+ * struct rec_capture - Raw output capture state
+ * @fd: File descriptor of capture file
+ * @index: Stream receiving side index entries
+ * @offset: Number of bytes captured
+ * @limit: Number of bytes to keep from start and end of output (0 for all)
+ * @spill: If set, stream receiving a copy of all output data
+ * @last: Most recent side index entry
+ * @indexed: Flag indicating that @last is valid
+ * @no_splice: Flag indicating that splice() cannot be used
+ * @tail: Side index entries for data stored in the ring buffer
+ * @tail_first: Array index of first valid entry in @tail
+ * @tail_num: Number of valid entries in @tail
+ * @tail_size: Number of entries allocated for @tail
+ *
+ * With an output limit, the capture file contains the first @limit bytes of
+ * output, followed by a ring buffer of @limit bytes that contains the most
+ * recent output. Side index entries for data in the ring buffer are kept in
+ * memory until the recording ends, and are discarded once their data has
+ * been overwritten.
+ */
+struct rec_capture {
+	int fd;
+	FILE *index;
+	uint64_t offset;
+	uint64_t limit;
+	FILE *spill;
+	struct rec_index last;
+	bool indexed;
+	bool no_splice;
+	struct rec_index *tail;
+	size_t tail_first;
+	size_t tail_num;
+	size_t tail_size;
+};
+
+/* Maximum number of bytes to move from a single stream per poll event. */
+#define SPLICE_MAX	(1024 * 1024)
+
+/* Return the capture file position of the output byte at @offset for an
+ * output limit of @limit bytes. Store the number of bytes that can be stored
+ * contiguously from this position in @space. */
+static uint64_t capture_pos(uint64_t limit, uint64_t offset, uint64_t *space)
+{
+	if (!limit) {
+		*space = UINT64_MAX;
+		return offset;
+	}
+	if (offset < limit) {
+		*space = limit - offset;
+		return offset;
+	}
+	offset = (offset - limit) % limit;
+	*space = limit - offset;
+
+	return limit + offset;
+}
+
+/* Keep side index entry @e for data in the ring buffer. */
+static void capture_tail_add(struct rec_capture *cap, struct rec_index *e)
+{
+	if (cap->tail_first + cap->tail_num == cap->tail_size) {
+		if (cap->tail_first > cap->tail_num) {
+			memmove(cap->tail, cap->tail + cap->tail_first,
+				sizeof(*e) * cap->tail_num);
+			cap->tail_first = 0;
+		} else {
+			cap->tail_size = cap->tail_size ? cap->tail_size * 2 :
+							  64;
+			cap->tail = misc_realloc(cap->tail, sizeof(*e) *
+						 cap->tail_size);
+		}
+	}
+	cap->tail[cap->tail_first + cap->tail_num++] = *e;
+}
+
+/* Discard side index entries for data that was overwritten in the ring
+ * buffer. */
+static void capture_tail_prune(struct rec_capture *cap)
+{
+	uint64_t kept;
+
+	if (!cap->limit || cap->offset <= 2 * cap->limit)
+		return;
+
+	kept = cap->offset - cap->limit;
+	while (cap->tail_num > 1 &&
+	       cap->tail[cap->tail_first + 1].offset <= kept) {
+		cap->tail_first++;
+		cap->tail_num--;
+	}
+}
+
+/* Add a side index entry for data from stream @id received at time @tv. */
+static void capture_index(struct rec_capture *cap, int id, struct timeval *tv,
+			  bool eof)
+{
+	struct rec_index *last = &cap->last;
+
+	/* Data directly following the previous entry can share that entry. */
+	if (cap->indexed && !eof && !last->eof && last->stream == id &&
+	    last->sec == tv->tv_sec && last->usec == tv->tv_usec)
+		return;
+
+	last->offset = cap->offset;
+	last->sec = tv->tv_sec;
+	last->usec = tv->tv_usec;
+	last->stream = id;
+	last->eof = eof;
+	cap->indexed = true;
+	if (cap->limit && last->offset >= cap->limit)
+		capture_tail_add(cap, last);
+	else
+		fwrite(last, sizeof(*last), 1, cap->index);
+}
+
+/* Complete the side index of capture @cap. */
+static void capture_finish(struct rec_capture *cap)
+{
+	struct rec_index end;
+
+	fwrite(cap->tail + cap->tail_first, sizeof(*cap->tail), cap->tail_num,
+	       cap->index);
+	free(cap->tail);
+	cap->tail = NULL;
+	cap->tail_num = 0;
+
+	memset(&end, 0, sizeof(end));
+	end.offset = cap->offset;
+	end.stream = INDEX_END;
+	fwrite(&end, sizeof(end), 1, cap->index);
+}
+
+/* Store @len bytes of data from stream @id in the capture file. */
+static void capture_write(struct rec_capture *cap, int id, struct timeval *tv,
+			  char *buf, size_t len)
+{
+	uint64_t pos, space;
+	ssize_t rc;
+
+	capture_index(cap, id, tv, false);
+	if (cap->spill)
+		fwrite(buf, 1, len, cap->spill);
+	while (len > 0) {
+		pos = capture_pos(cap->limit, cap->offset, &space);
+		rc = pwrite(cap->fd, buf, space < len ? space : len, pos);
+		if (rc == -1 && errno == EINTR)
+			continue;
+		if (rc <= 0)
+			break;
+		buf += rc;
+		len -= rc;
+		cap->offset += rc;
+	}
+	capture_tail_prune(cap);
+}
+
+/* Result of reading from a stream. */
+enum rec_read {
+	/* All available data was read. */
+	rec_read_done,
+	/* More data may be available. */
+	rec_read_more,
+	/* Stream was closed. */
+	rec_read_eof,
+};
+
+/* Move data from @stream to the capture file without copying it to user
+ * space. Set @cap->no_splice if splice() is not supported. */
+static enum rec_read capture_splice(struct rec_capture *cap, int id,
+				    struct rec_stream *stream,
+				    struct timeval *tv)
+{
+	ssize_t rc, total = 0;
+	uint64_t space;
+	loff_t pos;
+
+	capture_index(cap, id, tv, false);
+	while (total < SPLICE_MAX) {
+		pos = capture_pos(cap->limit, cap->offset, &space);
+		if (space > (uint64_t) (SPLICE_MAX - total))
+			space = SPLICE_MAX - total;
+		rc = splice(stream->fd, NULL, cap->fd, &pos, space,
+			    SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+		if (rc > 0) {
+			total += rc;
+			cap->offset += rc;
+			capture_tail_prune(cap);
+			continue;
+		}
+		if (rc == 0)
+			return rec_read_eof;
+		if (errno == EINTR)
+			continue;
+		if (errno == EAGAIN)
+			return rec_read_done;
+		if (total == 0 && (errno == EINVAL || errno == ENOSYS)) {
+			cap->no_splice = true;
+			return rec_read_done;
+		}
+		return rec_read_eof;
+	}
+
+	return rec_read_more;
+}
+
 /* Use this structure to preserve data read from a stream but not yet
  * consumed because of a lack of newline character. */
 struct stream_state {
@@ -183,22 +440,37 @@ struct stream_state {
 #define BUFLEN	1024
 
 /* Copy data from @stream->fd to @log line-by-line, while prefixing each output
- * line with a header. */
-static size_t rec_log_line(FILE *log, struct rec_stream *stream,
-			   struct timeval *tv, linehandler_t handler,
-			   void *data, struct stream_state *ss)
+ * line with a header. If @cap is specified, store data in raw format in the
+ * capture file instead. If @nonblock is set, @stream->fd is in non-blocking
+ * mode and data is read until no more data is available. */
+static enum rec_read rec_log_line(FILE *log, struct rec_capture *cap, int id,
+				  struct rec_stream *stream, bool nonblock,
+				  struct timeval *tv, linehandler_t handler,
+				  void *data, struct stream_state *ss)
 {
 	char *buffer;
-	ssize_t rc, total = 0, buflen;
+	ssize_t rc, buflen;
 	off_t off, i;
-	bool cont = true;
+	bool cont = true, lines, eof = false;
+	enum rec_read result;
 	struct pollfd fds[1];
 
+	/* Use fast path if data is only captured. */
+	if (cap && stream->raw && !cap->no_splice && !cap->spill) {
+		result = capture_splice(cap, id, stream, tv);
+		if (!cap->no_splice)
+			return result;
+	}
+
+	/* Lines are only needed for the log and the handler. */
+	lines = log || (handler && !stream->raw);
+
 	/* Initialize local stream state. */
-	if (ss && ss->buffer) {
+	if (ss->buffer) {
 		buflen = ss->buflen;
 		buffer = ss->buffer;
 		off = ss->off;
+		ss->buffer = NULL;
 	} else {
 		buflen = BUFLEN;
 		buffer = misc_malloc(buflen);
@@ -207,15 +479,26 @@ static size_t rec_log_line(FILE *log, struct rec_stream *stream,
 
 	fds[0].fd = stream->fd;
 	fds[0].events = POLLIN;
-	while (cont &&
-	       (rc = read(stream->fd, buffer + off, buflen - off)) > 0) {
-		total += rc;
+	while (cont) {
+		rc = read(stream->fd, buffer + off, buflen - off);
+		if (rc == -1 && errno == EINTR)
+			continue;
+		if (rc <= 0) {
+			eof = rc == 0 || errno != EAGAIN;
+			break;
+		}
+		if (cap)
+			capture_write(cap, id, tv, buffer + off, rc);
 		rc += off;
 
 		/* Check if there is more data to read. */
-		cont = poll(fds, 1, 0) == 1 && (fds[0].revents & POLLIN);
+		cont = nonblock ||
+		       (poll(fds, 1, 0) == 1 && (fds[0].revents & POLLIN));
 
 		off = 0;
+		if (!lines)
+			continue;
+
 		while (rc > 0) {
 			/* Get line end. */
 			for (i = 0; i < rc && buffer[i] != '\n'; i++)
@@ -224,7 +507,7 @@ static size_t rec_log_line(FILE *log, struct rec_stream *stream,
 			if (i < rc) {
 				/* Include newline when writing line. */
 				i++;
-			} else if (cont || ss) {
+			} else {
 				/* Got partial line, read rest. */
 				if (rc == buflen) {
 					/* Line exceeds buffer size. */
@@ -233,19 +516,8 @@ static size_t rec_log_line(FILE *log, struct rec_stream *stream,
 					if (!buffer)
 						oom();
 				}
-
-				if (cont) {
-					/* More data available. */
-					off = rc;
-					break;
-				}
-
-				/* No new line and no more data - save
-				 * line until next time data is available. */
-				ss->buffer = buffer;
-				ss->buflen = buflen;
-				ss->off = rc;
-				goto out;
+				off = rc;
+				break;
 			}
 
 			handle_line(log, stream, tv, handler, data, buffer, i);
@@ -253,31 +525,79 @@ static size_t rec_log_line(FILE *log, struct rec_stream *stream,
 			rc -= i;
 			if (rc > 0)
 				memmove(buffer, buffer + i, rc);
+
+			/* Skip remaining lines if the handler lost interest. */
+			if (!log && stream->raw) {
+				lines = false;
+				off = 0;
+				break;
+			}
 		}
 	}
 
+	if (off > 0 && !eof) {
+		/* No newline and no more data - save line until next time
+		 * data is available. */
+		ss->buffer = buffer;
+		ss->buflen = buflen;
+		ss->off = off;
+		return rec_read_done;
+	}
+
 	/* Consume residual data (on EOF). */
 	if (off > 0)
 		handle_line(log, stream, tv, handler, data, buffer, off);
-
 	free(buffer);
 
-	if (ss) {
-		/* All data consumed - clear stream state. */
-		ss->buffer = NULL;
-	}
-
-out:
-	return total;
+	return eof ? rec_read_eof : rec_read_done;
 }
 
-struct ctl_data {
+/**
+ * struct rec_logger - State of a recording event loop
+ * @loop: Event loop
+ * @log: Stream receiving output in log format (or %NULL)
+ * @cap: Raw output capture state (or %NULL)
+ * @handler: Line handler for stream data (or %NULL)
+ * @data: Data pointer for @handler
+ * @start_time: Time that timestamps are relative to (or %NULL)
+ * @tv: Timestamp of current event
+ * @streamc: Number of streams registered so far
+ * @sources: List of event sources of open streams
+ * @names: Names of all streams registered so far, including closed ones
+ */
+struct rec_logger {
+	struct ev_loop loop;
 	FILE *log;
-	struct timeval *tv;
-	struct pollfd **fds_ptr;
-	struct rec_stream **streams_ptr;
-	int *streamc_ptr;
-	int *openfd_ptr;
+	struct rec_capture *cap;
+	linehandler_t handler;
+	void *data;
+	struct timeval *start_time;
+	struct timeval tv;
+	int streamc;
+	struct rec_source *sources;
+	struct misc_htab names;
+};
+
+/**
+ * struct rec_source - Event source for a recorded stream
+ * @ev: Event source
+ * @logger: Recording state
+ * @stream: Stream to record
+ * @id: Stream number
+ * @ss: Data of partial line
+ * @dynamic: Flag indicating that @stream was registered via a control stream
+ * @prev: Previous source in list of sources
+ * @next: Next source in list of sources
+ */
+struct rec_source {
+	struct ev_source ev;
+	struct rec_logger *logger;
+	struct rec_stream *stream;
+	int id;
+	struct stream_state ss;
+	bool dynamic;
+	struct rec_source *prev;
+	struct rec_source *next;
 };
 
 /* Flag used to indicate that logging should end. */
@@ -297,20 +617,80 @@ static void do_log_str(FILE *log, struct timeval *tv, char *name, char *fmt,
 	free(str);
 }
 
+static bool source_handler(struct ev_loop *loop, struct ev_source *ev);
+
+/* Start recording data from @stream. */
+static void source_add(struct rec_logger *lg, struct rec_stream *stream,
+		       bool dynamic)
+{
+	struct rec_source *src;
+	int flags = 0;
+	char *name;
+
+	if (stream->name) {
+		name = misc_strdup(stream->name);
+		misc_htab_put(&lg->names, name, name);
+	}
+
+	src = misc_malloc(sizeof(*src));
+	src->logger = lg;
+	src->stream = stream;
+	src->id = lg->streamc++;
+	src->dynamic = dynamic;
+	src->ev.fd = stream->fd;
+	src->ev.handler = source_handler;
+	src->ev.data = src;
+
+	src->next = lg->sources;
+	if (lg->sources)
+		lg->sources->prev = src;
+	lg->sources = src;
+
+	/* Standard streams may be shared with other processes and cannot be
+	 * switched to non-blocking mode. */
+	if (stream->fd > STDERR_FILENO)
+		flags |= EV_EDGE;
+	/* Count only non-control file descriptors as open. */
+	if (!stream->name || stream->nocount)
+		flags |= EV_NOCOUNT;
+	ev_add(&lg->loop, &src->ev, flags);
+}
+
+/* Stop recording data from the stream associated with @src. */
+static void source_del(struct rec_source *src)
+{
+	struct rec_logger *lg = src->logger;
+
+	ev_del(&lg->loop, &src->ev);
+	if (src->prev)
+		src->prev->next = src->next;
+	else
+		lg->sources = src->next;
+	if (src->next)
+		src->next->prev = src->prev;
+
+	free(src->ss.buffer);
+	if (src->dynamic) {
+		free(src->stream->name);
+		close(src->stream->fd);
+		free(src->stream);
+	}
+	free(src);
+}
+
 /* Handle requests to open new streams sent via control file descriptors.
  * Format of requests must be "<stream name>:<path to stream>". */
 static void ctl_handler(void *data, char *line, struct rec_stream *stream)
 {
-	struct ctl_data *ctl = data;
-	struct rec_stream *streams = *ctl->streams_ptr;
-	int streamc = *ctl->streamc_ptr, i, fd;
-	struct pollfd *fds;
+	struct rec_logger *lg = data;
+	struct rec_stream *new;
 	char *filename;
+	int fd;
 
 	misc_strip_space(line);
 	filename = strchr(line, ':');
 	if (!filename) {
-		do_log_str(ctl->log, ctl->tv, line,
+		do_log_str(lg->log, &lg->tv, line,
 			   "Warning: Missing colon in stream argument");
 		return;
 	}
@@ -318,187 +698,237 @@ static void ctl_handler(void *data, char *line, struct rec_stream *stream)
 	filename++;
 
 	/* Check for duplicates. */
-	for (i = 0; i < streamc; i++) {
-		if (streams[i].name && strcmp(streams[i].name, line) == 0) {
-			do_log_str(ctl->log, ctl->tv, line,
-				   "Warning: Duplicate stream registered '%s'",
-				   line);
-			return;
-		}
+	if (misc_htab_get(&lg->names, line)) {
+		do_log_str(lg->log, &lg->tv, line,
+			   "Warning: Duplicate stream registered '%s'", line);
+		return;
 	}
 
 	fd = open(filename, O_RDONLY);
 	if (fd == -1) {
-		do_log_str(ctl->log, ctl->tv, line,
+		do_log_str(lg->log, &lg->tv, line,
 			   "Could not open file '%s': %s", filename,
 			   strerror(errno));
 		return;
 	}
-
-	/* Add new pollfd object. */
-	fds = misc_malloc(sizeof(struct pollfd) * (streamc + 1));
-	memcpy(fds, *ctl->fds_ptr, sizeof(struct pollfd) * streamc);
-	fds[streamc].fd = fd;
-	fds[streamc].events = POLLIN;
+	misc_cloexec(fd);
 
 	/* Add new stream object. */
-	streams = misc_malloc(sizeof(struct rec_stream) * (streamc + 1));
-	memcpy(streams, *ctl->streams_ptr, sizeof(struct rec_stream) * streamc);
-	streams[streamc].name = misc_strdup(line);
-	streams[streamc].fd = fd;
-	streamc++;
+	new = misc_malloc(sizeof(*new));
+	new->name = misc_strdup(line);
+	new->fd = fd;
+	source_add(lg, new, true);
+}
 
-	/* Update variables of main function. */
-	*ctl->fds_ptr = fds;
-	*ctl->streams_ptr = streams;
-	*ctl->streamc_ptr = streamc;
-	(*ctl->openfd_ptr)++;
+/* Update timestamp of current event. */
+static void logger_time(struct rec_logger *lg)
+{
+	gettimeofday(&lg->tv, NULL);
+	if (lg->start_time)
+		timersub(&lg->tv, lg->start_time, &lg->tv);
 }
 
-/* Receive output generated on specified file descriptors and store in log
- * format. If specified, call handler for each line. An entry in @streams
- * with a %NULL for name is not logged, but indicates a control stream
- * that can be used to add new streams. */
-void rec_log_streams(FILE *log, int streamc, struct rec_stream *streams,
-		     linehandler_t handler, void *data,
-		     struct timeval *start_time, struct timeval *stop_time)
+/* Handle stream closure for @src. */
+static void source_eof(struct rec_source *src)
 {
-	struct pollfd *fds;
-	struct timeval tv;
-	int i, openfd;
-	bool eof;
-	struct ctl_data ctl;
-	struct stream_state *ss;
+	struct rec_logger *lg = src->logger;
+	struct rec_stream *stream = src->stream;
 
-	debug("%s: starting logging\n", __func__);
+	if (lg->cap && stream->name)
+		capture_index(lg->cap, src->id, &lg->tv, true);
 
-	fds = misc_malloc(sizeof(struct pollfd) * streamc);
-	ss = misc_malloc(sizeof(struct stream_state) * streamc);
+	/* Send closing event if requested. */
+	if (lg->handler && stream->onclose)
+		lg->handler(lg->data, NULL, stream);
 
-	/* Set file descriptors to non-blocking. */
-	openfd = 0;
-	for (i = 0; i < streamc; i++) {
-		fds[i].fd = streams[i].fd;
-		fds[i].events = POLLIN;
+	debug("%s: stream %d/%s closed, %d remaining\n", __func__,
+	      stream->fd, stream->name, lg->loop.count - 1);
+}
 
-		/* Count only non-control file descriptors as open. */
-		if (streams[i].name && !streams[i].nocount)
-			openfd++;
+/* Receive data from the stream associated with event source @ev. */
+static bool source_handler(struct ev_loop *loop, struct ev_source *ev)
+{
+	struct rec_source *src = ev->data;
+	struct rec_logger *lg = src->logger;
+	struct rec_stream *stream = src->stream;
+	bool nonblock = ev->flags & EV_EDGE;
+	enum rec_read result;
+
+	logger_time(lg);
+	if (stream->name) {
+		/* Stream data. */
+		result = rec_log_line(lg->log, lg->cap, src->id, stream,
+				      nonblock, &lg->tv, lg->handler, lg->data,
+				      &src->ss);
+	} else {
+		/* Control data. */
+		result = rec_log_line(NULL, NULL, src->id, stream, nonblock,
+				      &lg->tv, ctl_handler, lg, &src->ss);
 	}
 
-	ctl.log = log;
-	ctl.tv = &tv;
-	ctl.fds_ptr = &fds;
-	ctl.streams_ptr = &streams;
-	ctl.streamc_ptr = &streamc;
-	ctl.openfd_ptr = &openfd;
+	if (result == rec_read_more)
+		return true;
+	if (result == rec_read_eof) {
+		source_eof(src);
+		source_del(src);
+	}
+
+	return false;
+}
+
+/* Receive output generated on specified file descriptors and store in log
+ * format in @log, or in raw format in @cap. If specified, call handler for each
+ * line. An entry in @streams with a %NULL for name is not logged, but
+ * indicates a control stream that can be used to add new streams. */
+static void log_streams(FILE *log, struct rec_capture *cap, int streamc,
+			struct rec_stream *streams, linehandler_t handler,
+			void *data, struct timeval *start_time,
+			struct timeval *stop_time, struct ev_source *timer,
+			unsigned long interval_ms)
+{
+	struct rec_logger lg;
+	struct rec_source *src;
+	size_t j;
+	int i;
+
+	debug("%s: starting logging\n", __func__);
+
+	memset(&lg, 0, sizeof(lg));
+	ev_init(&lg.loop);
+	misc_htab_init(&lg.names, streamc);
+	lg.log = log;
+	lg.cap = cap;
+	lg.handler = handler;
+	lg.data = data;
+	lg.start_time = start_time;
+	logger_time(&lg);
+
+	for (i = 0; i < streamc; i++)
+		source_add(&lg, &streams[i], false);
+	if (timer)
+		ev_timer(&lg.loop, timer, interval_ms);
 
 	/* Enable stop via SIGUSR1. */
 	log_stop = false;
 	signal(SIGUSR1, log_sig_handler);
 
 	/* Receive data from streams until all file descriptors are closed. */
-	while (openfd > 0 && !log_stop) {
-		if (poll(fds, streamc, -1) == -1) {
-			if (errno == EINTR)
-				continue;
-			break;
-		}
-		debug("%s: poll events received\n", __func__);
-
-		gettimeofday(&tv, NULL);
-		if (start_time)
-			timersub(&tv, start_time, &tv);
-
-		for (i = 0; i < streamc; i++) {
-			debug("%s: poll event: fd=%d/%s events=%04x "
-			      "revents=%04x\n", __func__, fds[i].fd,
-			      streams[i].name, fds[i].events, fds[i].revents);
-
-			eof = false;
-			if (fds[i].revents & POLLIN) {
-				if (streams[i].name) {
-					/* Stream data. */
-					if (rec_log_line(log, &streams[i], &tv,
-							 handler, data,
-							 &ss[i]) == 0)
-						eof = true;
-				} else {
-					/* Control data. */
-					if (rec_log_line(NULL, &streams[i], &tv,
-							 ctl_handler,
-							 &ctl, NULL) == 0)
-						eof = true;
-				}
-			} else if (fds[i].revents) {
-				/* EOF or POLLERR, POLLHUP or POLLNVAL. */
-				eof = true;
-			}
-			if (eof) {
-				if (ss[i].buffer) {
-					/* Consume pending data (without nl). */
-					handle_line(log, &streams[i], &tv,
-						    handler, data, ss[i].buffer,
-						    ss[i].off);
-					free(ss->buffer);
-					ss->buffer = NULL;
+	while (lg.loop.count > 0 && !log_stop)
+		ev_wait(&lg.loop);
 
-				}
-
-				/* Send closing event if requested. */
-				if (handler && streams[i].onclose)
-					handler(data, NULL, &streams[i]);
-
-				/* Stop watching this file descriptor. */
-				fds[i].fd = -1;
-				if (streams[i].name && !streams[i].nocount)
-					openfd--;
+	if (stop_time)
+		timeradd(&lg.tv, start_time, stop_time);
 
-				debug("%s: poll close event: fd %d/%s closed, "
-				      "%d remaining\n", __func__, fds[i].fd,
-				      streams[i].name, openfd);
-			}
+	/* Consume pending data (without nl) of streams that remain open. */
+	while ((src = lg.sources)) {
+		if (src->ss.buffer && src->stream->name) {
+			handle_line(log, src->stream, &lg.tv, handler, data,
+				    src->ss.buffer, src->ss.off);
 		}
+		source_del(src);
 	}
-	if (stop_time)
-		timeradd(&tv, start_time, stop_time);
+	if (timer)
+		ev_timer_del(&lg.loop, timer);
+	ev_exit(&lg.loop);
 
-	free(ss);
-	free(fds);
+	for (j = 0; j < lg.names.size; j++)
+		free(lg.names.entries[j].value);
+	misc_htab_free(&lg.names);
 
 	debug("%s: ending logging\n", __func__);
 }
 
+/* Receive output generated on specified file descriptors and store in log
+ * format. If specified, call handler for each line. An entry in @streams
+ * with a %NULL for name is not logged, but indicates a control stream
+ * that can be used to add new streams. */
+void rec_log_streams(FILE *log, int streamc, struct rec_stream *streams,
+		     linehandler_t handler, void *data,
+		     struct timeval *start_time, struct timeval *stop_time)
+{
+	log_streams(log, NULL, streamc, streams, handler, data, start_time,
+		    stop_time, NULL, 0);
+}
+
 static void rec_log(struct rec_mon *mon, struct timeval *start_time,
-		    struct timeval *stop_time)
+		    struct timeval *stop_time, struct smp_data *smp)
 {
 	struct rec_stream streams[2];
+	struct rec_capture cap;
 
 	rec_mon_prepare(mon, false);
 	memset(streams, 0, sizeof(streams));
-	streams[0].name = "stderr";
+	streams[0].name = rec_names[0];
 	streams[0].fd = mon->stderr_p[PREAD];
-	streams[1].name = "stdout";
+	streams[1].name = rec_names[1];
 	streams[1].fd = mon->stdout_p[PREAD];
 
-	rec_log_streams(mon->log, 2, streams, mon->handler, mon->data,
-			start_time, stop_time);
+	/* Output is stored in raw format and converted to log format by
+	 * rec_print(). */
+	memset(&cap, 0, sizeof(cap));
+	cap.fd = fileno(mon->log);
+	cap.index = mon->index;
+	cap.limit = mon->opts.output_limit;
+	cap.spill = mon->opts.spill;
+
+	log_streams(NULL, &cap, 2, streams, mon->handler, mon->data,
+		    start_time, stop_time, smp ? &smp->ev : NULL,
+		    smp ? smp->interval_ms : 0);
+	capture_finish(&cap);
+	if (smp)
+		smp_finish(smp);
 
 	rec_mon_cleanup(mon);
 }
 
+/* Make output recorded via @mon available in @res. */
+static void rec_mon_output(struct rec_mon *mon, struct rec_result *res)
+{
+	struct rec_index end;
+
+	if (!(mon->scope & (REC_STDOUT | REC_STDERR))) {
+		fclose(mon->log);
+		fclose(mon->index);
+		return;
+	}
+
+	res->output = mon->log;
+	res->output_index = mon->index;
+	res->output_limit = mon->opts.output_limit;
+	res->output_block = mon->opts.output_block;
+
+	/* Get total output size from terminating side index entry. */
+	if (fseek(mon->index, -(long) sizeof(end), SEEK_END) == 0 &&
+	    fread(&end, sizeof(end), 1, mon->index) == 1 &&
+	    end.stream == INDEX_END)
+		res->output_size = end.offset;
+	rewind(res->output);
+	rewind(res->output_index);
+	res->output_valid = true;
+}
+
 /* Run command specified by @cmd and @argv and store its result in @res.
  * @scope defines the scope of data to be recorded (see REC_* definitions).
+ * If non-null, @opts specifies additional recording parameters.
  * When specified as non-null, @handler is called for each line of data
  * recorded. @data is a data pointer to be passed to @handler. */
 void rec_record(struct rec_result *res, char *cmd, char *argv[], int scope,
-		linehandler_t handler, void *data)
+		struct rec_opts *opts, linehandler_t handler, void *data)
 {
 	struct rec_mon mon;
+	char *name;
 
 	memset(res, 0, sizeof(*res));
 
-	rec_mon_init(&mon, scope, handler, data);
+	rec_mon_init(&mon, scope, opts, handler, data);
+
+	if (scope & REC_CGROUP) {
+		name = misc_asprintf("tela-%d", getpid());
+		cg_create(&mon.cg, name);
+		free(name);
+	}
+	if (mon.opts.perf_events && pipe2(mon.sync_p, O_CLOEXEC) == -1)
+		err(1, "Could not create pipe");
 
 	gettimeofday(&res->start_time, NULL);
 
@@ -512,8 +942,21 @@ void rec_record(struct rec_result *res, char *cmd, char *argv[], int scope,
 
 	if (mon.pid == 0)
 		rec_child(&mon, cmd, argv);
-	else
-		rec_log(&mon, &res->start_time, &res->stop_time);
+
+	if (mon.opts.perf_events) {
+		/* Counting starts when the child calls exec(). */
+		close(mon.sync_p[PREAD]);
+		perf_open(&res->perf, mon.opts.perf_events, mon.pid);
+		close(mon.sync_p[PWRITE]);
+	}
+
+	if (mon.opts.sample_ms) {
+		smp_init(&res->samples, mon.opts.sample_ms,
+			 mon.cg.path ? &mon.cg : NULL, &res->start_time);
+	}
+
+	rec_log(&mon, &res->start_time, &res->stop_time,
+		mon.opts.sample_ms ? &res->samples : NULL);
 
 	timersub(&res->stop_time, &res->start_time, &res->duration);
 
@@ -524,13 +967,16 @@ void rec_record(struct rec_result *res, char *cmd, char *argv[], int scope,
 	if (scope & REC_RUSAGE)
 		res->rusage_valid = true;
 
-	if (mon.scope & (REC_STDOUT | REC_STDERR)) {
-		res->output = mon.log;
-		res->output_size = ftell(mon.log);
-		rewind(res->output);
-		res->output_valid = true;
-	} else
-		fclose(mon.log);
+	/* Get resource usage of all processes including those that were not
+	 * waited for, and clean up remaining processes. */
+	perf_read(&res->perf);
+	if (mon.cg.path) {
+		cg_read(&mon.cg, &res->cgroup);
+		res->cgroup_valid = true;
+		cg_release(&mon.cg, mon.opts.cgroup_kill);
+	}
+
+	rec_mon_output(&mon, res);
 }
 
 #define RADD(a,b,x)	((a)->x += (b)->x)
@@ -594,12 +1040,192 @@ static void rec_print_rusage(FILE *fd, struct rusage *r, int indent)
 	fprintf(fd, "%*snivcsw: %ld\n", indent, "", r->ru_nivcsw);
 }
 
-/* Print results recorded in @res indented by @indent spaces. */
-void rec_print(FILE *fd, struct rec_result *res, int indent)
+/* Print a line of captured output described by @e in log format. */
+static void print_line(FILE *fd, int indent, struct rec_index *e, char *buf,
+		       size_t len)
 {
-	char *line;
-	size_t n;
+	bool nl = buf[len - 1] == '\n';
+
+	/* Note: Line contents end at the first null character. */
+	fprintf(fd, "%*s[%4lu.%06lu] %s%s: %.*s\n", indent, "",
+		(unsigned long) e->sec, (unsigned long) e->usec,
+		e->stream < ARRAY_SIZE(rec_names) ? rec_names[e->stream] : "",
+		nl ? "" : "(nonl)", (int) (nl ? len - 1 : len), buf);
+}
+
+/* Partial line of captured output. */
+struct pending {
+	char *buf;
+	size_t len;
+	size_t size;
+	struct rec_index last;
+};
+
+/* Print all lines of captured output that end in the data from offset @off
+ * to @end described by side index entry @e. */
+static void print_entry(FILE *fd, int indent, struct rec_result *res,
+			struct rec_index *e, uint64_t off, uint64_t end,
+			struct pending *p)
+{
+	uint64_t pos, space;
+	char *start, *nl;
+	size_t len;
+	ssize_t rc;
+
+	p->last = *e;
+	while (off < end) {
+		/* Append next block of data to partial line. */
+		if (p->size - p->len < BUFLEN) {
+			p->size = p->len + BUFLEN * 64;
+			p->buf = misc_realloc(p->buf, p->size);
+		}
+		pos = capture_pos(res->output_limit, off, &space);
+		len = p->size - p->len;
+		if (len > end - off)
+			len = end - off;
+		if (len > space)
+			len = space;
+		rc = pread(fileno(res->output), p->buf + p->len, len, pos);
+		if (rc <= 0)
+			break;
+		off += rc;
 
+		start = p->buf;
+		while ((nl = memchr(start, '\n', p->buf + p->len + rc -
+					      start))) {
+			print_line(fd, indent, e, start, nl + 1 - start);
+			start = nl + 1;
+		}
+		p->len = p->buf + p->len + rc - start;
+		memmove(p->buf, start, p->len);
+	}
+}
+
+/* Print partial line @p. */
+static void print_pending(FILE *fd, int indent, struct pending *p)
+{
+	if (p->len > 0)
+		print_line(fd, indent, &p->last, p->buf, p->len);
+	p->len = 0;
+}
+
+/* Print output captured in @res in log format indented by @indent spaces. */
+static void print_output(FILE *fd, struct rec_result *res, int indent)
+{
+	struct pending pending[ARRAY_SIZE(rec_names)];
+	uint64_t off, end, gap_start = 0, gap_end = 0;
+	struct rec_index e, next;
+	bool valid, next_valid, gap;
+	size_t i;
+
+	/* Determine range of output data that was not kept. */
+	gap = rec_truncated(res);
+	if (gap) {
+		gap_start = res->output_limit;
+		gap_end = res->output_size - res->output_limit;
+	}
+
+	memset(pending, 0, sizeof(pending));
+	rewind(res->output_index);
+	valid = fread(&e, sizeof(e), 1, res->output_index) == 1;
+	while (valid && e.stream != INDEX_END) {
+		next_valid = fread(&next, sizeof(next), 1,
+				   res->output_index) == 1;
+		end = next_valid ? next.offset : res->output_size;
+		if (e.stream >= ARRAY_SIZE(pending))
+			goto next;
+
+		off = e.offset;
+		if (gap && end > gap_start) {
+			if (off < gap_start) {
+				print_entry(fd, indent, res, &e, off, gap_start,
+					    &pending[e.stream]);
+			}
+			if (end <= gap_end)
+				goto next;
+
+			/* Mark omitted output. */
+			for (i = 0; i < ARRAY_SIZE(pending); i++)
+				print_pending(fd, indent, &pending[i]);
+			fprintf(fd, "%*s[%4lu.%06lu] tela: %llu bytes of output "
+				"omitted\n", indent, "", (unsigned long) e.sec,
+				(unsigned long) e.usec,
+				(unsigned long long) (gap_end - gap_start));
+			if (off < gap_end)
+				off = gap_end;
+			gap = false;
+		}
+		print_entry(fd, indent, res, &e, off, end, &pending[e.stream]);
+		if (e.eof)
+			print_pending(fd, indent, &pending[e.stream]);
+next:
+		e = next;
+		valid = next_valid;
+	}
+
+	/* Print partial lines of streams that were not closed. */
+	for (i = 0; i < ARRAY_SIZE(pending); i++) {
+		print_pending(fd, indent, &pending[i]);
+		free(pending[i].buf);
+	}
+}
+
+/* Print output captured in @res indented by @indent spaces as a block of data
+ * that is prefixed by a line containing the block length. This enables a
+ * consumer of the resulting stream to forward the block without having to
+ * parse each line. */
+static void print_output_block(FILE *fd, struct rec_result *res, int indent)
+{
+	char buf[BUFLEN * 64];
+	off_t off = 0;
+	size_t size;
+	ssize_t rc;
+	FILE *tmp;
+
+	tmp = tmpfile();
+	if (!tmp) {
+		print_output(fd, res, indent);
+		return;
+	}
+	print_output(tmp, res, indent);
+	fflush(tmp);
+	size = ftello(tmp);
+
+	fprintf(fd, REC_BLOCK_FMT, size);
+	fflush(fd);
+	while (off < (off_t) size) {
+		rc = sendfile(fileno(fd), fileno(tmp), &off, size - off);
+		if (rc == -1 && errno == EINTR)
+			continue;
+		if (rc <= 0)
+			break;
+	}
+
+	/* Fall back to copying via user space. */
+	if (off < (off_t) size && fseeko(tmp, off, SEEK_SET) == 0) {
+		while ((rc = fread(buf, 1, sizeof(buf), tmp)) > 0)
+			fwrite(buf, 1, rc, fd);
+	}
+	fclose(tmp);
+}
+
+/**
+ * rec_truncated - Check if recorded output was truncated
+ * @res: Recording result
+ *
+ * Return %true if parts of the output recorded in @res were not kept because
+ * of an output limit.
+ */
+bool rec_truncated(struct rec_result *res)
+{
+	return res->output_limit && res->output_size > 2 * res->output_limit;
+}
+
+/* Print results recorded in @res indented by @indent spaces. If
+ * @res->output_block is set, output data is printed as a block of data that
+ * is prefixed by a line in REC_BLOCK_FMT format specifying the block length. */
+void rec_print(FILE *fd, struct rec_result *res, int indent)
+{
 	if (res->status_valid) {
 		if (WIFEXITED(res->status)) {
 			fprintf(fd, "%*sexitcode: %d\n", indent, "",
@@ -619,27 +1245,42 @@ void rec_print(FILE *fd, struct rec_result *res, int indent)
 		rec_print_rusage(fd, &res->rusage, indent + 2);
 	}
 
+	if (res->cgroup_valid) {
+		fprintf(fd, "%*scgroup:\n", indent, "");
+		cg_print(fd, &res->cgroup, indent + 2);
+	}
+
+	if (res->perf.num > 0) {
+		fprintf(fd, "%*sperf:\n", indent, "");
+		perf_print(fd, &res->perf, indent + 2);
+	}
+
+	if (res->samples.num > 0) {
+		fprintf(fd, "%*ssamples: |\n", indent, "");
+		smp_print(fd, &res->samples, indent + 2);
+	}
+
 	if (!res->output_valid)
 		return;
+	if (rec_truncated(res)) {
+		fprintf(fd, "%*soutput_bytes: %zu\n", indent, "",
+			res->output_size);
+		fprintf(fd, "%*soutput_omitted: %zu\n", indent, "",
+			res->output_size - 2 * res->output_limit);
+	}
 	if (res->output_size == 0) {
 		fprintf(fd, "%*soutput: \"\"\n", indent, "");
 	} else {
 		fprintf(fd, "%*soutput: |\n", indent, "");
-		rewind(res->output);
-		if (res->output) {
-			line = NULL;
-			while (getline(&line, &n, res->output) != -1) {
-				fprintf(fd, "%*s%s", indent + 2, "", line);
-				free(line);
-				line = NULL;
-			}
-			free(line);
-		}
+		if (res->output_block)
+			print_output_block(fd, res, indent + 2);
+		else
+			print_output(fd, res, indent + 2);
 	}
 }
 
-void rec_start(struct rec_result *res, int scope, linehandler_t handler,
-	       void *data)
+void rec_start(struct rec_result *res, int scope, struct rec_opts *opts,
+	       linehandler_t handler, void *data)
 {
 	struct rusage usage;
 	struct rec_mon *mon;
@@ -650,7 +1291,7 @@ void rec_start(struct rec_result *res, int scope, linehandler_t handler,
 		err(1, "Could not allocate memory");
 	mon = res->state;
 
-	rec_mon_init(mon, scope, handler, data);
+	rec_mon_init(mon, scope, opts, handler, data);
 
 	gettimeofday(&res->start_time, NULL);
 
@@ -663,7 +1304,7 @@ void rec_start(struct rec_result *res, int scope, linehandler_t handler,
 		err(1, "Could not fork");
 
 	if (mon->pid == 0) {
-		rec_log(mon, &res->start_time, NULL);
+		rec_log(mon, &res->start_time, NULL, NULL);
 		exit(0);
 	}
 
@@ -700,20 +1341,18 @@ void rec_stop(struct rec_result *res)
 	gettimeofday(&res->stop_time, NULL);
 	timersub(&res->stop_time, &res->start_time, &res->duration);
 
-	if (mon->scope & (REC_STDOUT | REC_STDERR)) {
-		res->output = mon->log;
-		res->output_size = ftell(mon->log);
-		rewind(res->output);
-		res->output_valid = true;
-	} else
-		fclose(mon->log);
+	rec_mon_output(mon, res);
 	free(res->state);
 }
 
 void rec_close(struct rec_result *res)
 {
-	if (res->output_valid)
+	perf_free(&res->perf);
+	smp_free(&res->samples);
+	if (res->output_valid) {
 		fclose(res->output);
+		fclose(res->output_index);
+	}
 }
 
 void rec_free_streams(int streamc, struct rec_stream *streams)
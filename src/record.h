@@ -13,6 +13,10 @@
 #include <sys/resource.h>
 #include <sys/time.h>
 
+#include "cgroup.h"
+#include "perf.h"
+#include "sample.h"
+
 /* Data recording scope. */
 
 /* Record output to standard output stream. */
@@ -24,18 +28,57 @@
 /* Record process resource usage. */
 #define REC_RUSAGE	4
 
+/* Record resource usage of all processes started by a command using a
+ * transient cgroup if available (rec_record() only). */
+#define REC_CGROUP	8
+
 /* Record all of the above. */
-#define REC_ALL		(REC_STDOUT | REC_STDERR | REC_RUSAGE)
+#define REC_ALL		(REC_STDOUT | REC_STDERR | REC_RUSAGE | REC_CGROUP)
+
+/* Prefix of lines carrying control information for 'tela format'. */
+#define REC_CTRL_PREFIX	"# tela: "
+
+/* Format of line announcing a length-prefixed block of output data. */
+#define REC_BLOCK_FMT	REC_CTRL_PREFIX "block %zu\n"
+
+/**
+ * struct rec_opts - Optional recording parameters
+ * @output_limit: If non-zero, only keep the first and the last @output_limit
+ *                bytes of output data
+ * @spill: If set, write a copy of all output data to this stream
+ * @output_block: If set, rec_print() emits output data as a length-prefixed
+ *                block (see rec_print())
+ * @cgroup_kill: If set, kill processes that remain in the transient cgroup
+ *               after the command ended (see %REC_CGROUP)
+ * @perf_events: If set, %NULL-terminated list of performance events to count
+ *               for the command (rec_record() only)
+ * @sample_ms: If non-zero, sample resource usage in intervals of this number
+ *             of milliseconds (rec_record() only)
+ */
+struct rec_opts {
+	size_t output_limit;
+	FILE *spill;
+	bool output_block;
+	bool cgroup_kill;
+	const char **perf_events;
+	unsigned long sample_ms;
+};
 
 struct rec_result {
 	/* Process status as returned by waitpid(). */
 	bool status_valid;
 	int status;
 	bool output_valid;
-	/* Stream containing timestamped output. */
+	/* Stream containing raw output data. */
 	FILE *output;
+	/* Stream containing the side index for @output. */
+	FILE *output_index;
 	/* Number of output bytes recorded. */
 	size_t output_size;
+	/* Number of bytes kept from start and end of output (0 for all). */
+	size_t output_limit;
+	/* Print output as length-prefixed block. */
+	bool output_block;
 	/* Recording start time. */
 	struct timeval start_time;
 	/* Recording end time. */
@@ -46,6 +89,13 @@ struct rec_result {
 	 * rec_stop(), maxrss includes usage before rec_start(). */
 	bool rusage_valid;
 	struct rusage rusage;
+	/* Resource usage of all processes in transient cgroup. */
+	bool cgroup_valid;
+	struct cg_usage cgroup;
+	/* Performance event counters. */
+	struct perf_data perf;
+	/* Resource usage samples. */
+	struct smp_data samples;
 	/* Internal state. */
 	void *state;
 };
@@ -58,12 +108,16 @@ struct rec_result {
  *           streams that must be closed for a recording call to end.
  * @onclose: If set, the handler function is called with a %NULL line when
  *           this stream is closed.
+ * @raw: If set, the handler function is no longer called for this stream.
+ *       Handlers may set this flag to enable a faster capture path for output
+ *       that they are not interested in.
  */
 struct rec_stream {
 	char *name;
 	int fd;
 	bool nocount;
 	bool onclose;
+	bool raw;
 };
 
 typedef void (*linehandler_t)(void *data, char *line,
@@ -73,10 +127,11 @@ void rec_log_streams(FILE *log, int streamc, struct rec_stream *streams,
 		     linehandler_t handler, void *data,
 		     struct timeval *start_time, struct timeval *stop_time);
 void rec_record(struct rec_result *res, char *cmd, char *argv[], int scope,
-		linehandler_t handler, void *data);
+		struct rec_opts *opts, linehandler_t handler, void *data);
+bool rec_truncated(struct rec_result *res);
 void rec_print(FILE *fd, struct rec_result *res, int indent);
-void rec_start(struct rec_result *res, int scope, linehandler_t handler,
-	       void *data);
+void rec_start(struct rec_result *res, int scope, struct rec_opts *opts,
+	       linehandler_t handler, void *data);
 void rec_stop(struct rec_result *res);
 void rec_close(struct rec_result *res);
 void rec_free_streams(int streamc, struct rec_stream *streams);
@@ -19,7 +19,9 @@
 #include <unistd.h>
 
 #include "misc.h"
+#include "phase.h"
 #include "resource.h"
+#include "trace.h"
 #include "yaml.h"
 
 #define LOCALHOST	"localhost"
@@ -368,6 +370,7 @@ static bool is_nonempty_scalar(struct yaml_node *node)
 static struct yaml_node *_sanitize_yaml(struct yaml_node *yaml, bool toplevel)
 {
 	struct yaml_node *node, *next, *prev = NULL;
+	char *key;
 
 	for (node = yaml; node; node = next) {
 		next = node->next;
@@ -390,8 +393,14 @@ static struct yaml_node *_sanitize_yaml(struct yaml_node *yaml, bool toplevel)
 			if (!is_nonempty_scalar(node->map.key))
 				goto remove;
 
-			/* Ensure single space between words in key scalars. */
-			sanitize_spacing(node->map.key->scalar.content);
+			/* Ensure single space between words in key scalars.
+			 * Key strings may be shared with other nodes, so
+			 * sanitize a copy. */
+			key = misc_strdup(node->map.key->scalar.content);
+			sanitize_spacing(key);
+			if (strcmp(key, node->map.key->scalar.content) != 0)
+				yaml_set_scalar(node->map.key, key);
+			free(key);
 
 			/* Recursively sanitize child nodes. */
 			node->map.value = _sanitize_yaml(node->map.value,
@@ -406,6 +415,7 @@ remove:
 		else
 			yaml = next;
 		node->next = NULL;
+		yaml_touch(prev ? prev : next);
 		yaml_free(node);
 	}
 
@@ -418,7 +428,10 @@ remove:
  */
 static struct yaml_node *sanitize_yaml(struct yaml_node *yaml)
 {
-	return _sanitize_yaml(yaml, true);
+	yaml = _sanitize_yaml(yaml, true);
+	yaml_touch(yaml);
+
+	return yaml;
 }
 
 /* Return key of mapping @node. */
@@ -534,12 +547,12 @@ static void cleanup_system(struct yaml_node *root)
 
 		if (match_key(node, "system")) {
 			/* Rename "system" to "system localhost". */
-			free(node->map.key->scalar.content);
-			node->map.key->scalar.content = misc_strdup(SYSLOCAL);
+			yaml_set_scalar(node->map.key, SYSLOCAL);
 		} else if (is_meta_section(node)) {
 			/* Remove meta sections. */
 			prev->next = next;
 			node->next = NULL;
+			yaml_touch(prev);
 			yaml_free(node);
 			continue;
 		} else if (!match_type_name(node, "system")) {
@@ -547,6 +560,7 @@ static void cleanup_system(struct yaml_node *root)
 			 * "system localhost" mapping. */
 			prev->next = next;
 			node->next = NULL;
+			yaml_touch(prev);
 			root->map.value = yaml_append(root->map.value, node);
 			continue;
 		}
@@ -593,48 +607,65 @@ static void handle_duplicates(struct yaml_node *a, struct yaml_node *b)
 {
 	if (a->type == yaml_scalar && b->type == yaml_scalar) {
 		/* New key replaces old key. */
-		free(a->scalar.content);
-		a->scalar.content = b->scalar.content;
-		b->scalar.content = NULL;
+		yaml_set_scalar(a, b->scalar.content);
 	} else
 		yaml_append(a, b);
 }
 
-/* Merge maps with the same name in @root and children. */
+/*
+ * Merge maps with the same name in @root and children. Later duplicates are
+ * merged into the first mapping with the same key, in list order. A hash
+ * table indexed by key keeps this linear in the number of nodes.
+ */
 static void merge_yaml(struct yaml_node *root)
 {
-	struct yaml_node *a, *b, *b_prev, *b_next;
-
-	for (a = root; a; a = a->next) {
-		if (a->type != yaml_map)
-			continue;
+	struct yaml_node *a, *b, *prev, *next;
+	struct misc_htab first;
+	size_t num = 0;
+	char *key;
 
-		for (b_prev = a, b = a->next; b; b = b_next) {
-			b_next = b->next;
+	for (a = root; a; a = a->next)
+		num++;
+	if (num < 2)
+		goto children;
 
-			if (b->type != yaml_map)
-				continue;
+	misc_htab_init(&first, num);
+	for (prev = NULL, b = root; b; b = next) {
+		next = b->next;
 
-			if (strcmp(get_key(a), get_key(b)) != 0) {
-				b_prev = b;
-				continue;
-			}
+		key = get_key(b);
+		if (!key) {
+			prev = b;
+			continue;
+		}
 
-			/* Append content of b to content of a. */
-			if (a->map.value && b->map.value)
-				handle_duplicates(a->map.value, b->map.value);
-			else if (!a->map.value)
-				a->map.value = b->map.value;
-
-			/* Remove b. */
-			b_prev->next = b->next;
-			b->next = NULL;
-			b->map.value = NULL;
-			yaml_free(b);
+		a = misc_htab_get(&first, key);
+		if (!a) {
+			misc_htab_put(&first, key, b);
+			prev = b;
+			continue;
 		}
 
-		/* Handle child mappings. */
-		if (a->map.value && a->map.value->type == yaml_map)
+		/* Append content of b to content of a. */
+		if (a->map.value && b->map.value)
+			handle_duplicates(a->map.value, b->map.value);
+		else if (!a->map.value)
+			yaml_append_child(a, b->map.value);
+
+		/* Remove b. */
+		prev->next = next;
+		b->next = NULL;
+		b->map.value = NULL;
+		yaml_touch(prev);
+		yaml_free(b);
+	}
+	misc_htab_free(&first);
+
+children:
+	/* Handle child mappings. */
+	for (a = root; a; a = a->next) {
+		if (a->type == yaml_map && a->map.value &&
+		    a->map.value->type == yaml_map)
 			merge_yaml(a->map.value);
 	}
 }
@@ -680,12 +711,12 @@ static struct yaml_node *get_resources(const char *filename, bool filter)
 	/* Read resource file. */
 	if (filename) {
 		if (filter)
-			result->next = filter_file(true, filename);
+			yaml_append(result, filter_file(true, filename));
 		else if (strcmp(filename, "-") == 0) {
-			result->next = yaml_parse_stream(stdin,
-							 "standard input");
+			yaml_append(result, yaml_parse_stream(stdin,
+							      "standard input"));
 		} else
-			result->next = yaml_parse_file("%s", filename);
+			yaml_append(result, yaml_parse_file("%s", filename));
 	}
 
 	/* Clean up resulting resource data. */
@@ -707,7 +738,7 @@ static struct yaml_node *get_requirements(const char *filename)
 
 	if (strcmp(filename, "-") == 0 || stat(filename, &buf) == 0) {
 		/* Add contents from testcase YAML file. */
-		result->next = filter_file(false, filename);
+		yaml_append(result, filter_file(false, filename));
 	}
 
 	/* Clean up resulting resource data. */
@@ -908,16 +939,17 @@ static bool resolve_copy_cb(struct yaml_iter *iter, void *data)
 
 static bool check_copy_cb(struct yaml_iter *iter, void *data)
 {
-	char *val;
+	char *val, *path;
 
 	/* Check for scalar marker. */
 	val = get_scalar_value(iter->node);
 	if (!val || !misc_starts_with(val, COPY_MARKER))
 		return true;
 
-	yaml_decode_path(iter->path);
+	path = yaml_iter_decoded_path(iter);
 	twarn(iter->node->filename, iter->node->lineno,
-	      "Unresolved copy reference '%s'", iter->path);
+	      "Unresolved copy reference '%s'", path);
+	free(path);
 	yaml_iter_del(iter);
 
 	return true;
@@ -1093,12 +1125,12 @@ static char *get_sysname(struct yaml_node *node)
 static void rename_systems(struct yaml_node *root, const char *sysname)
 {
 	struct yaml_node *node;
+	char *key;
 
-	yaml_for_each(node, root) {
-		free(node->map.key->scalar.content);
-		node->map.key->scalar.content =
-			misc_asprintf("system %s", sysname);
-	}
+	key = misc_asprintf("system %s", sysname);
+	yaml_for_each(node, root)
+		yaml_set_scalar(node->map.key, key);
+	free(key);
 }
 
 /*
@@ -1175,7 +1207,8 @@ static const char *get_cache_path(void)
  * the requested data. The resource file (res) and the output of the system
  * script (sysout) are stored in a temporary directory that persists for the
  * duration of one test run. Each combination of resource and system script
- * output file is called a "slot".
+ * output file is called a "slot". Cache files are only read by tela and use
+ * the binary YAML format.
  */
 
 /* Macro for generating path to cache file. */
@@ -1262,7 +1295,7 @@ static void update_cached_sysout(const char *path, const char *sysname,
 	new_sysout = yaml_dup(sysout, true, false);
 	new_sysout = yaml_append(new_sysout, old_sysout);
 	merge_yaml(new_sysout);
-	yaml_write_file(new_sysout, 0, true, CACHE_SYSOUT(path, sysname, i));
+	yaml_write_binary(new_sysout, true, CACHE_SYSOUT(path, sysname, i));
 	yaml_free(new_sysout);
 }
 
@@ -1279,10 +1312,10 @@ static void add_cached_sysout(const char *path, const char *sysname,
 	debug("sysout: adding cache slot %d", i);
 
 	/* Write resource file. */
-	yaml_write_file(res, 0, true, CACHE_RES(path, sysname, i));
+	yaml_write_binary(res, true, CACHE_RES(path, sysname, i));
 
 	/* Write sysout file. */
-	yaml_write_file(sysout, 0, true, CACHE_SYSOUT(path, sysname, i));
+	yaml_write_binary(sysout, true, CACHE_SYSOUT(path, sysname, i));
 }
 
 static struct yaml_node *get_sysout(const char *sysname, struct yaml_node *req,
@@ -1358,10 +1391,27 @@ out:
 	return sysout;
 }
 
+static void write_text(const char *filename, const char *fmt, ...)
+{
+	FILE *file;
+
+	get_varargs(fmt, text);
+
+	file = fopen(filename, "w");
+	if (file) {
+		fwrite(text, 1, strlen(text), file);
+		fclose(file);
+	}
+
+	free(text);
+}
+
 static pid_t start_sysout(const char *sysname, struct yaml_node *req,
 			  struct yaml_node *res, const char *filename)
 {
 	struct yaml_node *sysout;
+	struct timespec start;
+	char *name, *timefile;
 	pid_t pid;
 
 	pid = fork();
@@ -1374,26 +1424,21 @@ static pid_t start_sysout(const char *sysname, struct yaml_node *req,
 
 	/* Child process. */
 	misc_flush_cleanup();
+	name = misc_asprintf("collect %s", sysname);
+	trace_begin(name, NULL);
+	phase_start(&start);
 	sysout = get_sysout(sysname, req, res);
 	if (sysout)
-		yaml_write_file(sysout, 0, false, filename);
+		yaml_write_binary(sysout, false, filename);
 
-	exit(0);
-}
+	/* Report collection time to parent. */
+	timefile = misc_asprintf("%s.ms", filename);
+	write_text(timefile, "%.3f", phase_elapsed(&start));
+	free(timefile);
+	trace_end(name, NULL);
+	free(name);
 
-static void write_text(const char *filename, const char *fmt, ...)
-{
-	FILE *file;
-
-	get_varargs(fmt, text);
-
-	file = fopen(filename, "w");
-	if (file) {
-		fwrite(text, 1, strlen(text), file);
-		fclose(file);
-	}
-
-	free(text);
+	exit(0);
 }
 
 /* Return %true if system object @sys contains the _tela_final attribute. */
@@ -1415,15 +1460,37 @@ static bool is_final_sys(struct yaml_node *sys)
 	return false;
 }
 
-static struct yaml_node *get_state(struct yaml_node *req, struct yaml_node *res)
+/* Add the time spent collecting data for system @sysname as reported in
+ * file @filename to @phases. */
+static void add_collect_phase(struct phase_data *phases, const char *sysname,
+			      const char *filename)
 {
-	struct yaml_node *result = NULL, *node, *state, *copy;
+	char *name;
+	FILE *file;
+	double ms;
+
+	file = fopen(filename, "r");
+	if (!file)
+		return;
+	if (fscanf(file, "%lf", &ms) == 1) {
+		name = misc_asprintf("collect_%s", sysname);
+		phase_add(phases, name, ms);
+		free(name);
+	}
+	fclose(file);
+}
+
+static struct yaml_node *get_state(struct yaml_node *req, struct yaml_node *res,
+				   struct phase_data *phases)
+{
+	struct yaml_node *result = NULL, *node, *state, *next;
 	pid_t pid, *pids = NULL;
 	int num_pids = 0, i;
 	char *sysname, *outdir, *outfile;
 
 	printf("# tela: query state\n");
 	fflush(stdout);
+	trace_begin("state", NULL);
 
 	outdir = misc_mktempdir(NULL);
 
@@ -1449,16 +1516,21 @@ static struct yaml_node *get_state(struct yaml_node *req, struct yaml_node *res)
 			 * used as-is for resource matching without data
 			 * collection.
 			 */
-			yaml_write_file(node, 0, true, outfile);
+			yaml_write_binary(node, true, outfile);
 		} else {
 			/*
-			 * Start sub-process for collecting data. Use a single
-			 * node copy of @node here to enable use of
-			 * yaml_subset() for checking cache compatibility.
+			 * Start sub-process for collecting data. Temporarily
+			 * detach @node from its neighbors here to enable use
+			 * of yaml_subset() for checking cache compatibility.
+			 * The sub-process works on its own copy of memory, so
+			 * no duplicate is needed.
 			 */
-			copy = yaml_dup(node, true, false);
-			pid = start_sysout(sysname, req, copy, outfile);
-			yaml_free(copy);
+			next = node->next;
+			node->next = NULL;
+			yaml_touch(node);
+			pid = start_sysout(sysname, req, node, outfile);
+			node->next = next;
+			yaml_touch(node);
 
 			if (pid) {
 				/* Save child process PID. */
@@ -1479,6 +1551,13 @@ static struct yaml_node *get_state(struct yaml_node *req, struct yaml_node *res)
 	yaml_for_each(node, res) {
 		sysname = get_sysname(node);
 
+		if (phases) {
+			outfile = misc_asprintf("%s/sysout.%s.ms", outdir,
+						sysname);
+			add_collect_phase(phases, sysname, outfile);
+			free(outfile);
+		}
+
 		state = yaml_parse_file("%s/sysout.%s", outdir, sysname);
 		if (!state)
 			continue;
@@ -1500,6 +1579,7 @@ static struct yaml_node *get_state(struct yaml_node *req, struct yaml_node *res)
 
 	misc_remove(outdir);
 	free(outdir);
+	trace_end("state", NULL);
 
 	return result;
 }
@@ -1815,49 +1895,6 @@ out:
 	return result;
 }
 
-/*
- * Parse decimal and binary unit prefixes in @s and return the resulting
- * factor. Decimal prefixes include 'k', 'm', 'g', and 't', binary prefixes
- * include 'ki', 'mi', 'gi', 'ti'.
- */
-static unsigned long parse_scale(char **s)
-{
-	char unit = tolower((*s)[0]), unit2 = unit ? tolower((*s)[1]) : 0;
-
-	switch (unit) {
-	case 'k':
-		(*s)++;
-		if (unit2 == 'i') {
-			(*s)++;
-			return 1UL << 10;
-		}
-		return 1000UL;
-	case 'm':
-		(*s)++;
-		if (unit2 == 'i') {
-			(*s)++;
-			return 1UL << 20;
-		}
-		return 1000000UL;
-	case 'g':
-		(*s)++;
-		if (unit2 == 'i') {
-			(*s)++;
-			return 1UL << 30;
-		}
-		return 1000000000UL;
-	case 't':
-		(*s)++;
-		if (unit2 == 'i') {
-			(*s)++;
-			return 1UL << 40;
-		}
-		return 1000000000000UL;
-	}
-
-	return 1;
-}
-
 /*
  * Match numerical requirement:
  *   [<op>] <value> [<scale>]
@@ -1896,7 +1933,7 @@ static bool match_number(struct yaml_node *req_node, struct yaml_node *res_node)
 	} else
 		req = next;
 	misc_skip_space(req);
-	req_value *= parse_scale(&req);
+	req_value *= misc_parse_scale(&req);
 
 	/* Parse res. */
 	res_value = strtol(res, &next, 0);
@@ -1906,7 +1943,7 @@ static bool match_number(struct yaml_node *req_node, struct yaml_node *res_node)
 	} else
 		res = next;
 	misc_skip_space(res);
-	res_value *= parse_scale(&res);
+	res_value *= misc_parse_scale(&res);
 
 	result = cmp_number(res_value, req_value, op);
 
@@ -2518,7 +2555,7 @@ static bool update_objname_cb(struct yaml_iter *iter, void *data)
 {
 	struct yaml_node *node = iter->node, *res, *object_id;
 	struct match_data *mdata = md(node);
-	char *key, *id;
+	char *key, *id, *reskey;
 	int i;
 
 	if (!is_object(iter->path))
@@ -2537,15 +2574,18 @@ static bool update_objname_cb(struct yaml_iter *iter, void *data)
 		if (id) {
 			object_id = yaml_parse_string(__func__, "_id: %s",
 						      id + 1);
+			object_id = yaml_adopt(res, object_id);
 			if (object_id) {
 				/* Insert object_id attribute as first child. */
 				object_id->next = res->map.value;
 				res->map.value = object_id;
+				yaml_touch(res);
 			}
 		}
 
-		free(res->map.key->scalar.content);
-		res->map.key->scalar.content = get_reskey(key, i);
+		reskey = get_reskey(key, i);
+		yaml_set_scalar(res->map.key, reskey);
+		free(reskey);
 	}
 
 	return true;
@@ -2618,6 +2658,7 @@ static char **match_req(struct yaml_node *req, struct yaml_node *res,
  * @reason_ptr: Reason if requirements could not be resolved
  * @matchfile_ptr: If non-%null, write the matching resources in YAML format to
  *                 a temporary file and store its name in @matchfile_ptr
+ * @phases: If non-%null, add the durations of resolution phases to @phases
  *
  * Try to resolve all testcase resource requirements specified in @reqfile
  * with the available resources specified in @resfile.
@@ -2631,11 +2672,13 @@ static char **match_req(struct yaml_node *req, struct yaml_node *res,
  */
 char **res_resolve(const char *reqfile, const char *resfile,
 		   bool do_filter, bool do_state, char **reason_ptr,
-		   char **matchfile_ptr)
+		   char **matchfile_ptr, struct phase_data *phases)
 {
 	struct yaml_node *res, *req, *state;
+	struct timespec start;
 	char **env;
 
+	phase_start(&start);
 	get_types();
 
 	/* Get requirements. */
@@ -2643,15 +2686,25 @@ char **res_resolve(const char *reqfile, const char *resfile,
 
 	/* Get list of available resources. */
 	res = get_resources(resfile, do_filter);
-
-	/* Get state of resources. */
-	if (do_state)
-		state = get_state(req, res);
-	else
-		state = yaml_dup(res, false, false);
+	phase_stop(phases, "filter", &start);
+
+	/* Get state of resources. Without state, matching may modify the
+	 * resource list directly as it is not needed afterwards. */
+	if (do_state) {
+		phase_start(&start);
+		state = get_state(req, res, phases);
+		phase_stop(phases, "state", &start);
+	} else {
+		state = res;
+		res = NULL;
+	}
 
 	/* Try to find a match for all requirements. */
+	trace_begin("match", NULL);
+	phase_start(&start);
 	env = match_req(req, state, reason_ptr, matchfile_ptr);
+	phase_stop(phases, "match", &start);
+	trace_end("match", NULL);
 
 	/* Release temporary resources. */
 	yaml_free(state);
@@ -10,10 +10,12 @@
 
 #include <stdbool.h>
 
+#include "phase.h"
+
 char *res_get_resource_path(void);
 char **res_resolve(const char *reqfile, const char *resfile,
 		   bool do_filter, bool do_state, char **reason_ptr,
-		   char **matchfile_ptr);
+		   char **matchfile_ptr, struct phase_data *phases);
 bool res_eval(const char *type, const char *req, const char *res);
 
 #endif /* RESOURCE_H */
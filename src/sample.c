@@ -0,0 +1,258 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Functions for periodic sampling of system resource usage.
+ *
+ * Copyright IBM Corp. 2023
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "misc.h"
+#include "sample.h"
+
+/* Read values of keys listed in @keys from file @path containing lines in
+ * "<key>[:] <value>" format into @values. */
+static void smp_read_keys(const char *path, const char *keys[],
+			  uint64_t *values[])
+{
+	char *line = NULL, key[64], *colon;
+	unsigned long long value;
+	size_t n = 0;
+	FILE *fd;
+	int i;
+
+	fd = fopen(path, "r");
+	if (!fd)
+		return;
+	while (getline(&line, &n, fd) != -1) {
+		if (sscanf(line, "%63s %llu", key, &value) != 2)
+			continue;
+		colon = strchr(key, ':');
+		if (colon)
+			*colon = 0;
+		for (i = 0; keys[i]; i++) {
+			if (strcmp(key, keys[i]) == 0) {
+				*values[i] = value;
+				break;
+			}
+		}
+	}
+	free(line);
+	fclose(fd);
+}
+
+/* Read current absolute counter values into @abs. */
+static void smp_read(struct smp_data *smp, struct smp_row *abs)
+{
+	unsigned long long v[8];
+	struct timeval now, tv;
+	uint64_t total = 0, avail = 0;
+	struct cg_usage usage;
+	FILE *fd;
+
+	memset(abs, 0, sizeof(*abs));
+
+	gettimeofday(&now, NULL);
+	timersub(&now, &smp->start, &tv);
+	abs->time_ms = tv.tv_sec * 1000 + tv.tv_usec / 1000;
+
+	/* Fields: user nice system idle iowait irq softirq steal. */
+	fd = fopen("/proc/stat", "r");
+	if (fd) {
+		if (fscanf(fd, "cpu %llu %llu %llu %llu %llu %llu %llu %llu",
+			   &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6],
+			   &v[7]) == 8) {
+			abs->cpu_user = v[0] + v[1];
+			abs->cpu_system = v[2] + v[5] + v[6];
+			abs->cpu_iowait = v[4];
+			abs->cpu_total = v[0] + v[1] + v[2] + v[3] + v[4] +
+					 v[5] + v[6] + v[7];
+		}
+		fclose(fd);
+	}
+
+	smp_read_keys("/proc/meminfo",
+		      (const char *[]) { "MemTotal", "MemAvailable", NULL },
+		      (uint64_t *[]) { &total, &avail });
+	abs->mem_used_kb = total > avail ? total - avail : 0;
+
+	smp_read_keys("/proc/vmstat",
+		      (const char *[]) { "pgpgin", "pgpgout", NULL },
+		      (uint64_t *[]) { &abs->pgpgin_kb, &abs->pgpgout_kb });
+
+	if (smp->cg) {
+		cg_sample(smp->cg, &usage);
+		smp->cg_valid = usage.cpu_valid;
+		abs->cg_cpu_usec = usage.usage_usec;
+		abs->cg_mem_kb = usage.memory_current / 1024;
+		abs->cg_rbytes = usage.rbytes;
+		abs->cg_wbytes = usage.wbytes;
+	}
+}
+
+#define DELTA(d, a, b, x)	((d)->x = (a)->x > (b)->x ? (a)->x - (b)->x : 0)
+
+/* Store difference between absolute values @now and @last in @d. */
+static void smp_delta(struct smp_row *d, struct smp_row *now,
+		      struct smp_row *last)
+{
+	d->time_ms = now->time_ms;
+	DELTA(d, now, last, cpu_user);
+	DELTA(d, now, last, cpu_system);
+	DELTA(d, now, last, cpu_iowait);
+	DELTA(d, now, last, cpu_total);
+	d->mem_used_kb = now->mem_used_kb;
+	DELTA(d, now, last, pgpgin_kb);
+	DELTA(d, now, last, pgpgout_kb);
+	DELTA(d, now, last, cg_cpu_usec);
+	d->cg_mem_kb = now->cg_mem_kb;
+	DELTA(d, now, last, cg_rbytes);
+	DELTA(d, now, last, cg_wbytes);
+}
+
+#define SADD(a, b, x)	((a)->x += (b)->x)
+#define SMAX(a, b, x)	((a)->x = (a)->x > (b)->x ? (a)->x : (b)->x)
+
+/* Merge row @b that follows row @a into @a. */
+static void smp_merge(struct smp_row *a, struct smp_row *b)
+{
+	a->time_ms = b->time_ms;
+	SADD(a, b, cpu_user);
+	SADD(a, b, cpu_system);
+	SADD(a, b, cpu_iowait);
+	SADD(a, b, cpu_total);
+	SMAX(a, b, mem_used_kb);
+	SADD(a, b, pgpgin_kb);
+	SADD(a, b, pgpgout_kb);
+	SADD(a, b, cg_cpu_usec);
+	SMAX(a, b, cg_mem_kb);
+	SADD(a, b, cg_rbytes);
+	SADD(a, b, cg_wbytes);
+}
+
+/* Add @row to the rows of @smp. If all rows are used, halve the number of
+ * rows by merging adjacent rows. */
+static void smp_add(struct smp_data *smp, struct smp_row *row)
+{
+	int i;
+
+	if (smp->num == SMP_MAX_ROWS) {
+		for (i = 0; i < SMP_MAX_ROWS / 2; i++) {
+			smp->rows[i] = smp->rows[2 * i];
+			smp_merge(&smp->rows[i], &smp->rows[2 * i + 1]);
+		}
+		smp->num = SMP_MAX_ROWS / 2;
+		smp->merge *= 2;
+	}
+	smp->rows[smp->num++] = *row;
+}
+
+/* Take a sample. If @flush is set, add the resulting row even if the number
+ * of timer intervals per row has not yet been reached. */
+static void smp_take(struct smp_data *smp, bool flush)
+{
+	struct smp_row now, delta;
+
+	smp_read(smp, &now);
+	smp_delta(&delta, &now, &smp->last);
+	smp->last = now;
+
+	if (smp->ticks == 0)
+		smp->cur = delta;
+	else
+		smp_merge(&smp->cur, &delta);
+	if (++smp->ticks < smp->merge && !flush)
+		return;
+
+	smp_add(smp, &smp->cur);
+	smp->ticks = 0;
+}
+
+static bool smp_handler(struct ev_loop *loop, struct ev_source *ev)
+{
+	smp_take(ev->data, false);
+
+	return false;
+}
+
+/**
+ * smp_init - Prepare sampling of resource usage
+ * @smp: Sampling data to initialize
+ * @interval_ms: Sampling interval in milliseconds
+ * @cg: If non-null, cgroup containing test processes
+ * @start: Time that sample timestamps are relative to
+ *
+ * Record initial counter values. Samples are taken each time the event
+ * source @smp->ev is called, which is intended to be used with ev_timer().
+ */
+void smp_init(struct smp_data *smp, unsigned long interval_ms,
+	      struct cg_group *cg, struct timeval *start)
+{
+	memset(smp, 0, sizeof(*smp));
+	smp->ev.handler = smp_handler;
+	smp->ev.data = smp;
+	smp->interval_ms = interval_ms;
+	smp->cg = cg;
+	smp->start = *start;
+	smp->merge = 1;
+	smp->rows = misc_malloc(sizeof(*smp->rows) * SMP_MAX_ROWS);
+	smp_read(smp, &smp->last);
+}
+
+/* Take a final sample covering the time since the last sample. */
+void smp_finish(struct smp_data *smp)
+{
+	smp_take(smp, true);
+	smp->cg = NULL;
+}
+
+/* Return @a as percentage of @b. */
+static double smp_pct(uint64_t a, uint64_t b)
+{
+	return b ? 100.0 * a / b : 0.0;
+}
+
+/* Print samples in CSV format indented by @indent spaces. The first line
+ * contains column names. */
+void smp_print(FILE *fd, struct smp_data *smp, int indent)
+{
+	struct smp_row *r;
+	int i;
+
+	fprintf(fd, "%*stime_ms,cpu_user_pct,cpu_system_pct,cpu_iowait_pct,"
+		"mem_used_kb,pgpgin_kb,pgpgout_kb%s\n", indent, "",
+		smp->cg_valid ? ",test_cpu_ms,test_mem_kb,test_rbytes,"
+				"test_wbytes" : "");
+	for (i = 0; i < smp->num; i++) {
+		r = &smp->rows[i];
+		fprintf(fd, "%*s%u,%.1f,%.1f,%.1f,%llu,%llu,%llu", indent, "",
+			r->time_ms, smp_pct(r->cpu_user, r->cpu_total),
+			smp_pct(r->cpu_system, r->cpu_total),
+			smp_pct(r->cpu_iowait, r->cpu_total),
+			(unsigned long long) r->mem_used_kb,
+			(unsigned long long) r->pgpgin_kb,
+			(unsigned long long) r->pgpgout_kb);
+		if (smp->cg_valid) {
+			fprintf(fd, ",%llu.%03llu,%llu,%llu,%llu",
+				(unsigned long long) r->cg_cpu_usec / 1000,
+				(unsigned long long) r->cg_cpu_usec % 1000,
+				(unsigned long long) r->cg_mem_kb,
+				(unsigned long long) r->cg_rbytes,
+				(unsigned long long) r->cg_wbytes);
+		}
+		fprintf(fd, "\n");
+	}
+}
+
+/* Release resources associated with @smp. */
+void smp_free(struct smp_data *smp)
+{
+	free(smp->rows);
+	smp->rows = NULL;
+	smp->num = 0;
+}
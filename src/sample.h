@@ -0,0 +1,95 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Functions for periodic sampling of system resource usage.
+ *
+ * Copyright IBM Corp. 2023
+ */
+
+#ifndef SAMPLE_H
+#define SAMPLE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/time.h>
+
+#include "cgroup.h"
+#include "event.h"
+
+/* Maximum number of samples to keep. */
+#define SMP_MAX_ROWS	512
+
+/* Minimum sampling interval in milliseconds. */
+#define SMP_MIN_INTERVAL_MS	10
+
+/**
+ * struct smp_row - Resource usage during one sampling interval
+ * @time_ms: End of interval in milliseconds relative to sampling start
+ * @cpu_user: System-wide CPU time spent in user mode (in clock ticks)
+ * @cpu_system: System-wide CPU time spent in kernel mode (in clock ticks)
+ * @cpu_iowait: System-wide CPU time spent waiting for I/O (in clock ticks)
+ * @cpu_total: System-wide total CPU time (in clock ticks)
+ * @mem_used_kb: Maximum system-wide memory usage in kilobytes
+ * @pgpgin_kb: Kilobytes read from block devices system-wide
+ * @pgpgout_kb: Kilobytes written to block devices system-wide
+ * @cg_cpu_usec: CPU time used by test processes in microseconds
+ * @cg_mem_kb: Maximum memory usage of test processes in kilobytes
+ * @cg_rbytes: Bytes read from block devices by test processes
+ * @cg_wbytes: Bytes written to block devices by test processes
+ *
+ * Values are deltas over the sampling interval, except for maximum values.
+ */
+struct smp_row {
+	uint32_t time_ms;
+	uint64_t cpu_user;
+	uint64_t cpu_system;
+	uint64_t cpu_iowait;
+	uint64_t cpu_total;
+	uint64_t mem_used_kb;
+	uint64_t pgpgin_kb;
+	uint64_t pgpgout_kb;
+	uint64_t cg_cpu_usec;
+	uint64_t cg_mem_kb;
+	uint64_t cg_rbytes;
+	uint64_t cg_wbytes;
+};
+
+/**
+ * struct smp_data - Sampling state and results
+ * @ev: Timer event source
+ * @interval_ms: Timer interval in milliseconds
+ * @cg: Cgroup of test processes (or %NULL)
+ * @start: Sampling start time
+ * @last: Absolute counter values at the time of the most recent sample
+ * @cur: Row that accumulates samples until @merge timer intervals passed
+ * @ticks: Number of timer intervals accumulated in @cur
+ * @merge: Number of timer intervals per row
+ * @cg_valid: Flag indicating that cgroup data is available
+ * @rows: Array of @num rows
+ * @num: Number of rows
+ *
+ * Memory usage is bounded by %SMP_MAX_ROWS rows: when all rows are used,
+ * adjacent rows are merged and the number of timer intervals per row is
+ * doubled.
+ */
+struct smp_data {
+	struct ev_source ev;
+	unsigned long interval_ms;
+	struct cg_group *cg;
+	struct timeval start;
+	struct smp_row last;
+	struct smp_row cur;
+	int ticks;
+	int merge;
+	bool cg_valid;
+	struct smp_row *rows;
+	int num;
+};
+
+void smp_init(struct smp_data *smp, unsigned long interval_ms,
+	      struct cg_group *cg, struct timeval *start);
+void smp_finish(struct smp_data *smp);
+void smp_print(FILE *fd, struct smp_data *smp, int indent);
+void smp_free(struct smp_data *smp);
+
+#endif /* SAMPLE_H */
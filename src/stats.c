@@ -0,0 +1,443 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Functions for analyzing testcase metrics in TAP13 logs.
+ *
+ * Copyright IBM Corp. 2023
+ */
+
+#include <err.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+#include "misc.h"
+#include "stats.h"
+
+/* Maximum width of histogram bars. */
+#define STATS_BAR_WIDTH	40
+
+/**
+ * struct stats_dir - Aggregated metrics of testcases in a directory
+ * @name: Directory name
+ * @duration_ms: Sum of test executable run durations in milliseconds
+ * @execs: Number of test executable runs
+ */
+struct stats_dir {
+	char *name;
+	double duration_ms;
+	int execs;
+};
+
+/* Initialize @s for collecting metrics. At most @top entries are kept in
+ * lists of largest values. */
+void stats_init(struct stats_data *s, int top)
+{
+	memset(s, 0, sizeof(*s));
+	s->top = top;
+	s->slowest = misc_malloc(sizeof(*s->slowest) * top);
+	s->largest = misc_malloc(sizeof(*s->largest) * top);
+	misc_htab_init(&s->dirs, 0);
+}
+
+/* Reset @e to an empty test executable run. */
+static void stats_exec_init(struct stats_exec *e)
+{
+	memset(e, 0, sizeof(*e));
+	e->start = -1;
+	e->stop = -1;
+	log_metrics_init(&e->metrics);
+}
+
+/* Release resources associated with @e. */
+static void stats_exec_free(struct stats_exec *e)
+{
+	free(e->name);
+	free(e->testexec);
+	stats_exec_init(e);
+}
+
+/* Add @value for testcase @name to the list @list of @s->top largest values
+ * which currently contains *@num entries sorted in descending order. */
+static void stats_top_add(struct stats_data *s, struct stats_top *list,
+			  int *num, double value, const char *name)
+{
+	int i;
+
+	if (*num == s->top) {
+		if (s->top == 0 || value <= list[*num - 1].value)
+			return;
+		free(list[--(*num)].name);
+	}
+	for (i = *num; i > 0 && list[i - 1].value < value; i--)
+		list[i] = list[i - 1];
+	list[i].value = value;
+	list[i].name = misc_strdup(name);
+	(*num)++;
+}
+
+/* Add @duration_ms of testcase @name to the metrics of its directory. */
+static void stats_dir_add(struct stats_data *s, const char *name,
+			  double duration_ms)
+{
+	struct stats_dir *dir;
+	const char *slash;
+	char *dirname;
+
+	slash = strrchr(name, '/');
+	if (slash) {
+		dirname = misc_strdup(name);
+		dirname[slash - name] = 0;
+	} else
+		dirname = misc_strdup(".");
+	dir = misc_htab_get(&s->dirs, dirname);
+	if (!dir) {
+		dir = misc_malloc(sizeof(*dir));
+		dir->name = dirname;
+		misc_htab_put(&s->dirs, dir->name, dir);
+	} else
+		free(dirname);
+	dir->duration_ms += duration_ms;
+	dir->execs++;
+}
+
+/* Return the duration histogram bucket for @duration_ms. */
+static int stats_bucket(double duration_ms)
+{
+	int i;
+
+	for (i = 0; i < STATS_BUCKETS - 1 && duration_ms >= 1; i++)
+		duration_ms /= 2;
+
+	return i;
+}
+
+/* Add metrics of test executable run @e to @s and reset @e. */
+static void stats_exec_done(struct stats_data *s, struct stats_exec *e)
+{
+	struct log_metrics *m;
+	const char *name;
+	double delta;
+	char *colon;
+
+	if (e->results == 0)
+		return;
+	if (!e->name)
+		e->name = misc_strdup("");
+
+	/* Results of a test executable that reports multiple results are
+	 * named <testexec>:<name> - use only <testexec> part. */
+	colon = strchr(e->name, ':');
+	if (e->results > 1 && colon)
+		*colon = 0;
+	name = e->name;
+
+	s->execs++;
+	m = &e->metrics;
+	if (m->duration_ms >= 0) {
+		s->timed++;
+		s->duration_ms += m->duration_ms;
+		s->log_duration_ms += m->duration_ms;
+		s->histogram[stats_bucket(m->duration_ms)]++;
+		stats_top_add(s, s->slowest, &s->num_slowest, m->duration_ms,
+			      name);
+		stats_dir_add(s, name, m->duration_ms);
+	}
+	if (m->utime_ms >= 0)
+		s->utime_ms += m->utime_ms;
+	if (m->stime_ms >= 0)
+		s->stime_ms += m->stime_ms;
+	if (m->maxrss_kb >= 0) {
+		/* Update mean and variance using Welford's algorithm. */
+		s->rss_num++;
+		delta = m->maxrss_kb - s->rss_mean;
+		s->rss_mean += delta / s->rss_num;
+		s->rss_m2 += delta * (m->maxrss_kb - s->rss_mean);
+		stats_top_add(s, s->largest, &s->num_largest, m->maxrss_kb,
+			      name);
+	}
+	if (e->start >= 0 && (s->log_start < 0 || e->start < s->log_start))
+		s->log_start = e->start;
+	if (e->stop >= 0 && e->stop > s->log_stop)
+		s->log_stop = e->stop;
+
+	stats_exec_free(e);
+}
+
+/* Add metrics of result @r to @s. Results of the same test executable run
+ * are combined. */
+static void stats_result_done(struct stats_data *s, struct stats_exec *r)
+{
+	struct stats_exec *cur = &s->cur;
+
+	if (r->results == 0)
+		return;
+	if (cur->results > 0 && r->start >= 0 && r->start == cur->start &&
+	    r->testexec && cur->testexec &&
+	    strcmp(r->testexec, cur->testexec) == 0) {
+		cur->results++;
+		stats_exec_free(r);
+		return;
+	}
+	stats_exec_done(s, cur);
+	*cur = *r;
+	stats_exec_init(r);
+}
+
+/* Update result @r with YAML data @line. */
+static void stats_parse(struct stats_exec *r, const char *line)
+{
+	char *v;
+
+	if (log_metrics_parse(&r->metrics, line))
+		return;
+
+	/* Remaining keys are only found at the top level of YAML data. */
+	if (line[0] != ' ' || line[1] != ' ' || line[2] == ' ')
+		return;
+	if (sscanf(line, "  starttime: %lf", &r->start) == 1 ||
+	    sscanf(line, "  stoptime: %lf", &r->stop) == 1)
+		return;
+	if (misc_starts_with(line, "  testexec: \"")) {
+		free(r->testexec);
+		r->testexec = misc_strdup(line + strlen("  testexec: \""));
+		v = strrchr(r->testexec, '"');
+		if (v)
+			*v = 0;
+	}
+}
+
+/* Add metrics of all test executable runs in current log to @s. */
+static void stats_log_done(struct stats_data *s)
+{
+	double wall_ms;
+
+	stats_exec_done(s, &s->cur);
+	if (s->log_start >= 0 && s->log_stop >= s->log_start) {
+		wall_ms = (s->log_stop - s->log_start) * 1000;
+		s->wall_ms += wall_ms;
+		/* Ignore rounding errors in logged durations. */
+		if (wall_ms > s->log_duration_ms)
+			s->overhead_ms += wall_ms - s->log_duration_ms;
+	}
+}
+
+/**
+ * stats_read - Collect testcase metrics from a TAP13 log
+ * @s: Aggregated metrics
+ * @path: Path to TAP13 log or "-" for standard input
+ *
+ * Read the log at @path in a single pass and add metrics of all testcases
+ * to @s. Memory usage does not depend on log size. Return %true on success,
+ * %false if the log could not be opened.
+ */
+bool stats_read(struct stats_data *s, const char *path)
+{
+	enum tela_result_t result;
+	struct stats_exec r;
+	char *line = NULL, *name;
+	bool yaml = false;
+	size_t n = 0;
+	FILE *fd;
+
+	if (strcmp(path, "-") == 0)
+		fd = stdin;
+	else {
+		fd = fopen(path, "r");
+		if (!fd) {
+			warn("Could not open log '%s'", path);
+			return false;
+		}
+	}
+
+	s->logs++;
+	s->log_start = -1;
+	s->log_stop = -1;
+	s->log_duration_ms = 0;
+	stats_exec_init(&r);
+
+	while (getline(&line, &n, fd) != -1) {
+		/* Check first character before full parsing for speed. */
+		if ((*line == 'o' || *line == 'n') &&
+		    log_parse_line(line, &name, NULL, &result, NULL)) {
+			stats_result_done(s, &r);
+			s->results[result]++;
+			r.name = name;
+			r.results = 1;
+			yaml = false;
+		} else if (strcmp(line, "  ---\n") == 0) {
+			yaml = r.results > 0;
+		} else if (strcmp(line, "  ...\n") == 0) {
+			stats_result_done(s, &r);
+			yaml = false;
+		} else if (yaml) {
+			stats_parse(&r, line);
+		}
+	}
+	stats_result_done(s, &r);
+	stats_log_done(s);
+
+	free(line);
+	if (fd != stdin)
+		fclose(fd);
+
+	return true;
+}
+
+/* Print @ms in seconds. */
+static void stats_print_s(FILE *fd, const char *label, double ms)
+{
+	fprintf(fd, "%-20s %.3f s", label, ms / 1000);
+}
+
+static int stats_dir_cmp(const void *a, const void *b)
+{
+	const struct stats_dir *da = *(const struct stats_dir **) a,
+			       *db = *(const struct stats_dir **) b;
+
+	if (da->duration_ms != db->duration_ms)
+		return da->duration_ms < db->duration_ms ? 1 : -1;
+
+	return strcmp(da->name, db->name);
+}
+
+/* Print time spent per directory. */
+static void stats_print_dirs(FILE *fd, struct stats_data *s)
+{
+	struct stats_dir **dirs;
+	size_t i, num = 0;
+
+	dirs = misc_malloc(sizeof(*dirs) * (s->dirs.num + 1));
+	for (i = 0; i < s->dirs.size; i++) {
+		if (s->dirs.entries[i].key)
+			dirs[num++] = s->dirs.entries[i].value;
+	}
+	qsort(dirs, num, sizeof(*dirs), stats_dir_cmp);
+
+	fprintf(fd, "\nTime per directory:\n");
+	for (i = 0; i < num; i++) {
+		fprintf(fd, "  %12.3f s %5.1f%% %6d  %s\n",
+			dirs[i]->duration_ms / 1000,
+			s->duration_ms > 0 ? 100 * dirs[i]->duration_ms /
+					     s->duration_ms : 0.0,
+			dirs[i]->execs, dirs[i]->name);
+	}
+	free(dirs);
+}
+
+/* Print duration histogram. */
+static void stats_print_histogram(FILE *fd, struct stats_data *s)
+{
+	int i, first = -1, last = -1, max = 0, width;
+	char label[64];
+
+	for (i = 0; i < STATS_BUCKETS; i++) {
+		if (s->histogram[i] == 0)
+			continue;
+		if (first == -1)
+			first = i;
+		last = i;
+		if (s->histogram[i] > max)
+			max = s->histogram[i];
+	}
+
+	fprintf(fd, "\nDuration histogram:\n");
+	for (i = first; i >= 0 && i <= last; i++) {
+		if (i == 0)
+			snprintf(label, sizeof(label), "< 1 ms");
+		else if (i == STATS_BUCKETS - 1)
+			snprintf(label, sizeof(label), ">= %lu ms",
+				 1UL << (i - 1));
+		else
+			snprintf(label, sizeof(label), "%lu-%lu ms",
+				 1UL << (i - 1), 1UL << i);
+		width = (s->histogram[i] * STATS_BAR_WIDTH + max - 1) / max;
+		fprintf(fd, "  %16s %6d  %.*s\n", label, s->histogram[i],
+			width, "########################################");
+	}
+}
+
+/* Print test executable runs with a maximum RSS that exceeds the mean by
+ * more than three standard deviations. */
+static void stats_print_rss(FILE *fd, struct stats_data *s)
+{
+	double stddev = 0;
+	int i, num = 0;
+
+	if (s->rss_num > 1)
+		stddev = sqrt(s->rss_m2 / (s->rss_num - 1));
+	fprintf(fd, "\nMax RSS outliers (mean: %.0f kB, stddev: %.0f kB):\n",
+		s->rss_mean, stddev);
+	for (i = 0; i < s->num_largest; i++) {
+		if (s->largest[i].value <= s->rss_mean + 3 * stddev)
+			break;
+		fprintf(fd, "  %12.0f kB  %s\n", s->largest[i].value,
+			s->largest[i].name);
+		num++;
+	}
+	if (num == 0)
+		fprintf(fd, "  none\n");
+}
+
+/* Print aggregated metrics in @s to @fd. */
+void stats_print(FILE *fd, struct stats_data *s)
+{
+	double cpu_ms = s->utime_ms + s->stime_ms;
+	int i;
+
+	fprintf(fd, "%-20s %d\n", "Logs:", s->logs);
+	fprintf(fd, "%-20s %d (pass: %d, fail: %d, skip: %d, todo: %d)\n",
+		"Results:", s->results[TELA_PASS] + s->results[TELA_FAIL] +
+		s->results[TELA_SKIP] + s->results[TELA_TODO],
+		s->results[TELA_PASS], s->results[TELA_FAIL],
+		s->results[TELA_SKIP], s->results[TELA_TODO]);
+	fprintf(fd, "%-20s %d (with duration: %d)\n", "Test runs:", s->execs,
+		s->timed);
+	stats_print_s(fd, "Wall time:", s->wall_ms);
+	fprintf(fd, "\n");
+	stats_print_s(fd, "Test duration:", s->duration_ms);
+	fprintf(fd, "\n");
+	stats_print_s(fd, "Framework overhead:", s->overhead_ms);
+	fprintf(fd, " (%.1f%% of wall time)\n", s->wall_ms > 0 ?
+		100 * s->overhead_ms / s->wall_ms : 0.0);
+	stats_print_s(fd, "CPU time:", cpu_ms);
+	fprintf(fd, " (user: %.3f s, system: %.3f s, %.1f%% of test "
+		"duration)\n", s->utime_ms / 1000, s->stime_ms / 1000,
+		s->duration_ms > 0 ? 100 * cpu_ms / s->duration_ms : 0.0);
+
+	fprintf(fd, "\nSlowest tests:\n");
+	for (i = 0; i < s->num_slowest; i++) {
+		fprintf(fd, "  %12.3f s  %s\n", s->slowest[i].value / 1000,
+			s->slowest[i].name);
+	}
+
+	stats_print_histogram(fd, s);
+	stats_print_dirs(fd, s);
+	stats_print_rss(fd, s);
+}
+
+/* Release resources associated with @s. */
+void stats_free(struct stats_data *s)
+{
+	struct stats_dir *dir;
+	size_t i;
+	int j;
+
+	for (j = 0; j < s->num_slowest; j++)
+		free(s->slowest[j].name);
+	for (j = 0; j < s->num_largest; j++)
+		free(s->largest[j].name);
+	free(s->slowest);
+	free(s->largest);
+	for (i = 0; i < s->dirs.size; i++) {
+		dir = s->dirs.entries[i].value;
+		if (!s->dirs.entries[i].key || !dir)
+			continue;
+		free(dir->name);
+		free(dir);
+	}
+	misc_htab_free(&s->dirs);
+	stats_exec_free(&s->cur);
+}
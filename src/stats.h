@@ -0,0 +1,109 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Functions for analyzing testcase metrics in TAP13 logs.
+ *
+ * Copyright IBM Corp. 2023
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "log.h"
+#include "misc.h"
+
+/* Number of duration histogram buckets. Bucket 0 counts durations below
+ * 1 ms, bucket i > 0 durations from 2^(i-1) ms to below 2^i ms. The last
+ * bucket also counts all longer durations. */
+#define STATS_BUCKETS	22
+
+/**
+ * struct stats_exec - Metrics of a single test executable run
+ * @name: Testcase name
+ * @testexec: Path to test executable
+ * @results: Number of testcase results reported by this run
+ * @start: Start time in seconds since the Epoch or -1 if unknown
+ * @stop: Stop time in seconds since the Epoch or -1 if unknown
+ * @metrics: Duration and resource usage
+ *
+ * Testcases that report multiple results share the same run metrics.
+ */
+struct stats_exec {
+	char *name;
+	char *testexec;
+	int results;
+	double start;
+	double stop;
+	struct log_metrics metrics;
+};
+
+/**
+ * struct stats_top - Entry of a list of largest values
+ * @value: Value
+ * @name: Testcase name
+ */
+struct stats_top {
+	double value;
+	char *name;
+};
+
+/**
+ * struct stats_data - Aggregated testcase metrics
+ * @top: Maximum number of entries in @slowest and @largest
+ * @logs: Number of logs read
+ * @results: Number of results per result type
+ * @execs: Number of test executable runs
+ * @timed: Number of test executable runs with known duration
+ * @duration_ms: Sum of test executable run durations in milliseconds
+ * @utime_ms: Sum of CPU time spent in user mode in milliseconds
+ * @stime_ms: Sum of CPU time spent in kernel mode in milliseconds
+ * @wall_ms: Sum of times between first start and last stop per log
+ * @overhead_ms: Sum of wall time not spent in test executables per log
+ * @histogram: Number of test executable runs per duration bucket
+ * @slowest: Test executable runs with the longest durations
+ * @num_slowest: Number of entries in @slowest
+ * @largest: Test executable runs with the largest maximum RSS
+ * @num_largest: Number of entries in @largest
+ * @rss_num: Number of test executable runs with known maximum RSS
+ * @rss_mean: Mean maximum RSS in kilobytes
+ * @rss_m2: Sum of squared differences from @rss_mean
+ * @dirs: Hash table mapping directory names to struct stats_dir
+ * @cur: Current test executable run
+ * @log_start: Earliest start time in current log
+ * @log_stop: Latest stop time in current log
+ * @log_duration_ms: Sum of durations in current log
+ */
+struct stats_data {
+	int top;
+	int logs;
+	int results[TELA_TODO + 1];
+	int execs;
+	int timed;
+	double duration_ms;
+	double utime_ms;
+	double stime_ms;
+	double wall_ms;
+	double overhead_ms;
+	int histogram[STATS_BUCKETS];
+	struct stats_top *slowest;
+	int num_slowest;
+	struct stats_top *largest;
+	int num_largest;
+	int rss_num;
+	double rss_mean;
+	double rss_m2;
+	struct misc_htab dirs;
+	struct stats_exec cur;
+	double log_start;
+	double log_stop;
+	double log_duration_ms;
+};
+
+void stats_init(struct stats_data *s, int top);
+bool stats_read(struct stats_data *s, const char *path);
+void stats_print(FILE *fd, struct stats_data *s);
+void stats_free(struct stats_data *s);
+
+#endif /* STATS_H */
@@ -10,6 +10,8 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <fnmatch.h>
+#include <limits.h>
+#include <poll.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -19,15 +21,21 @@
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "config.h"
 #include "console_zvm.h"
+#include "history.h"
 #include "log.h"
 #include "misc.h"
+#include "perf.h"
+#include "phase.h"
 #include "pretty.h"
 #include "record.h"
 #include "resource.h"
+#include "stats.h"
+#include "trace.h"
 #include "yaml.h"
 
 #define CMD_COUNT	"count"
@@ -40,6 +48,10 @@
 #define CMD_MATCH	"match"
 #define CMD_CONSOLE	"console"
 #define CMD_YAMLSCALAR	"yamlscalar"
+#define CMD_YAMLSERVE	"yamlserve"
+#define CMD_LOG		"log"
+#define CMD_HISTORY	"history"
+#define CMD_STATS	"stats"
 
 /* A mapping of characters that need to be escaped for consumption in shell
  * single quotes. */
@@ -75,7 +87,8 @@ static void usage(void)
 	static const char * const cmds[] = {
 		CMD_COUNT, CMD_MONITOR, CMD_RUN, CMD_FORMAT, CMD_EVAL,
 		CMD_YAMLGET, CMD_FIXNAME, CMD_MATCH, CMD_CONSOLE,
-		CMD_YAMLSCALAR, NULL,
+		CMD_YAMLSCALAR, CMD_YAMLSERVE, CMD_LOG, CMD_HISTORY,
+		CMD_STATS, NULL,
 	};
 	int i;
 
@@ -171,6 +184,10 @@ struct run_data {
 	int num;
 	int plan;
 	bool large_temp;
+	long output_limit;
+	bool perf;
+	char **perf_events;
+	char *spillfile;
 	char *exec;
 	char *exec_dir;
 	const char *rexec;
@@ -179,8 +196,20 @@ struct run_data {
 	struct yaml_node *desc;
 	char *matchfile;
 	struct runlog_data runlog;
+	struct phase_data phases;
+	bool phases_pending;
 };
 
+/* Print framework phase durations of @data as separate YAML block for a
+ * result that has no YAML data of its own. */
+static void print_phases_block(struct run_data *data)
+{
+	printf("  ---\n");
+	phase_print(stdout, &data->phases, 2);
+	printf("  ...\n");
+	phase_free(&data->phases);
+}
+
 /* Parse testexec TAP output. */
 static void handle_tap_line(struct run_data *data, char *line,
 			    struct rec_stream *stream)
@@ -190,6 +219,15 @@ static void handle_tap_line(struct run_data *data, char *line,
 	int num;
 	struct yaml_node *node;
 
+	/* Framework phases are added to the YAML data of the first result.
+	 * If that result has none, add a YAML block containing only the
+	 * phases. */
+	if (data->phases_pending && strcmp(stream->name, "stdout") == 0) {
+		data->phases_pending = false;
+		if (strcmp(line, "  ---\n") != 0)
+			print_phases_block(data);
+	}
+
 	if (strcmp(stream->name, "stdout") != 0) {
 		/* A harness must only read TAP output from standard output. */
 		twarn(data->exec, 0, "%s", line);
@@ -234,6 +272,7 @@ static void handle_tap_line(struct run_data *data, char *line,
 		}
 
 		log_line(stdout, data->num, name, result, reason);
+		data->phases_pending = data->phases.num > 0;
 
 		free(name);
 		free(s);
@@ -254,7 +293,17 @@ static void handle_tap_line(struct run_data *data, char *line,
 		/* TAP13 test produced non-TAP13 output - emit warning. */
 		twarn(data->exec, 0, "Output not in TAP13 format: %s", line);
 	} else {
-		/* Pass anything else through. */
+		/* Pass anything else through. Add framework phase
+		 * durations once per test run to the end of the YAML data
+		 * of the first result. */
+		if (strcmp(line, "  ...\n") == 0) {
+			phase_print(stdout, &data->phases, 2);
+			phase_free(&data->phases);
+		}
+		/* Prevent test output from being interpreted as control
+		 * line by 'tela format'. */
+		if (misc_starts_with(line, REC_CTRL_PREFIX))
+			printf("# ");
 		printf("%s", line);
 	}
 }
@@ -369,10 +418,17 @@ static void run_handler(void *data, char *line, struct rec_stream *stream)
 		d->check_done = true;
 	}
 
-	if (d->is_tap13)
+	if (d->is_tap13) {
 		handle_tap_line(d, line, stream);
-	else
+	} else {
 		handle_nontap_line(d, line, stream);
+
+		/* Standard output of non-TAP programs is only needed in the
+		 * runlog. Without a runlog, let the recording code capture it
+		 * without line processing. */
+		if (!d->runlog.fd && strcmp(stream->name, "stdout") == 0)
+			stream->raw = true;
+	}
 }
 
 static void read_file_to_env(char ***env_ptr, char *filename)
@@ -414,10 +470,23 @@ static char *prepare_data(struct run_data *data, char *exec, char *matchenv,
 {
 	char *reason = NULL, *reqfile, *resfile, *v;
 	struct yaml_node *yaml;
+	struct timespec start;
 	struct config_t cfg;
+	int i;
 
+	phase_start(&start);
 	memset(data, 0, sizeof(*data));
 
+	/*
+	 * _TELA_PHASES - Set by runtests.sh to the durations of phases that
+	 * were performed before 'tela run' was started. Not passed on to the
+	 * test executable.
+	 */
+	v = getenv("_TELA_PHASES");
+	if (v && *v && !phase_parse(&data->phases, v))
+		warnx("Invalid phase data '%s'", v);
+	unsetenv("_TELA_PHASES");
+
 	/* Prepare run-time data-> */
 	data->exec = misc_abspath(exec);
 	if (!data->exec) {
@@ -426,6 +495,7 @@ static char *prepare_data(struct run_data *data, char *exec, char *matchenv,
 	}
 	data->exec_dir = misc_dirname(data->exec);
 	data->rexec = misc_relpath(data->exec, NULL);
+	trace_begin("prepare", data->rexec);
 
 	/* Handle testexec YAML file. */
 	reqfile = misc_asprintf("%s.yaml", data->exec);
@@ -435,9 +505,36 @@ static char *prepare_data(struct run_data *data, char *exec, char *matchenv,
 	config_parse(&cfg, yaml);
 	data->plan = cfg.plan;
 	data->large_temp = cfg.large_temp;
+	data->output_limit = cfg.output_limit;
+	data->perf = cfg.perf > 0;
+	data->perf_events = cfg.perf_events;
 	data->desc = cfg.desc;
 	yaml_free(yaml);
 
+	/* Apply global performance event setting if not specified by test. */
+	if (cfg.perf < 0) {
+		v = getenv("TELA_PERF");
+		data->perf = v && strcmp(v, "1") == 0;
+	}
+	for (i = 0; data->perf_events && data->perf_events[i]; i++) {
+		if (!perf_known(data->perf_events[i])) {
+			twarn(reqfile, 0, "Unknown performance event '%s'",
+			      data->perf_events[i]);
+		}
+	}
+
+	/* Apply global output limit if not specified by test. */
+	if (data->output_limit < 0) {
+		data->output_limit = 0;
+		v = getenv("TELA_OUTPUT_LIMIT");
+		if (v && *v && !misc_parse_size(v, &data->output_limit)) {
+			warnx("Invalid OUTPUT_LIMIT value '%s'", v);
+			data->output_limit = 0;
+		}
+	}
+
+	phase_stop(&data->phases, "config", &start);
+
 	/* Get environment variables describing requested resources. */
 	if (matcherr) {
 		reason = misc_strdup(matcherr);
@@ -446,7 +543,8 @@ static char *prepare_data(struct run_data *data, char *exec, char *matchenv,
 	} else {
 		resfile = res_get_resource_path();
 		data->env = res_resolve(reqfile, resfile, true, true,
-					&reason, &data->matchfile);
+					&reason, &data->matchfile,
+					&data->phases);
 		free(resfile);
 	}
 
@@ -455,6 +553,7 @@ static char *prepare_data(struct run_data *data, char *exec, char *matchenv,
 	v = getenv("TELA_RUNLOG");
 	if (v && *v)
 		runlog_open(&data->runlog, v, data->exec);
+	trace_end("prepare", data->rexec);
 
 	return reason;
 }
@@ -466,6 +565,12 @@ static void cleanup_data(struct run_data *data)
 	free(data->exec);
 	free(data->exec_dir);
 	free(data->last_stderr);
+	free(data->spillfile);
+	if (data->perf_events) {
+		for (i = 0; data->perf_events[i]; i++)
+			free(data->perf_events[i]);
+		free(data->perf_events);
+	}
 	if (data->env) {
 		for (i = 0; data->env[i]; i++)
 			free(data->env[i]);
@@ -476,10 +581,15 @@ static void cleanup_data(struct run_data *data)
 		free(data->matchfile);
 	}
 	runlog_close(&data->runlog);
+	phase_free(&data->phases);
 }
 
 static void finish_tap(struct run_data *data, struct rec_result *res)
 {
+	if (data->phases_pending) {
+		data->phases_pending = false;
+		print_phases_block(data);
+	}
 	if (WIFSIGNALED(res->status)) {
 		twarn(data->exec, 0, "Test executable was killed by "
 		      "signal %d\n", WTERMSIG(res->status));
@@ -518,13 +628,17 @@ static void finish_nontap(struct run_data *data, struct rec_result *res)
 
 	log_plan(stdout, data->plan);
 	log_result(stdout, data->rexec, data->exec, data->num, result,
-		   data->last_stderr, res, data->desc, NULL);
+		   data->last_stderr, res, &data->phases, data->desc, NULL);
+	phase_free(&data->phases);
 }
 
 static void plan_mismatch(struct run_data *data, const char *names)
 {
-	log_all_result(stdout, data->exec, TELA_FAIL, NULL, NULL, data->rexec,
-		       data->desc, data->num, data->plan);
+	/* Report phases here if no result of the test run included them. */
+	log_all_result(stdout, data->exec, TELA_FAIL, NULL, NULL,
+		       &data->phases, data->rexec, data->desc, data->num,
+		       data->plan);
+	phase_free(&data->phases);
 
 	if (names) {
 		twarn(data->exec, 0, "Plan mismatch (missing tests:%s)\n",
@@ -546,8 +660,8 @@ static void skip_test(struct run_data *data, const char *reason)
 
 	log_plan(stdout, max);
 
-	log_all_result(stdout, data->exec, TELA_SKIP, reason, NULL, data->rexec,
-		       data->desc, 0, data->plan);
+	log_all_result(stdout, data->exec, TELA_SKIP, reason, NULL,
+		       &data->phases, data->rexec, data->desc, 0, data->plan);
 }
 
 static void set_osid(void)
@@ -606,17 +720,62 @@ static void setup_env(char *tmpdir, struct run_data *data)
 		setenv("TELA_RESOURCE_FILE", data->matchfile, 1);
 }
 
+/* Return a stream that receives a compressed copy of all test output if
+ * requested, or %NULL otherwise. */
+static FILE *spill_open(struct run_data *data)
+{
+	char *v = getenv("TELA_OUTPUT_SPILL");
+	FILE *fd;
+
+	if (!data->output_limit || !v || strcmp(v, "1") != 0 ||
+	    !getenv("_TELA_FILE_ARCHIVE"))
+		return NULL;
+
+	fclose(misc_mktempfile(&data->spillfile));
+	v = misc_asprintf("gzip -c >\"%s\"", data->spillfile);
+	fd = popen(v, "we");
+	if (!fd)
+		warn("Could not start gzip");
+	free(v);
+
+	return fd;
+}
+
+/* Add compressed test output from @fd to the data archive if the output
+ * recorded in @res was truncated. */
+static void spill_close(struct run_data *data, FILE *fd,
+			struct rec_result *res)
+{
+	char *dir;
+
+	if (!fd)
+		return;
+	pclose(fd);
+	if (!rec_truncated(res))
+		return;
+
+	dir = misc_asprintf("%s/%s", getenv("_TELA_FILE_ARCHIVE"),
+			    data->rexec);
+	if (misc_system("mkdir -p \"%s\" && mv -f \"%s\" \"%s/output.gz\"",
+			dir, data->spillfile, dir) != 0)
+		warnx("Could not store test output in data archive");
+	free(dir);
+}
+
 /* Run specified command and capture output. If output is in TAP13 format,
  * convert to canonical format. Otherwise generate TAP13 format from arbitrary
  * output. */
 static int cmd_run(int argc, char *argv[])
 {
 	struct rec_result res;
+	struct rec_opts opts;
 	struct run_data data;
 	int scope = REC_ALL;
 	char *exec_argv[2], *tmpdir, *skip_reason, *names = NULL, *tmp,
-	     *matchenv = NULL, *matcherr = NULL;
+	     *matchenv = NULL, *matcherr = NULL, *v;
 	struct yaml_node *node, *key;
+	struct timespec start;
+	bool block;
 
 	if (argc < 1) {
 		fprintf(stderr, "Usage: %s %s <command> [<scope>] [<matchenv>] "
@@ -631,6 +790,14 @@ static int cmd_run(int argc, char *argv[])
 	if (argc > 3 && argv[3][0])
 		matcherr = argv[3];
 
+	/*
+	 * _TELA_FORMAT_BLOCKS - Set by runtests.sh if output is consumed by
+	 * 'tela format' which supports length-prefixed output blocks. Not
+	 * passed on to the test executable.
+	 */
+	block = getenv("_TELA_FORMAT_BLOCKS");
+	unsetenv("_TELA_FORMAT_BLOCKS");
+
 	is_stdout_tap = true;
 	setvbuf(stdout, NULL, _IONBF, 0);
 	log_header(stdout);
@@ -645,6 +812,7 @@ static int cmd_run(int argc, char *argv[])
 
 	/* Use disk-based /var/tmp instead of memory-based /tmp for tests
 	 * that intend to store large files. */
+	phase_start(&start);
 	tmpdir = misc_mktempdir(data.large_temp ? "/var/tmp" : NULL);
 	setup_env(tmpdir, &data);
 
@@ -653,7 +821,38 @@ static int cmd_run(int argc, char *argv[])
 		err(1, "Could not change directory");
 	exec_argv[0] = data.exec;
 	exec_argv[1] = NULL;
-	rec_record(&res, exec_argv[0], exec_argv, scope, run_handler, &data);
+	memset(&opts, 0, sizeof(opts));
+	opts.output_limit = data.output_limit;
+	opts.output_block = block;
+	v = getenv("TELA_CGROUP");
+	if (v && strcmp(v, "0") == 0)
+		scope &= ~REC_CGROUP;
+	v = getenv("TELA_CGROUP_KILL");
+	opts.cgroup_kill = v && strcmp(v, "1") == 0;
+	if (data.perf) {
+		opts.perf_events = data.perf_events ?
+			(const char **) data.perf_events : perf_default_events;
+	}
+	v = getenv("TELA_SAMPLE");
+	if (v && *v) {
+		opts.sample_ms = strtoul(v, &tmp, 10);
+		if (*tmp) {
+			warnx("Invalid SAMPLE value '%s'", v);
+			opts.sample_ms = 0;
+		} else if (opts.sample_ms > 0 &&
+			   opts.sample_ms < SMP_MIN_INTERVAL_MS) {
+			warnx("SAMPLE value '%s' too small, using %d ms", v,
+			      SMP_MIN_INTERVAL_MS);
+			opts.sample_ms = SMP_MIN_INTERVAL_MS;
+		}
+	}
+	opts.spill = spill_open(&data);
+	phase_stop(&data.phases, "setup", &start);
+	trace_begin("exec", data.rexec);
+	rec_record(&res, exec_argv[0], exec_argv, scope, &opts, run_handler,
+		   &data);
+	trace_end("exec", data.rexec);
+	spill_close(&data, opts.spill, &res);
 
 	if (data.is_tap13)
 		finish_tap(&data, &res);
@@ -747,20 +946,484 @@ static void emit_bail_out(FILE *log, char *line)
 		fprintf(stderr, "Emergency stop!\n");
 }
 
+/* Policy for syncing log data to disk. */
+enum log_sync_mode {
+	/* Sync after each test result and YAML data block. */
+	LOG_SYNC_ALWAYS,
+	/* Sync pending data at most once per interval. */
+	LOG_SYNC_INTERVAL,
+	/* Sync only when the log is closed. */
+	LOG_SYNC_END,
+};
+
+/**
+ * struct log_sync - State for syncing log data to disk
+ * @log: Log file stream
+ * @mode: Sync policy
+ * @interval_ms: Minimum time between syncs for %LOG_SYNC_INTERVAL
+ * @last: Time of most recent sync
+ * @pending: Flag indicating that data should be synced
+ */
+struct log_sync {
+	FILE *log;
+	enum log_sync_mode mode;
+	unsigned long interval_ms;
+	struct timespec last;
+	bool pending;
+};
+
+/* Parse sync policy @str into @sync. Return %true on success. */
+static bool log_sync_parse(struct log_sync *sync, const char *str)
+{
+	char *end;
+
+	if (strcmp(str, "always") == 0)
+		sync->mode = LOG_SYNC_ALWAYS;
+	else if (strcmp(str, "end") == 0)
+		sync->mode = LOG_SYNC_END;
+	else if (strncmp(str, "interval:", 9) == 0) {
+		sync->mode = LOG_SYNC_INTERVAL;
+		sync->interval_ms = strtoul(str + 9, &end, 10);
+		if (end == str + 9 || *end)
+			return false;
+	} else
+		return false;
+
+	return true;
+}
+
+/* Write pending log data to disk. */
+static void log_sync_flush(struct log_sync *sync)
+{
+	trace_begin("sync", NULL);
+	sync->pending = false;
+	clock_gettime(CLOCK_MONOTONIC, &sync->last);
+	fflush(sync->log);
+	fdatasync(fileno(sync->log));
+	trace_end("sync", NULL);
+}
+
+/* Return the number of milliseconds until pending log data must be synced. */
+static int log_sync_remaining(struct log_sync *sync)
+{
+	struct timespec now;
+	long elapsed;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	elapsed = (now.tv_sec - sync->last.tv_sec) * 1000 +
+		  (now.tv_nsec - sync->last.tv_nsec) / 1000000;
+	if (elapsed >= (long) sync->interval_ms)
+		return 0;
+
+	return sync->interval_ms - elapsed;
+}
+
+/* Request that log data written so far reaches disk. Depending on the sync
+ * policy, data is synced immediately or together with data from later
+ * requests (group commit). */
+static void log_sync_request(struct log_sync *sync)
+{
+	if (!sync->log)
+		return;
+
+	switch (sync->mode) {
+	case LOG_SYNC_ALWAYS:
+		log_sync_flush(sync);
+		break;
+	case LOG_SYNC_INTERVAL:
+		sync->pending = true;
+		if (log_sync_remaining(sync) == 0)
+			log_sync_flush(sync);
+		break;
+	case LOG_SYNC_END:
+		break;
+	}
+}
+
+/* Buffered TAP13 input. */
+struct tap_input {
+	int fd;
+	char *buf;
+	size_t size;
+	size_t start;
+	size_t end;
+	bool no_splice;
+	struct log_sync *sync;
+};
+
+/* Wait until data is available from @in. If log data is pending to be
+ * synced, sync it when its sync interval ends while waiting. This ensures
+ * that data reaches disk in time even if no more input arrives. */
+static void input_wait(struct tap_input *in)
+{
+	struct pollfd pfd = { .fd = in->fd, .events = POLLIN };
+	int rc;
+
+	while (in->sync && in->sync->pending) {
+		rc = poll(&pfd, 1, log_sync_remaining(in->sync));
+		if (rc == 0)
+			log_sync_flush(in->sync);
+		else if (rc != -1 || errno != EINTR)
+			break;
+	}
+}
+
+/* Read the next line from @in into *@line_ptr with allocated size *@n_ptr.
+ * Return the line length or -1 on end of input. */
+static ssize_t input_getline(struct tap_input *in, char **line_ptr,
+			     size_t *n_ptr)
+{
+	char *nl;
+	size_t len;
+	ssize_t rc;
+
+	while (!(nl = memchr(in->buf + in->start, '\n', in->end - in->start))) {
+		/* Make room for more data. */
+		memmove(in->buf, in->buf + in->start, in->end - in->start);
+		in->end -= in->start;
+		in->start = 0;
+		if (in->end == in->size) {
+			in->size *= 2;
+			in->buf = misc_realloc(in->buf, in->size);
+		}
+
+		input_wait(in);
+		rc = read(in->fd, in->buf + in->end, in->size - in->end);
+		if (rc == -1 && errno == EINTR)
+			continue;
+		if (rc <= 0)
+			break;
+		in->end += rc;
+	}
+
+	len = nl ? (size_t) (nl + 1 - (in->buf + in->start)) :
+		   in->end - in->start;
+	if (len == 0)
+		return -1;
+	if (*n_ptr < len + 1) {
+		*n_ptr = len + 1;
+		*line_ptr = misc_realloc(*line_ptr, *n_ptr);
+	}
+	memcpy(*line_ptr, in->buf + in->start, len);
+	(*line_ptr)[len] = 0;
+	in->start += len;
+
+	return len;
+}
+
+/* Forward @size bytes of data from @in to @log and, if specified, to @out.
+ * Data that is only written to @log is moved without copying it to user
+ * space where possible. */
+static void input_copy(struct tap_input *in, size_t size, FILE *log,
+		       FILE *out)
+{
+	size_t len;
+	ssize_t rc;
+
+	while (size > 0) {
+		if (in->start == in->end) {
+			input_wait(in);
+			if (log && !out && !in->no_splice) {
+				fflush(log);
+				rc = splice(in->fd, NULL, fileno(log), NULL,
+					    size, SPLICE_F_MOVE);
+				if (rc > 0) {
+					size -= rc;
+					continue;
+				}
+				if (rc == 0)
+					break;
+				if (errno == EINTR)
+					continue;
+				in->no_splice = true;
+			}
+
+			rc = read(in->fd, in->buf, in->size);
+			if (rc == -1 && errno == EINTR)
+				continue;
+			if (rc <= 0)
+				break;
+			in->start = 0;
+			in->end = rc;
+		}
+
+		len = in->end - in->start;
+		if (len > size)
+			len = size;
+		if (log)
+			fwrite(in->buf + in->start, 1, len, log);
+		if (out)
+			fwrite(in->buf + in->start, 1, len, out);
+		in->start += len;
+		size -= len;
+	}
+}
+
+/**
+ * struct format_index - State for writing a log index
+ * @fd: Index file stream
+ * @log: Log file stream
+ * @entry: Index entry for the most recent testcase
+ * @open: Flag indicating that the end of @entry has not been reached yet
+ */
+struct format_index {
+	FILE *fd;
+	FILE *log;
+	struct log_index_entry entry;
+	bool open;
+};
+
+/* Return the current write offset in @log. */
+static off_t log_offset(FILE *log)
+{
+	/* Query file descriptor directly since data may have been written
+	 * to it bypassing the stream via splice(). */
+	fflush(log);
+
+	return lseek(fileno(log), 0, SEEK_CUR);
+}
+
+/* Write index entry for the current testcase if there is one. */
+static void index_end(struct format_index *idx)
+{
+	struct log_index_entry *e = &idx->entry;
+
+	if (!idx->open)
+		return;
+	idx->open = false;
+	e->length = log_offset(idx->log) - e->offset;
+	log_index_write(idx->fd, e);
+	free(e->name);
+	e->name = NULL;
+}
+
+/* Start index entry for a testcase with number @num, name @name and result
+ * @result that is about to be written to the log. */
+static void index_start(struct format_index *idx, int num, const char *name,
+			enum tela_result_t result)
+{
+	struct log_index_entry *e = &idx->entry;
+
+	if (!idx->fd)
+		return;
+	index_end(idx);
+	e->num = num;
+	e->result = result;
+	e->offset = log_offset(idx->log);
+	e->duration_ms = -1;
+	e->name = misc_strdup(name);
+	idx->open = true;
+}
+
+/* Update the index entry of the current testcase with data from YAML data
+ * @line. */
+static void index_parse(struct format_index *idx, const char *line)
+{
+	if (!idx->open)
+		return;
+	if (sscanf(line, "  duration_ms: %lf", &idx->entry.duration_ms) == 1)
+		return;
+	if (strcmp(line, "  ...\n") == 0)
+		index_end(idx);
+}
+
+/* Write line @line that is not interpreted by cmd_format() to @log and
+ * stdout, or to stderr if it contains a warning. */
+static void emit_line(FILE *log, const char *line, bool pretty, bool verbose,
+		      struct stats_t *stats)
+{
+	const char *warning;
+
+	if (log)
+		fprintf(log, "%s", line);
+
+	warning = log_parse_warning(line);
+	if (warning) {
+		stats->warnings++;
+		fflush(stdout);
+		fprintf(stderr, "%sWarning: %s%s", color_stderr.red, warning,
+			color_stderr.reset);
+	} else if (!pretty)
+		printf("%s", line);
+	else if (verbose)
+		printf("%s", line);
+}
+
+/**
+ * struct perfcheck - State for checking testcases for performance regressions
+ * @enabled: Flag indicating that checks are enabled
+ * @cpu: Flag indicating that CPU time is checked in addition to duration
+ * @threshold: Number of deviations above median that indicate a regression
+ * @baseline: Metrics of testcases in previous test runs
+ * @num: Number of regressions found for the current testcase
+ * @found: Flags indicating regressions per metric for the current testcase
+ */
+struct perfcheck {
+	bool enabled;
+	bool cpu;
+	double threshold;
+	struct hist_baseline baseline;
+	int num;
+	bool found[HIST_NUM_METRICS];
+};
+
+/* Names of metrics checked for regressions. */
+static const char *perfcheck_names[] = {
+	[HIST_DURATION] = "duration",
+	[HIST_CPU] = "cpu",
+};
+
+/* Enable regression checks in @pc if requested. Baseline data is read from
+ * history file @histfile. */
+static void perfcheck_init(struct perfcheck *pc, const char *histfile)
+{
+	char *v, *end;
+
+	/*
+	 * TELA_PERFCHECK - Check testcase durations for regressions
+	 *   0: Disabled
+	 *   1: Enabled
+	 */
+	v = getenv("TELA_PERFCHECK");
+	if (!v || atoi(v) == 0)
+		return;
+	if (!histfile || !*histfile) {
+		warnx("PERFCHECK requires HISTORY to be set");
+		return;
+	}
+
+	/*
+	 * TELA_PERFCHECK_THRESHOLD - Number of deviations from median that
+	 * indicate a regression
+	 */
+	pc->threshold = 3.0;
+	v = getenv("TELA_PERFCHECK_THRESHOLD");
+	if (v && *v) {
+		pc->threshold = strtod(v, &end);
+		if (*end || pc->threshold <= 0) {
+			warnx("Invalid PERFCHECK_THRESHOLD value '%s'", v);
+			pc->threshold = 3.0;
+		}
+	}
+
+	/*
+	 * TELA_PERFCHECK_CPU - Also check CPU time for regressions
+	 */
+	v = getenv("TELA_PERFCHECK_CPU");
+	pc->cpu = v && atoi(v) != 0;
+
+	trace_begin("baseline", NULL);
+	pc->enabled = hist_baseline_init(&pc->baseline, histfile,
+					 HIST_BASELINE_SAMPLES);
+	trace_end("baseline", NULL);
+}
+
+/* Check the most recent testcase in @hist for regressions and write
+ * resulting YAML data to @log and stdout. */
+static void perfcheck_yaml(struct perfcheck *pc, struct hist_data *hist,
+			   FILE *log, bool pretty, bool verbose,
+			   struct stats_t *stats)
+{
+	struct hist_regression reg;
+	struct hist_record *r;
+	enum hist_metric m;
+	char *line;
+
+	pc->num = 0;
+	memset(pc->found, 0, sizeof(pc->found));
+	if (hist->num == 0)
+		return;
+	r = &hist->records[hist->num - 1];
+	if (r->result != TELA_PASS)
+		return;
+
+	for (m = 0; m < HIST_NUM_METRICS; m++) {
+		if (m == HIST_CPU && !pc->cpu)
+			continue;
+		if (!hist_check(&pc->baseline, hist->names[hist->num - 1], m, r,
+				pc->threshold, &reg))
+			continue;
+		if (pc->num++ == 0)
+			emit_line(log, "  perf_regression:\n", pretty, verbose,
+				  stats);
+		line = misc_asprintf("    %s:\n"
+				     "      value_ms: %.3f\n"
+				     "      median_ms: %.3f\n"
+				     "      mad_ms: %.3f\n"
+				     "      limit_ms: %.3f\n"
+				     "      samples: %d\n",
+				     perfcheck_names[m], reg.value_ms,
+				     reg.median_ms, reg.mad_ms, reg.limit_ms,
+				     reg.samples);
+		emit_line(log, line, pretty, verbose, stats);
+		free(line);
+		pc->found[m] = true;
+	}
+}
+
+/* Write a warning about regressions found for the most recent testcase in
+ * @hist to @log and stderr. */
+static void perfcheck_warn(struct perfcheck *pc, struct hist_data *hist,
+			   FILE *log, struct stats_t *stats)
+{
+	const char *what;
+	char *line;
+
+	if (pc->found[HIST_DURATION] && pc->found[HIST_CPU])
+		what = "duration and CPU time";
+	else if (pc->found[HIST_DURATION])
+		what = "duration";
+	else
+		what = "CPU time";
+	line = misc_asprintf("# %s %s: Performance regression in %s\n",
+			     WARN_PREFIX, hist->names[hist->num - 1], what);
+	emit_line(log, line, true, false, stats);
+	free(line);
+	pc->num = 0;
+}
+
+/* Add testcase results in @hist to history file @path. */
+static void format_history(const char *path, struct hist_data *hist)
+{
+	char host[HOST_NAME_MAX + 1] = "", *os;
+	const char *id, *version;
+
+	trace_begin("history", NULL);
+	gethostname(host, sizeof(host) - 1);
+	id = getenv("TELA_OS_ID");
+	version = getenv("TELA_OS_VERSION");
+	os = misc_asprintf("%s %s", id ? id : "", version ? version : "");
+	misc_strip_space(os);
+
+	if (!hist_append(path, hist, host, os))
+		warnx("Could not add results to history file '%s'", path);
+	free(os);
+	trace_end("history", NULL);
+}
+
 /* Create formatted output for the TAP13 data specified by @argv[0]. */
 static int cmd_format(int argc, char *argv[])
 {
 	enum tela_result_t result;
 	char *line = NULL, *name, *reason, *v, *logfile = NULL;
-	const char *warning;
-	size_t n;
-	FILE *fd, *log = NULL;
+	size_t n = 0, size;
+	struct tap_input in;
+	FILE *log = NULL;
 	int num, numtests = -1, testnum = 0, rc = 0;
 	bool pretty = true, verbose = false, plan_done = false, diag = false,
-	     do_sync;
+	     do_sync, end;
 	struct stats_t stats;
+	struct log_sync sync;
+	struct perfcheck pc;
+	struct format_index idx;
+	struct hist_data hist;
+	const char *histfile;
 
 	memset(&stats, 0, sizeof(stats));
+	memset(&hist, 0, sizeof(hist));
+	memset(&pc, 0, sizeof(pc));
+	memset(&sync, 0, sizeof(sync));
+	memset(&idx, 0, sizeof(idx));
 
 	if (argc < 1) {
 		fprintf(stderr, "Usage: %s %s <tapfile>|- [<numtests>] "
@@ -768,20 +1431,21 @@ static int cmd_format(int argc, char *argv[])
 			CMD_FORMAT);
 		exit(EXIT_SYNTAX);
 	}
+	trace_begin("format", NULL);
 
-	/* Open output stream. */
+	/* Open input stream. */
+	memset(&in, 0, sizeof(in));
 	if (strcmp(argv[0], "-") == 0)
-		fd = stdin;
+		in.fd = STDIN_FILENO;
 	else {
-		fd = fopen(argv[0], "r");
-		if (!fd) {
+		in.fd = open(argv[0], O_RDONLY);
+		if (in.fd == -1) {
 			err(EXIT_RUNTIME, "Could not open tapfile '%s'",
 			    argv[0]);
 		}
 	}
-
-	/* Ensure output reaches log file despite fatal errors. */
-	setlinebuf(fd);
+	in.size = BUFSIZ;
+	in.buf = misc_malloc(in.size);
 
 	if (argc > 1) {
 		numtests = atoi(argv[1]);
@@ -823,11 +1487,46 @@ static int cmd_format(int argc, char *argv[])
 		/* Ensure output reaches log file despite fatal errors. */
 		setlinebuf(log);
 	}
+	sync.log = log;
+	in.sync = &sync;
+
+	/* Write index of test results next to log. */
+	if (log) {
+		v = misc_asprintf("%s%s", logfile, LOG_INDEX_SUFFIX);
+		idx.fd = fopen(v, "w");
+		if (!idx.fd)
+			warn("Could not open log index '%s'", v);
+		else {
+			setlinebuf(idx.fd);
+			fprintf(idx.fd, "%s", LOG_INDEX_HEADER);
+		}
+		free(v);
+		idx.log = log;
+	}
+
+	/*
+	 * TELA_LOGSYNC - Define when log data is synced to disk
+	 *   always:        After each test result and YAML data block
+	 *   interval:<ms>: At most every <ms> milliseconds
+	 *   end:           When the log is closed
+	 */
+	v = getenv("TELA_LOGSYNC");
+	if (v && *v && !log_sync_parse(&sync, v)) {
+		warnx("Invalid LOGSYNC value '%s' - using 'always'", v);
+		sync.mode = LOG_SYNC_ALWAYS;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &sync.last);
+
+	/*
+	 * TELA_HISTORY - Filename of history file to which results are added
+	 */
+	histfile = getenv("TELA_HISTORY");
+	perfcheck_init(&pc, histfile);
 
 	/* Print header information. */
 	emit_header(log, pretty);
 
-	while (getline(&line, &n, fd) != -1) {
+	while (input_getline(&in, &line, &n) != -1) {
 		do_sync = false;
 
 		if (strncmp(line, "TAP ", 4) == 0) {
@@ -855,6 +1554,9 @@ static int cmd_format(int argc, char *argv[])
 				name = misc_asprintf("test%d", num);
 			}
 
+			index_start(&idx, testnum, name, result);
+			if (histfile && *histfile)
+				hist_add(&hist, name, result);
 			emit_result(log, testnum, numtests, name, result,
 				    reason, pretty);
 
@@ -878,48 +1580,67 @@ static int cmd_format(int argc, char *argv[])
 			do_sync = true;
 		} else if (log_parse_bail(line)) {
 			/* Terminate test run. */
+			index_end(&idx);
 			emit_bail_out(log, line);
 			rc = EXIT_RUNTIME;
 			break;
 		} else if (strcmp(line, "# tela: query state\n") == 0) {
 			if (pretty && verbose)
 				printf("Collecting system state\n");
+		} else if (sscanf(line, REC_BLOCK_FMT, &size) == 1) {
+			/* Forward block of test output data. */
+			input_copy(&in, size, log, !pretty || verbose ? stdout :
+								       NULL);
 		} else {
+			/* Add regression data at end of YAML data. */
+			end = strcmp(line, "  ...\n") == 0;
+			if (end && pc.enabled)
+				perfcheck_yaml(&pc, &hist, log, pretty, verbose,
+					       &stats);
+
 			/* Pass anything else through. */
-			if (log)
-				fprintf(log, "%s", line);
-
-			warning = log_parse_warning(line);
-			if (warning) {
-				stats.warnings++;
-				fflush(stdout);
-				fprintf(stderr, "%sWarning: %s%s",
-					color_stderr.red, warning,
-					color_stderr.reset);
-			} else if (!pretty)
-				printf("%s", line);
-			else if (verbose)
-				printf("%s", line);
+			emit_line(log, line, pretty, verbose, &stats);
+			index_parse(&idx, line);
+			hist_parse(&hist, line);
+
+			if (end && pc.num > 0)
+				perfcheck_warn(&pc, &hist, log, &stats);
 
 			/* Sync at end of YAML data. */
-			if (strcmp(line, "  ...\n") == 0)
+			if (end)
 				do_sync = true;
 		}
 
 		/* Make sure data reaches disk. */
-		if (do_sync && log)
-			fdatasync(fileno(log));
+		if (do_sync)
+			log_sync_request(&sync);
 	}
 	free(line);
 
+	/* Add results to history. */
+	if (hist.num > 0)
+		format_history(histfile, &hist);
+	hist_data_free(&hist);
+	if (pc.enabled)
+		hist_baseline_free(&pc.baseline);
+
 	/* Print footer information. */
 	if (pretty)
 		pretty_footer(&stats, logfile);
 
-	if (log)
+	if (idx.fd) {
+		index_end(&idx);
+		fclose(idx.fd);
+	}
+	if (log) {
+		if (sync.mode != LOG_SYNC_ALWAYS || sync.pending)
+			log_sync_flush(&sync);
 		fclose(log);
-	if (fd != stdin)
-		fclose(fd);
+	}
+	if (in.fd != STDIN_FILENO)
+		close(in.fd);
+	free(in.buf);
+	trace_end("format", NULL);
 
 	return rc;
 }
@@ -941,32 +1662,66 @@ static int cmd_eval(int argc, char *argv[])
 	return result;
 }
 
-static bool yamlget_cb(struct yaml_iter *iter, void *data)
-{
-	char *pattern = data, *quoted;
+/**
+ * struct yamlget_data - Data for scanning a file in cmd_yamlget()
+ * @pattern: Path pattern
+ * @found: Flag indicating that at least one node was found
+ */
+struct yamlget_data {
+	const char *pattern;
+	bool found;
+};
 
-	if (fnmatch(pattern, iter->path, FNM_PATHNAME) == 0) {
-		yaml_decode_path(iter->path);
-		if (iter->node->type == yaml_scalar &&
-		    iter->node->scalar.content) {
-			quoted = misc_replace_map(iter->node->scalar.content,
-						  shell_escape_single_map);
-			printf("YAMLPATH='%s' VALUE='%s' TYPE='scalar'\n",
-			       iter->path, quoted);
-			free(quoted);
-		} else if (iter->node->type == yaml_map) {
-			printf("YAMLPATH='%s' VALUE='' TYPE='map'\n",
-			       iter->path);
-		}
+/*
+ * Print a yamlget output line for the node with encoded @path to @file. If
+ * @content is %NULL, the node is a mapping, otherwise a scalar.
+ */
+static void yamlget_print(FILE *file, const char *path, const char *content)
+{
+	char *quoted, *decoded;
+
+	decoded = misc_strdup(path);
+	yaml_decode_path(decoded);
+	if (content) {
+		quoted = misc_replace_map(content, shell_escape_single_map);
+		fprintf(file, "YAMLPATH='%s' VALUE='%s' TYPE='scalar'\n",
+			decoded, quoted);
+		free(quoted);
+	} else {
+		fprintf(file, "YAMLPATH='%s' VALUE='' TYPE='map'\n", decoded);
 	}
+	free(decoded);
+}
 
-	return true;
+static bool yamlget_cb(struct yaml_event *event, void *data)
+{
+	struct yamlget_data *d = data;
+
+	d->found = true;
+	if (event->type != yaml_event_scalar &&
+	    event->type != yaml_event_map_start)
+		return true;
+	if (event->type == yaml_event_scalar && !event->content)
+		return true;
+	if (fnmatch(d->pattern, event->path, FNM_PATHNAME) != 0)
+		return true;
+
+	yamlget_print(stdout, event->path,
+		      event->type == yaml_event_scalar ? event->content : NULL);
+
+	/* Stop reading if output is no longer possible. */
+	return !ferror(stdout);
 }
 
-/* Get scalar data from a YAML file. */
+/*
+ * Get scalar data from a YAML file in text or binary format. Text files are
+ * scanned once per pattern without building a document tree, and matches are
+ * printed as they are found. Memory use is therefore independent of file
+ * size. Matches found before a syntax error in the file are still printed.
+ */
 static int cmd_yamlget(int argc, char *argv[])
 {
-	struct yaml_node *root;
+	struct yamlget_data d;
 	int i;
 
 	if (argc < 2) {
@@ -976,17 +1731,16 @@ static int cmd_yamlget(int argc, char *argv[])
 		exit(EXIT_SYNTAX);
 	}
 
-	root = yaml_parse_file("%s", argv[0]);
-	if (!root) {
-		warnx("%s: Empty or non-existent file", argv[0]);
-		return 1;
+	for (i = 1; i < argc; i++) {
+		d.pattern = argv[i];
+		d.found = false;
+		if (!yaml_scan_file(yamlget_cb, &d, "%s", argv[0]) ||
+		    !d.found) {
+			warnx("%s: Empty or non-existent file", argv[0]);
+			return 1;
+		}
 	}
 
-	for (i = 1; i < argc; i++)
-		yaml_traverse(&root, yamlget_cb, argv[i]);
-
-	yaml_free(root);
-
 	return 0;
 }
 
@@ -1088,7 +1842,7 @@ static int cmd_match(int argc, char *argv[])
 	/* Perform match. */
 	is_stdout_tap = true;
 	env = res_resolve(reqfile, resfile, true, getstate, &reason,
-			  fmt == MATCH_FMT_YAML ? &matchfile : NULL);
+			  fmt == MATCH_FMT_YAML ? &matchfile : NULL, NULL);
 
 	free(resfile);
 	free(reqfile);
@@ -1273,6 +2027,478 @@ static int cmd_yamlscalar(int argc, char *argv[])
 	return 0;
 }
 
+/**
+ * struct yamlserve_query - Path query of cmd_yamlserve()
+ * @pattern: Path pattern
+ * @prefixes: Patterns matching the first 1..@num path components or %NULL
+ * @num: Number of path components in @pattern
+ * @file: Output stream
+ */
+struct yamlserve_query {
+	const char *pattern;
+	char **prefixes;
+	int num;
+	FILE *file;
+};
+
+/*
+ * Fill in the path component prefixes of @q. Prefixes are used to skip
+ * sub-trees that cannot contain a match. This is only possible if each '/' in
+ * the pattern separates path components.
+ */
+static void yamlserve_prefixes(struct yamlserve_query *q)
+{
+	const char *c;
+	int i;
+
+	q->prefixes = NULL;
+	q->num = 1;
+	if (strpbrk(q->pattern, "[\\"))
+		return;
+
+	for (c = q->pattern; *c; c++) {
+		if (*c == '/')
+			q->num++;
+	}
+	q->prefixes = misc_malloc(q->num * sizeof(char *));
+	for (i = 0, c = q->pattern; i < q->num; i++, c++) {
+		c = strchrnul(c, '/');
+		q->prefixes[i] = strndup(q->pattern, c - q->pattern);
+		if (!q->prefixes[i])
+			oom();
+	}
+}
+
+static int path_depth(const char *path)
+{
+	int depth = 1;
+
+	for (; *path; path++) {
+		if (*path == '/')
+			depth++;
+	}
+
+	return depth;
+}
+
+static bool yamlserve_cb(struct yaml_iter *iter, void *data)
+{
+	struct yamlserve_query *q = data;
+	struct yaml_node *node = iter->node;
+	int depth;
+
+	if (q->prefixes) {
+		depth = path_depth(iter->path);
+		if (depth > q->num ||
+		    fnmatch(q->prefixes[depth - 1], iter->path,
+			    FNM_PATHNAME) != 0) {
+			iter->skip = true;
+			return true;
+		}
+		if (depth < q->num)
+			return true;
+		iter->skip = true;
+	} else if (fnmatch(q->pattern, iter->path, FNM_PATHNAME) != 0) {
+		return true;
+	}
+
+	if (node->type == yaml_scalar && node->scalar.content)
+		yamlget_print(q->file, iter->path, node->scalar.content);
+	else if (node->type == yaml_map)
+		yamlget_print(q->file, iter->path, NULL);
+
+	return true;
+}
+
+/* Write query response consisting of @size bytes of output in @buf. */
+static void yamlserve_reply(char *buf, size_t size)
+{
+	size_t i, lines = 0;
+
+	for (i = 0; i < size; i++) {
+		if (buf[i] == '\n')
+			lines++;
+	}
+	if (size > 0 && buf[size - 1] != '\n')
+		lines++;
+
+	printf("OK %zu\n", lines);
+	fwrite(buf, 1, size, stdout);
+	if (size > 0 && buf[size - 1] != '\n')
+		printf("\n");
+}
+
+static void yamlserve_get(struct yaml_node **root, const char *pattern)
+{
+	struct yamlserve_query q;
+	size_t size;
+	char *buf;
+	int i;
+
+	q.pattern = pattern;
+	q.file = open_memstream(&buf, &size);
+	if (!q.file)
+		oom();
+	yamlserve_prefixes(&q);
+
+	yaml_traverse(root, yamlserve_cb, &q);
+	fclose(q.file);
+	yamlserve_reply(buf, size);
+
+	if (q.prefixes) {
+		for (i = 0; i < q.num; i++)
+			free(q.prefixes[i]);
+		free(q.prefixes);
+	}
+	free(buf);
+}
+
+static void yamlserve_scalar(char *args)
+{
+	char *indent, *escape, *filename, *buf;
+	FILE *in, *out;
+	size_t size;
+
+	indent = strsep(&args, " ");
+	escape = strsep(&args, " ");
+	filename = args;
+	if (!filename || !*filename) {
+		printf("ERROR Usage: scalar <indent> <escape> <text_file>\n");
+		return;
+	}
+
+	in = fopen(filename, "r");
+	if (!in) {
+		printf("ERROR Could not open file '%s': %s\n", filename,
+		       strerror(errno));
+		return;
+	}
+	out = open_memstream(&buf, &size);
+	if (!out)
+		oom();
+	yaml_sanitize_scalar(in, out, atoi(indent), atoi(escape));
+	fclose(out);
+	fclose(in);
+
+	yamlserve_reply(buf, size);
+	free(buf);
+}
+
+/*
+ * Answer queries for a YAML file read from stdin. The file is parsed only
+ * once. Supported requests, one per line:
+ *
+ *   get <pattern>                        - same as yamlget <file> <pattern>
+ *   scalar <indent> <escape> <text_file> - same as yamlscalar
+ *   quit                                 - exit
+ *
+ * Each response starts with a line "OK <n>" followed by n lines of output,
+ * or consists of a single line "ERROR <message>".
+ */
+static int cmd_yamlserve(int argc, char *argv[])
+{
+	struct yaml_node *root;
+	char *line = NULL;
+	size_t size = 0;
+	ssize_t len;
+
+	if (argc != 1) {
+		fprintf(stderr, "Usage: %s %s <yaml_file>\n",
+			program_invocation_short_name, CMD_YAMLSERVE);
+		exit(EXIT_SYNTAX);
+	}
+
+	root = yaml_parse_file("%s", argv[0]);
+	if (!root) {
+		warnx("%s: Empty or non-existent file", argv[0]);
+		return 1;
+	}
+
+	while ((len = getline(&line, &size, stdin)) != -1) {
+		if (len > 0 && line[len - 1] == '\n')
+			line[len - 1] = 0;
+
+		if (strncmp(line, "get ", 4) == 0)
+			yamlserve_get(&root, line + 4);
+		else if (strncmp(line, "scalar ", 7) == 0)
+			yamlserve_scalar(line + 7);
+		else if (strcmp(line, "quit") == 0)
+			break;
+		else
+			printf("ERROR Unknown request '%s'\n", line);
+		fflush(stdout);
+	}
+
+	free(line);
+	yaml_free(root);
+
+	return 0;
+}
+
+static void usage_log(void)
+{
+	fprintf(stderr,
+"Usage: %s %s query LOGFILE [SELECT] [VIEW]\n"
+"\n"
+"Show testcase results from a TAP13 log using the index file written by\n"
+"'%s %s' next to the log.\n"
+"\n"
+"If at least one testcase was selected, exit with return code 0, otherwise\n"
+"exit with return code 1.\n"
+"\n"
+"PARAMETERS\n"
+"  LOGFILE   Name of a TAP13 log file\n"
+"  SELECT    Testcases to show:\n"
+"            - all:     All testcases (default)\n"
+"            - failed:  Failed testcases\n"
+"            - <num>:   Testcase with test number <num>\n"
+"            - <pattern>: Testcases with names matching shell <pattern>\n"
+"  VIEW      Data to show for each testcase:\n"
+"            - summary: Number, result, duration and name (default)\n"
+"            - full:    Test result line and YAML data from log\n"
+"            - output:  Testcase output\n",
+		program_invocation_short_name, CMD_LOG,
+		program_invocation_short_name, CMD_FORMAT);
+}
+
+/* Check if index entry @e is selected by @select. */
+static bool query_selected(struct log_index_entry *e, const char *select)
+{
+	char *end;
+	long num;
+
+	if (strcmp(select, "all") == 0)
+		return true;
+	if (strcmp(select, "failed") == 0)
+		return e->result == TELA_FAIL;
+	num = strtol(select, &end, 10);
+	if (*select && !*end)
+		return e->num == num;
+
+	return fnmatch(select, e->name, 0) == 0;
+}
+
+/* Print the testcase output contained in log data @block. */
+static void query_print_output(char *block)
+{
+	char *s, *nl;
+
+	s = strstr(block, "\n  output: |\n");
+	if (!s)
+		return;
+	for (s = strchr(s + 1, '\n') + 1; strncmp(s, "    ", 4) == 0;
+	     s = nl + 1) {
+		nl = strchr(s, '\n');
+		if (!nl)
+			break;
+		printf("%.*s\n", (int) (nl - s - 4), s + 4);
+	}
+}
+
+/* Print data for index entry @e in @view format. Log data is read from
+ * @fd. */
+static void query_print(int fd, const char *logfile, struct log_index_entry *e,
+			const char *view)
+{
+	int num = -1;
+	char *block;
+
+	if (strcmp(view, "summary") == 0) {
+		printf("%d %s ", e->num, log_result_str(e->result));
+		if (e->duration_ms < 0)
+			printf("-");
+		else
+			printf("%.3f", e->duration_ms);
+		printf(" %s\n", e->name);
+		return;
+	}
+
+	/* Buffer is zero-terminated since misc_malloc() clears memory. */
+	block = misc_malloc(e->length + 1);
+	if (pread(fd, block, e->length, e->offset) != (ssize_t) e->length ||
+	    !log_parse_line(block, NULL, &num, NULL, NULL) || num != e->num) {
+		errx(EXIT_RUNTIME, "Index does not match log '%s'",
+		     logfile);
+	}
+
+	if (strcmp(view, "full") == 0)
+		printf("%s", block);
+	else
+		query_print_output(block);
+	free(block);
+}
+
+/* Show selected results from an indexed TAP13 log. */
+static int cmd_log(int argc, char *argv[])
+{
+	const char *logfile, *select = "all", *view = "summary";
+	struct log_index_entry *entries;
+	int i, num, fd, found = 0;
+	char *idxfile, *end;
+	long n;
+
+	if (argc < 2 || argc > 4 || strcmp(argv[0], "query") != 0) {
+		usage_log();
+		exit(EXIT_SYNTAX);
+	}
+	logfile = argv[1];
+	if (argc > 2)
+		select = argv[2];
+	if (argc > 3)
+		view = argv[3];
+	if (strcmp(view, "summary") != 0 && strcmp(view, "full") != 0 &&
+	    strcmp(view, "output") != 0) {
+		usage_log();
+		exit(EXIT_SYNTAX);
+	}
+
+	fd = open(logfile, O_RDONLY);
+	if (fd == -1)
+		err(EXIT_RUNTIME, "Could not open log '%s'", logfile);
+	idxfile = misc_asprintf("%s%s", logfile, LOG_INDEX_SUFFIX);
+	if (!log_index_read(idxfile, &entries, &num))
+		errx(EXIT_RUNTIME, "Could not read log index '%s'", idxfile);
+	free(idxfile);
+
+	/* Entries are ordered by test number, so a single testcase can be
+	 * found directly. */
+	n = strtol(select, &end, 10);
+	if (!*end && n > 0 && n <= num && entries[n - 1].num == n) {
+		query_print(fd, logfile, &entries[n - 1], view);
+		found = 1;
+	} else {
+		for (i = 0; i < num; i++) {
+			if (!query_selected(&entries[i], select))
+				continue;
+			query_print(fd, logfile, &entries[i], view);
+			found++;
+		}
+	}
+
+	log_index_free(entries, num);
+	close(fd);
+
+	return found ? 0 : 1;
+}
+
+static void usage_history(void)
+{
+	fprintf(stderr,
+"Usage: %s %s HISTFILE runs [LAST]\n"
+"       %s %s HISTFILE duration NAME [LAST]\n"
+"       %s %s HISTFILE flaky [LAST] [TOP]\n"
+"\n"
+"Show data from a history file written by '%s %s' when environment\n"
+"variable TELA_HISTORY is set.\n"
+"\n"
+"COMMANDS\n"
+"  runs      Show date, number of tests, passed, failed and skipped tests,\n"
+"            host and OS for each test run\n"
+"  duration  Show date, result and duration in milliseconds of testcase\n"
+"            NAME for each test run\n"
+"  flaky     Show the TOP testcases with the most changes between pass and\n"
+"            fail results, the number of failures, and the number of\n"
+"            results (default TOP: 20)\n"
+"\n"
+"Only the LAST most recent test runs are considered (default: 100, 0 for\n"
+"all test runs).\n",
+		program_invocation_short_name, CMD_HISTORY,
+		program_invocation_short_name, CMD_HISTORY,
+		program_invocation_short_name, CMD_HISTORY,
+		program_invocation_short_name, CMD_FORMAT);
+}
+
+/* Show data from a history file. */
+static int cmd_history(int argc, char *argv[])
+{
+	const char *cmd, *name = NULL;
+	int last = 100, top = 20, rc = 0;
+	struct hist_file h;
+
+	if (argc < 2) {
+		usage_history();
+		exit(EXIT_SYNTAX);
+	}
+	cmd = argv[1];
+	if (strcmp(cmd, "duration") == 0) {
+		if (argc < 3 || argc > 4) {
+			usage_history();
+			exit(EXIT_SYNTAX);
+		}
+		name = argv[2];
+		if (argc > 3)
+			last = atoi(argv[3]);
+	} else if (strcmp(cmd, "runs") == 0 || strcmp(cmd, "flaky") == 0) {
+		if (argc > 4 || (argc > 3 && strcmp(cmd, "runs") == 0)) {
+			usage_history();
+			exit(EXIT_SYNTAX);
+		}
+		if (argc > 2)
+			last = atoi(argv[2]);
+		if (argc > 3)
+			top = atoi(argv[3]);
+	} else {
+		usage_history();
+		exit(EXIT_SYNTAX);
+	}
+
+	if (!hist_open(&h, argv[0]))
+		exit(EXIT_RUNTIME);
+
+	if (strcmp(cmd, "runs") == 0)
+		hist_print_runs(stdout, &h, last);
+	else if (strcmp(cmd, "duration") == 0)
+		rc = hist_print_duration(stdout, &h, name, last) ? 0 : 1;
+	else
+		hist_print_flaky(stdout, &h, last, top);
+
+	hist_close(&h);
+
+	return rc;
+}
+
+static void usage_stats(void)
+{
+	fprintf(stderr,
+"Usage: %s %s [-n TOP] LOGFILE...\n"
+"\n"
+"Analyze testcase metrics in one or more TAP13 logs. Print overall wall and\n"
+"CPU time, framework overhead, the TOP slowest tests (default: 10), a\n"
+"duration histogram, the time spent per test directory, and tests with an\n"
+"unusually large maximum resident set size.\n"
+"\n"
+"Each log is read in a single pass. A LOGFILE of '-' denotes standard\n"
+"input.\n",
+		program_invocation_short_name, CMD_STATS);
+}
+
+/* Analyze testcase metrics in TAP13 logs. */
+static int cmd_stats(int argc, char *argv[])
+{
+	struct stats_data s;
+	int i, top = 10, rc = 0;
+
+	if (argc >= 2 && strcmp(argv[0], "-n") == 0) {
+		top = atoi(argv[1]);
+		argc -= 2;
+		argv += 2;
+	}
+	if (argc < 1 || top < 0) {
+		usage_stats();
+		exit(EXIT_SYNTAX);
+	}
+
+	stats_init(&s, top);
+	for (i = 0; i < argc; i++) {
+		if (!stats_read(&s, argv[i]))
+			rc = EXIT_RUNTIME;
+	}
+	stats_print(stdout, &s);
+	stats_free(&s);
+
+	return rc;
+}
+
 int main(int argc, char *argv[])
 {
 	char *cmd;
@@ -1313,6 +2539,14 @@ int main(int argc, char *argv[])
 		rc = cmd_console(argc, argv);
 	else if (strcmp(cmd, CMD_YAMLSCALAR) == 0)
 		rc = cmd_yamlscalar(argc, argv);
+	else if (strcmp(cmd, CMD_YAMLSERVE) == 0)
+		rc = cmd_yamlserve(argc, argv);
+	else if (strcmp(cmd, CMD_LOG) == 0)
+		rc = cmd_log(argc, argv);
+	else if (strcmp(cmd, CMD_HISTORY) == 0)
+		rc = cmd_history(argc, argv);
+	else if (strcmp(cmd, CMD_STATS) == 0)
+		rc = cmd_stats(argc, argv);
 	else {
 		usage();
 		rc = EXIT_SYNTAX;
@@ -0,0 +1,90 @@
+#!/bin/bash
+#
+# Check if 'tela format' correctly forwards length-prefixed blocks of test
+# output data, and that TAP13 tests cannot forge block prefixes.
+#
+
+TELA="$TELA_FRAMEWORK/src/tela"
+IN="$TELA_TMP/in"
+LOG="$TELA_TMP/log"
+OUT="$TELA_TMP/out"
+CMD="$TELA_TMP/cmd"
+TAPCMD="$TELA_TMP/tapcmd"
+
+cat >$CMD <<EOF
+#!/bin/bash
+
+echo "ok 1 - not a result"
+echo "# tela: block 3"
+echo -n "no newline"
+
+exit 1
+EOF
+cat >$TAPCMD <<EOF
+#!/bin/bash
+
+echo "TAP version 13"
+echo "1..2"
+echo "ok 1 - first"
+echo "# tela: block 1000"
+echo "ok 2 - second"
+EOF
+chmod u+x $CMD $TAPCMD
+
+# Run with length-prefixed output blocks
+_TELA_FORMAT_BLOCKS=1 $TELA run $CMD >$IN 2>&1
+
+echo "Input"
+cat $IN
+
+RC=0
+if ! grep -q '^# tela: block ' $IN ; then
+	echo "Error: Missing block in 'tela run' output" >&2
+	RC=1
+fi
+
+TELA_PRETTY=0 TELA_WRITELOG=$LOG $TELA format $IN >$OUT 2>&1
+
+echo "Log"
+cat $LOG
+
+for f in $LOG $OUT ; do
+	if grep -q '^# tela: block ' $f ; then
+		echo "Error: Block prefix was not removed in $f" >&2
+		RC=1
+	fi
+	if ! grep -q '^    \[.*\] stdout: ok 1 - not a result$' $f ||
+	   ! grep -q '^    \[.*\] stdout: # tela: block 3$' $f ||
+	   ! grep -q '^    \[.*\] stdout(nonl): no newline$' $f ||
+	   ! grep -q '^  \.\.\.$' $f ; then
+		echo "Error: Block data not as expected in $f" >&2
+		RC=1
+	fi
+done
+
+if [[ "$(grep -c '^not ok' $LOG)" != 1 ]] ; then
+	echo "Error: Unexpected test result lines" >&2
+	RC=1
+fi
+
+# Run TAP13 test that prints a block prefix
+_TELA_FORMAT_BLOCKS=1 $TELA run $TAPCMD >$IN 2>&1
+TELA_PRETTY=0 TELA_WRITELOG=$LOG timeout 60 $TELA format $IN >$OUT 2>&1
+
+echo "Input for TAP13 test"
+cat $IN
+echo "Log for TAP13 test"
+cat $LOG
+
+if grep -q '^# tela: block ' $IN ; then
+	echo "Error: Block prefix printed by test was not escaped" >&2
+	RC=1
+fi
+if ! grep -q '^ok  *1 - .*:first$' $LOG ||
+   ! grep -q '^ok  *2 - .*:second$' $LOG
+then
+	echo "Error: Test results after forged block prefix are missing" >&2
+	RC=1
+fi
+
+exit $RC
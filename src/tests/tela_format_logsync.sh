@@ -0,0 +1,59 @@
+#!/bin/bash
+#
+# Check if 'tela format' writes the same log with all log sync policies and
+# warns about invalid policies.
+#
+
+TELA="$TELA_FRAMEWORK/src/tela"
+IN="$TELA_TMP/in"
+LOG="$TELA_TMP/log"
+OUT="$TELA_TMP/out"
+
+for (( i = 1; i <= 100; i++ )) ; do
+	echo "ok $i - test$i"
+	echo "  ---"
+	echo "    testresult: \"pass\""
+	echo "  ..."
+done >$IN
+
+RC=0
+for MODE in always interval:0 interval:50 end ; do
+	# Feed input slowly to exercise syncing while waiting for input
+	( head -n 200 $IN ; sleep 0.2 ; tail -n +201 $IN ) |
+		TELA_PRETTY=0 TELA_LOGSYNC=$MODE TELA_WRITELOG=$LOG.$MODE \
+		$TELA format - >$OUT 2>&1
+
+	echo "Output for LOGSYNC=$MODE"
+	cat $OUT
+
+	if [[ -s $OUT ]] && grep -q 'Warning' $OUT ; then
+		echo "Error: Unexpected warning for LOGSYNC=$MODE" >&2
+		RC=1
+	fi
+	if [[ "$(grep -c '^ok ' $LOG.$MODE)" != 100 ]] ; then
+		echo "Error: Missing results in log for LOGSYNC=$MODE" >&2
+		RC=1
+	fi
+	if ! cmp -s $LOG.always $LOG.$MODE ; then
+		echo "Error: Log for LOGSYNC=$MODE differs" >&2
+		RC=1
+	fi
+done
+
+TELA_PRETTY=0 TELA_LOGSYNC=sometimes TELA_WRITELOG=$LOG $TELA format $IN \
+	>$OUT 2>&1
+
+echo "Output for invalid LOGSYNC"
+cat $OUT
+
+if ! grep -q "Invalid LOGSYNC value 'sometimes'" $OUT ; then
+	echo "Error: Missing warning for invalid LOGSYNC value" >&2
+	RC=1
+fi
+
+if ! cmp -s $LOG.always $LOG ; then
+	echo "Error: Log for invalid LOGSYNC differs" >&2
+	RC=1
+fi
+
+exit $RC
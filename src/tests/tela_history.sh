@@ -0,0 +1,94 @@
+#!/bin/bash
+#
+# Check if 'tela format' adds test results to a history file and if
+# 'tela history' shows data from it.
+#
+
+TELA="$TELA_FRAMEWORK/src/tela"
+IN="$TELA_TMP/in"
+HIST="$TELA_TMP/hist"
+OUT="$TELA_TMP/out"
+
+# Do not overwrite log of enclosing test run
+export TELA_WRITELOG="$TELA_TMP/log"
+
+# write_run <duration> <result2> - write TAP input for a test run
+function write_run() {
+	cat >$IN <<EOF
+TAP version 13
+1..3
+ok 1 - dir/first.sh
+  ---
+  duration_ms: $1
+  rusage:
+    utime_ms: 1.000
+    maxrss_kb: 1024
+  ...
+${2/_/ } 2 - dir/second.sh
+ok 3 - other/third.sh # SKIP not needed
+EOF
+}
+
+RC=0
+for RUN in "10.500 ok" "11.500 not_ok" "12.500 ok" ; do
+	write_run $RUN
+	TELA_PRETTY=0 TELA_HISTORY=$HIST TELA_OS_ID=myos TELA_OS_VERSION=1 \
+		$TELA format $IN >/dev/null 2>&1
+done
+
+# Simulate crash during write
+truncate -s -8 $HIST
+
+write_run 13.500 ok
+TELA_PRETTY=0 TELA_HISTORY=$HIST TELA_OS_ID=myos TELA_OS_VERSION=1 \
+	$TELA format $IN >/dev/null 2>&1
+
+# check_history <expected_rc> <expected_output> <args...> - check
+# 'tela history' output
+function check_history() {
+	local rc exp_rc=$1 exp_out="$2"
+
+	shift 2
+	$TELA history $HIST "$@" >$OUT 2>&1
+	rc=$?
+
+	echo "Output for $*"
+	cat $OUT
+
+	if [[ $rc != $exp_rc ]] ; then
+		echo "Error: Unexpected exit code $rc for $*" >&2
+		RC=1
+	fi
+	if [[ "$(cat $OUT)" != "$exp_out" ]] ; then
+		echo "Error: Unexpected output for $*" >&2
+		RC=1
+	fi
+}
+
+check_history 0 "2 1/3 dir/second.sh" flaky
+check_history 0 "" flaky 1
+check_history 1 "" duration no/such/test
+
+$TELA history $HIST duration dir/first.sh >$OUT 2>&1
+echo "Output for duration"
+cat $OUT
+
+# Third run is missing because of simulated crash
+if [[ "$(cut -d ' ' -f 1,4,5 $OUT)" != "$(printf '%s\n' "1 pass 10.500" \
+      "2 pass 11.500" "3 pass 13.500")" ]] ; then
+	echo "Error: Unexpected output for duration" >&2
+	RC=1
+fi
+
+$TELA history $HIST runs >$OUT 2>&1
+echo "Output for runs"
+cat $OUT
+
+if [[ "$(wc -l <$OUT)" != 3 ]] ||
+   ! grep -q ' 3 2 0 1 .* myos 1$' $OUT ||
+   ! grep -q ' 3 1 1 1 .* myos 1$' $OUT ; then
+	echo "Error: Unexpected output for runs" >&2
+	RC=1
+fi
+
+exit $RC
@@ -0,0 +1,101 @@
+#!/bin/bash
+#
+# Check if 'tela format' writes a log index and if 'tela log query' uses it
+# to show selected test results.
+#
+
+TELA="$TELA_FRAMEWORK/src/tela"
+IN="$TELA_TMP/in"
+LOG="$TELA_TMP/log"
+OUT="$TELA_TMP/out"
+
+cat >$IN <<EOF
+TAP version 13
+1..3
+ok 1 - dir/first.sh
+  ---
+  testresult: "pass"
+  duration_ms: 1.500
+  output: |
+    [   0.001000] stdout: first output
+  ...
+not ok 2 - dir/second.sh
+  ---
+  testresult: "fail"
+  duration_ms: 20.250
+  output: |
+    [   0.002000] stdout: second output
+    [   0.003000] stderr: second error
+  ...
+ok 3 - other/third.sh # SKIP not needed
+EOF
+
+TELA_PRETTY=0 TELA_WRITELOG=$LOG $TELA format $IN >/dev/null 2>&1
+
+echo "Index"
+cat $LOG.idx
+
+RC=0
+if [[ "$(head -n 1 $LOG.idx)" != "# tela log index 1" ]] ||
+   [[ "$(wc -l <$LOG.idx)" != 4 ]] ; then
+	echo "Error: Unexpected index file contents" >&2
+	exit 1
+fi
+
+# check_query <expected_rc> <select> <view> - check 'tela log query' output
+function check_query() {
+	local rc
+
+	$TELA log query $LOG "$2" "$3" >$OUT 2>&1
+	rc=$?
+
+	echo "Output for select=$2 view=$3"
+	cat $OUT
+
+	if [[ $rc != $1 ]] ; then
+		echo "Error: Unexpected exit code $rc for select=$2 view=$3" >&2
+		RC=1
+	fi
+	if ! diff -u - $OUT ; then
+		echo "Error: Unexpected output for select=$2 view=$3" >&2
+		RC=1
+	fi
+}
+
+check_query 0 all summary <<EOF
+1 pass 1.500 dir/first.sh
+2 fail 20.250 dir/second.sh
+3 skip - other/third.sh
+EOF
+
+check_query 0 failed summary <<EOF
+2 fail 20.250 dir/second.sh
+EOF
+
+check_query 0 'dir/*' summary <<EOF
+1 pass 1.500 dir/first.sh
+2 fail 20.250 dir/second.sh
+EOF
+
+check_query 0 2 output <<EOF
+[   0.002000] stdout: second output
+[   0.003000] stderr: second error
+EOF
+
+check_query 0 1 full <<EOF
+ok     1 - dir/first.sh
+  ---
+  testresult: "pass"
+  duration_ms: 1.500
+  output: |
+    [   0.001000] stdout: first output
+  ...
+EOF
+
+check_query 0 3 full <<EOF
+ok     3 - other/third.sh # SKIP not needed
+EOF
+
+check_query 1 4 summary </dev/null
+
+exit $RC
@@ -0,0 +1,62 @@
+#!/bin/bash
+#
+# Check if 'tela monitor' records data from many streams registered via its
+# control stream.
+#
+
+TELA="$TELA_FRAMEWORK/src/tela"
+OUT="$TELA_TMP/out"
+CTL="$TELA_TMP/ctl"
+MAIN="$TELA_TMP/main"
+NUM=100
+
+mkfifo "$CTL" "$MAIN"
+for (( i=1; i<=NUM; i++ )) ; do
+	mkfifo "$TELA_TMP/fifo$i"
+done
+
+# Start monitor and open control and main stream
+$TELA monitor "main:$MAIN" <"$CTL" >"$OUT" &
+pid=$!
+exec 4>"$CTL"
+exec 3>"$MAIN"
+
+# Start writers - these block until the monitor opens the stream
+writers=()
+for (( i=1; i<=NUM; i++ )) ; do
+	echo "line $i" >"$TELA_TMP/fifo$i" &
+	writers+=( $! )
+done
+
+# Register streams, including a duplicate
+for (( i=1; i<=NUM; i++ )) ; do
+	echo "s$i:$TELA_TMP/fifo$i" >&4
+done
+echo "s1:$TELA_TMP/fifo1" >&4
+
+wait "${writers[@]}"
+exec 3>&- 4>&-
+wait $pid
+rc=$?
+
+echo "Output"
+cat "$OUT"
+
+if [[ $rc -ne 0 ]] ; then
+	echo "Error: Unexpected monitor exit code $rc" >&2
+	exit 1
+fi
+
+for (( i=1; i<=NUM; i++ )) ; do
+	if ! grep -q "s$i: line $i\$" "$OUT" ; then
+		echo "Error: Missing output of stream s$i" >&2
+		exit 1
+	fi
+done
+
+if ! grep -q "Duplicate stream registered 's1'" "$OUT" ; then
+	echo "Error: Missing warning about duplicate stream" >&2
+	exit 1
+fi
+
+exit 0
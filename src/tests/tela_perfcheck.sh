@@ -0,0 +1,115 @@
+#!/bin/bash
+#
+# Check if 'tela format' reports testcases with durations that regressed
+# compared to previous test runs stored in a history file.
+#
+
+TELA="$TELA_FRAMEWORK/src/tela"
+IN="$TELA_TMP/in"
+HIST="$TELA_TMP/hist"
+LOG="$TELA_TMP/log"
+OUT="$TELA_TMP/out"
+
+# format_run <duration> <utime> - run 'tela format' for a test run
+function format_run() {
+	cat >$IN <<EOF
+TAP version 13
+1..2
+ok 1 - dir/first.sh
+  ---
+  duration_ms: $1
+  rusage:
+    utime_ms: $2
+    stime_ms: 1.000
+  ...
+ok 2 - dir/second.sh
+  ---
+  duration_ms: 100.000
+  ...
+EOF
+	TELA_PRETTY=0 TELA_HISTORY=$HIST TELA_WRITELOG=$LOG $TELA format $IN \
+		>$OUT 2>&1
+}
+
+# Create baseline
+for D in 100.0 102.0 99.0 101.0 100.0 103.0 ; do
+	format_run $D 50.0
+done
+
+RC=0
+
+# No regression
+TELA_PERFCHECK=1 TELA_PERFCHECK_CPU=1 format_run 104.0 51.0
+
+echo "Output without regression"
+cat $OUT
+
+if grep -q 'perf_regression:' $LOG || grep -q 'regression' $OUT ; then
+	echo "Error: Unexpected regression reported" >&2
+	RC=1
+fi
+
+# Duration regression
+TELA_PERFCHECK=1 format_run 150.0 500.0
+
+echo "Output with duration regression"
+cat $OUT
+
+if ! grep -q "WARNING: dir/first.sh: Performance regression in duration$" \
+     $LOG ||
+   ! grep -q "Warning: dir/first.sh: Performance regression" $OUT ; then
+	echo "Error: Missing regression warning" >&2
+	RC=1
+fi
+if [[ "$(grep -c 'perf_regression:' $LOG)" != 1 ]] ||
+   ! grep -q '^    duration:$' $LOG ||
+   ! grep -q '^      value_ms: 150.000$' $LOG ||
+   ! grep -q '^      median_ms: 101.000$' $LOG ||
+   ! grep -q '^      samples: 7$' $LOG ; then
+	echo "Error: Missing or unexpected regression data" >&2
+	RC=1
+fi
+if grep -q '^    cpu:$' $LOG ; then
+	echo "Error: Unexpected CPU time regression" >&2
+	RC=1
+fi
+
+# Duration and CPU time regression with higher threshold
+TELA_PERFCHECK=1 TELA_PERFCHECK_CPU=1 TELA_PERFCHECK_THRESHOLD=20 \
+	format_run 150.0 500.0
+
+echo "Output with CPU time regression"
+cat $LOG
+
+if ! grep -q "Performance regression in CPU time$" $LOG ||
+   ! grep -q '^    cpu:$' $LOG || grep -q '^    duration:$' $LOG ; then
+	echo "Error: Missing or unexpected CPU time regression data" >&2
+	RC=1
+fi
+
+# Runs of another test suite sharing the history file must not hide the
+# baseline of testcases that were not part of these runs
+cat >$IN <<EOF
+TAP version 13
+1..1
+ok 1 - other/only.sh
+  ---
+  duration_ms: 10.000
+  ...
+EOF
+for I in $(seq 25) ; do
+	TELA_HISTORY=$HIST TELA_WRITELOG=$LOG $TELA format $IN >/dev/null 2>&1
+done
+
+TELA_PERFCHECK=1 format_run 150.0 50.0
+
+echo "Output with shared history file"
+cat $LOG
+
+if ! grep -q "Performance regression in duration$" $LOG ||
+   ! grep -q '^      samples: 9$' $LOG ; then
+	echo "Error: Missing regression with shared history file" >&2
+	RC=1
+fi
+
+exit $RC
@@ -0,0 +1,53 @@
+#!/bin/bash
+#
+# Check if 'tela run' records resource usage via cgroup v2 and kills processes
+# left behind by a test.
+#
+
+TELA="$TELA_FRAMEWORK/src/tela"
+OUT="$TELA_TMP/out"
+CMD="$TELA_TMP/cmd"
+PIDFILE="$TELA_TMP/pid"
+
+cat >$CMD <<EOF
+#!/bin/bash
+
+sleep 60 >/dev/null 2>&1 &
+echo \$! >$PIDFILE
+
+exit 0
+EOF
+chmod u+x $CMD
+
+# Filter through 'tela run'
+TELA_CGROUP=1 TELA_CGROUP_KILL=1 $TELA run $CMD >$OUT 2>&1
+
+echo "Output"
+cat $OUT
+
+if ! grep -q '^  cgroup:$' $OUT ; then
+	echo "Skipping: cgroup v2 not available"
+	kill $(cat $PIDFILE)
+	exit 2
+fi
+
+RC=0
+if ! grep -q 'cpu_usage_ms: ' $OUT ; then
+	echo "Error: Missing CPU usage" >&2
+	RC=1
+fi
+
+if ! grep -q 'leftover_procs: 1$' $OUT ; then
+	echo "Error: Missing leftover process count" >&2
+	RC=1
+fi
+
+# Process may remain as zombie until reaped
+STATE=$(awk '{ print $3 }' /proc/$(cat $PIDFILE)/stat 2>/dev/null)
+if [[ -n "$STATE" ]] && [[ "$STATE" != "Z" ]] ; then
+	echo "Error: Leftover process was not killed" >&2
+	kill $(cat $PIDFILE)
+	RC=1
+fi
+
+exit $RC
@@ -0,0 +1,54 @@
+#!/bin/bash
+#
+# Check if 'tela run' correctly records large amounts of interleaved stdout
+# and stderr output.
+#
+
+TELA="$TELA_FRAMEWORK/src/tela"
+OUT="$TELA_TMP/out"
+CMD="$TELA_TMP/cmd"
+LINES=20000
+
+cat >$CMD <<EOF
+#!/bin/bash
+
+for (( i = 0; i < $LINES; i++ )) ; do
+	echo "out \$i"
+done
+for (( i = 0; i < $LINES; i++ )) ; do
+	echo "err \$i" >&2
+done
+echo -n last
+
+exit 0
+EOF
+chmod u+x $CMD
+
+# Filter through 'tela run'
+$TELA run $CMD >$OUT 2>&1
+
+RC=0
+stdout=$(grep -c 'stdout: out [0-9]*$' $OUT)
+stderr=$(grep -c 'stderr: err [0-9]*$' $OUT)
+
+echo "stdout lines: $stdout"
+echo "stderr lines: $stderr"
+
+if [[ "$stdout" != "$LINES" ]] || [[ "$stderr" != "$LINES" ]] ; then
+	echo "Error: Unexpected number of output lines" >&2
+	RC=1
+fi
+
+if ! diff <(grep -o 'stdout: out .*' $OUT) \
+	  <(seq 0 $(( LINES - 1 )) | sed -e 's/^/stdout: out /') >/dev/null ;
+then
+	echo "Error: Output lines out of order" >&2
+	RC=1
+fi
+
+if ! grep -q 'stdout(nonl): last' $OUT ; then
+	echo "Error: Missing last line" >&2
+	RC=1
+fi
+
+exit $RC
@@ -0,0 +1,47 @@
+#!/bin/bash
+#
+# Check if 'tela run' correctly limits the amount of recorded output.
+#
+
+TELA="$TELA_FRAMEWORK/src/tela"
+OUT="$TELA_TMP/out"
+CMD="$TELA_TMP/cmd"
+
+cat >$CMD <<EOF
+#!/bin/bash
+
+for (( i = 0; i < 1000; i++ )) ; do
+	echo "line \$i"
+done
+echo -n last
+
+exit 0
+EOF
+chmod u+x $CMD
+
+# Filter through 'tela run'
+TELA_OUTPUT_LIMIT=100 TELA_OUTPUT_SPILL=0 $TELA run $CMD >$OUT 2>&1
+
+echo "Output"
+cat $OUT
+
+RC=0
+if ! grep -q 'output_bytes: 8894$' $OUT ||
+   ! grep -q 'output_omitted: 8694$' $OUT ; then
+	echo "Error: Missing output size" >&2
+	RC=1
+fi
+
+if ! grep -q 'tela: 8694 bytes of output omitted' $OUT ; then
+	echo "Error: Missing truncation marker" >&2
+	RC=1
+fi
+
+if ! grep -q 'stdout: line 0$' $OUT || grep -q 'stdout: line 500$' $OUT ||
+   ! grep -q 'stdout: line 999$' $OUT ||
+   ! grep -q 'stdout(nonl): last' $OUT ; then
+	echo "Error: Output not as expected" >&2
+	RC=1
+fi
+
+exit $RC
@@ -0,0 +1,61 @@
+#!/bin/bash
+#
+# Check if 'tela run' counts performance events specified in the test YAML
+# file.
+#
+
+TELA="$TELA_FRAMEWORK/src/tela"
+OUT="$TELA_TMP/out"
+CMD="$TELA_TMP/cmd"
+
+cat >$CMD <<EOF
+#!/bin/bash
+
+for (( i = 0; i < 10; i++ )) ; do
+	/bin/true
+done
+
+exit 0
+EOF
+chmod u+x $CMD
+
+cat >$CMD.yaml <<EOF
+test:
+  perf:
+    - task-clock
+    - context-switches
+    - no-such-event
+EOF
+
+# Filter through 'tela run'
+TELA_PERF=0 $TELA run $CMD >$OUT 2>&1
+
+echo "Output"
+cat $OUT
+
+RC=0
+if ! grep -q "Unknown performance event 'no-such-event'" $OUT ; then
+	echo "Error: Missing warning about unknown event" >&2
+	RC=1
+fi
+
+if ! grep -q '^  perf:$' $OUT ; then
+	if [[ $RC -eq 0 ]] ; then
+		echo "Skipping: perf_event_open() not available"
+		exit 2
+	fi
+	exit $RC
+fi
+
+if ! grep -q '^    task-clock: [1-9]' $OUT ||
+   ! grep -q '^    context-switches: [0-9]' $OUT ; then
+	echo "Error: Missing event counts" >&2
+	RC=1
+fi
+
+if grep -q 'no-such-event:' $OUT ; then
+	echo "Error: Unexpected count for unknown event" >&2
+	RC=1
+fi
+
+exit $RC
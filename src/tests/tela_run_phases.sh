@@ -0,0 +1,124 @@
+#!/bin/bash
+#
+# Check if 'tela run' reports the durations of framework phases in the YAML
+# data of test results.
+#
+
+TELA="$TELA_FRAMEWORK/src/tela"
+OUT="$TELA_TMP/out"
+CMD="$TELA_TMP/cmd"
+TAPCMD="$TELA_TMP/tapcmd"
+NOYAMLCMD="$TELA_TMP/noyamlcmd"
+SKIPCMD="$TELA_TMP/skipcmd"
+RC=0
+
+cat >$CMD <<EOF
+#!/bin/bash
+exit 0
+EOF
+cat >$TAPCMD <<EOF
+#!/bin/bash
+echo "TAP version 13"
+echo "1..2"
+echo "ok 1 - first"
+echo "  ---"
+echo "  my: data"
+echo "  ..."
+echo "ok 2 - second"
+echo "  ---"
+echo "  ..."
+EOF
+cat >$NOYAMLCMD <<EOF
+#!/bin/bash
+echo "TAP version 13"
+echo "1..2"
+echo "ok 1 - first"
+echo "ok 2 - second"
+EOF
+cp $CMD $SKIPCMD
+cat >$SKIPCMD.yaml <<EOF
+test:
+  plan: 3
+EOF
+chmod u+x $CMD $TAPCMD $NOYAMLCMD $SKIPCMD
+
+# check_phases <description> <phases...> - check that output contains
+# all specified phases
+function check_phases() {
+	local desc="$1" phase
+
+	shift
+	for phase in "$@" ; do
+		if ! grep -q "^    ${phase}_ms: [0-9]*\.[0-9]\{3\}$" $OUT ; then
+			echo "Error: Missing phase '$phase' for $desc" >&2
+			RC=1
+		fi
+	done
+}
+
+# Phases measured by 'tela run'
+$TELA run $CMD >$OUT 2>&1
+
+echo "Output"
+cat $OUT
+
+if [[ "$(grep -c '^  phases:$' $OUT)" != 1 ]] ; then
+	echo "Error: Missing phases for test" >&2
+	RC=1
+fi
+check_phases "test" config filter state match setup
+
+# Phases measured by runtests.sh before 'tela run'
+_TELA_PHASES="resolve=12.500 before=1.250" $TELA run $CMD "" /dev/null \
+	>$OUT 2>&1
+
+echo "Output with phases from runtests.sh"
+cat $OUT
+
+if ! grep -A 3 '^  phases:$' $OUT | grep -q '^    before_ms: 1.250$' ||
+   ! grep -A 3 '^  phases:$' $OUT | grep -q '^    resolve_ms: 12.500$' ; then
+	echo "Error: Missing phases from runtests.sh" >&2
+	RC=1
+fi
+check_phases "test with match data" config setup
+
+# Phases for first result of a TAP13 test only
+$TELA run $TAPCMD >$OUT 2>&1
+
+echo "Output for TAP13 test"
+cat $OUT
+
+if [[ "$(grep -c '^  phases:$' $OUT)" != 1 ]] ||
+   [[ "$(grep -B 1 '^  \.\.\.$' $OUT | grep -c '^    setup_ms: ')" != 1 ]] ||
+   ! grep -A 2 '^ok  *1 ' $OUT | grep -q '^  my: data$'
+then
+	echo "Error: Unexpected phases for TAP13 test results" >&2
+	RC=1
+fi
+
+# Phases for TAP13 test without YAML data
+$TELA run $NOYAMLCMD >$OUT 2>&1
+
+echo "Output for TAP13 test without YAML data"
+cat $OUT
+
+if [[ "$(grep -c '^  phases:$' $OUT)" != 1 ]] ||
+   ! grep -A 1 '^ok  *1 ' $OUT | grep -q '^  ---$' ; then
+	echo "Error: Missing phases for TAP13 test without YAML data" >&2
+	RC=1
+fi
+check_phases "TAP13 test without YAML data" config setup
+
+# Phases for skipped test with multiple planned results
+$TELA run $SKIPCMD "" "" "Missing resource" >$OUT 2>&1
+
+echo "Output for skipped test"
+cat $OUT
+
+if [[ "$(grep -c '^ok ' $OUT)" != 3 ]] ||
+   [[ "$(grep -c '^  phases:$' $OUT)" != 1 ]] ; then
+	echo "Error: Unexpected phases for skipped test" >&2
+	RC=1
+fi
+
+exit $RC
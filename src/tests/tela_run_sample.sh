@@ -0,0 +1,66 @@
+#!/bin/bash
+#
+# Check if 'tela run' periodically samples resource usage while a test is
+# running.
+#
+
+TELA="$TELA_FRAMEWORK/src/tela"
+OUT="$TELA_TMP/out"
+CMD="$TELA_TMP/cmd"
+
+cat >$CMD <<EOF
+#!/bin/bash
+
+sleep 0.5
+echo done
+
+exit 0
+EOF
+chmod u+x $CMD
+
+# Filter through 'tela run'
+TELA_SAMPLE=50 $TELA run $CMD >$OUT 2>&1
+
+echo "Output"
+cat $OUT
+
+RC=0
+if ! grep -q '^  samples: |$' $OUT ; then
+	echo "Error: Missing samples" >&2
+	exit 1
+fi
+
+if ! grep -q '^    time_ms,cpu_user_pct,' $OUT ; then
+	echo "Error: Missing sample header" >&2
+	RC=1
+fi
+
+ROWS=$(grep -c '^    [0-9]*,[0-9.]*,' $OUT)
+if [[ $ROWS -lt 5 ]] ; then
+	echo "Error: Expected at least 5 samples, got $ROWS" >&2
+	RC=1
+fi
+
+if ! grep -q 'stdout: done' $OUT ; then
+	echo "Error: Missing test output" >&2
+	RC=1
+fi
+
+# Check that very small intervals are increased
+TELA_SAMPLE=1 $TELA run $CMD >$OUT 2>&1
+
+echo "Output with small interval"
+cat $OUT
+
+if ! grep -q "SAMPLE value '1' too small, using 10 ms" $OUT ; then
+	echo "Error: Missing warning for small interval" >&2
+	RC=1
+fi
+
+ROWS=$(grep -c '^    [0-9]*,[0-9.]*,' $OUT)
+if [[ $ROWS -gt 200 ]] ; then
+	echo "Error: Expected at most 200 samples, got $ROWS" >&2
+	RC=1
+fi
+
+exit $RC
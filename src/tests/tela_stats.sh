@@ -0,0 +1,87 @@
+#!/bin/bash
+#
+# Check if 'tela stats' correctly aggregates testcase metrics from TAP13 logs.
+#
+
+TELA="$TELA_FRAMEWORK/src/tela"
+LOG="$TELA_TMP/log"
+OUT="$TELA_TMP/out"
+
+# result <num> <name> <start> <duration_ms> <utime_ms> <maxrss_kb> - write
+# result with YAML data
+function result() {
+	cat <<EOF
+ok $1 - $2
+  ---
+  testresult: "pass"
+  testexec: "/tests/${2%%:*}"
+  starttime: $3
+  stoptime:  $(awk "BEGIN { printf \"%.6f\", $3 + $4 / 1000 }") # comment
+  duration_ms: $4
+  rusage:
+    utime_ms: $5
+    stime_ms: 1.000
+    maxrss_kb: $6
+  output: |
+    [   0.001000] stdout:   duration_ms: 99999
+    utime_ms: 99999
+    maxrss_kb: 99999999
+  ...
+EOF
+}
+
+{
+	echo "TAP version 13"
+	echo "1..14"
+	result 1 dir1/a.sh 1000.0 100.0 10.0 1000
+	result 2 dir1/b.sh 1000.2 2000.0 20.0 1100
+	result 3 dir2/c.sh:sub1 1002.5 400.0 30.0 1200
+	result 4 dir2/c.sh:sub2 1002.5 400.0 30.0 1200
+	for (( i = 5; i <= 13; i++ )) ; do
+		result $i other/t$i.sh 1003.0 0.5 0.0 1000
+	done
+	result 14 dir1/big.sh 1003.1 10.0 1.0 500000
+	echo "ok 15 - dir1/skipped.sh # SKIP not needed"
+} >$LOG
+
+$TELA stats -n 3 $LOG - <$LOG >$OUT 2>&1
+RC=$?
+
+echo "Output"
+cat $OUT
+
+if [[ $RC -ne 0 ]] ; then
+	echo "Error: Unexpected exit code $RC" >&2
+	exit 1
+fi
+
+# check <pattern> <description> - check for output line matching pattern
+function check() {
+	if ! grep -q -- "$1" $OUT ; then
+		echo "Error: Missing or unexpected $2" >&2
+		RC=1
+	fi
+}
+
+check '^Logs: *2$' "log count"
+check '^Results: *30 (pass: 28, fail: 0, skip: 2, todo: 0)$' "result counts"
+check '^Test runs: *28 (with duration: 26)$' "test run count"
+check '^Wall time: *6.220 s$' "wall time"
+check '^Test duration: *5.029 s$' "test duration"
+check '^Framework overhead: *1.191 s ' "framework overhead"
+check '^CPU time: *0.148 s (user: 0.122 s, system: 0.026 s' "CPU time"
+check '^ *2.000 s  dir1/b.sh$' "slowest test"
+check '^ *0.400 s  dir2/c.sh$' "slowest test with subtests"
+check '^ *< 1 ms *18  #*$' "histogram bucket"
+check '^ *1024-2048 ms *2  #*$' "histogram bucket"
+check '^ *4.220 s *83.9% *6  dir1$' "directory time"
+check '^ *0.800 s *15.9% *2  dir2$' "directory time"
+check '^ *500000 kB  dir1/big.sh$' "RSS outlier"
+
+if [[ "$(grep -c ' kB  ' $OUT)" != 2 ]] ||
+   [[ "$(grep -c ' s  dir1/b.sh$' $OUT)" != 2 ]] ; then
+	echo "Error: Unexpected slowest tests or RSS outliers" >&2
+	RC=1
+fi
+
+exit $RC
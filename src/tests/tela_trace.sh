@@ -0,0 +1,62 @@
+#!/bin/bash
+#
+# Check if 'make check TRACE=<path>' writes trace events of all tela
+# components in Chrome trace-event format.
+#
+
+TRACE="$TELA_TMP/trace.json"
+OUT="$TELA_TMP/out"
+
+./clear_make.sh -C subtests check TESTS=yaml_out_bash.sh PRETTY=0 \
+	LOG="$TELA_TMP/log" TRACE="$TRACE" >"$OUT" 2>&1
+RC=$?
+
+echo "Output"
+cat $OUT
+echo "Trace"
+cat $TRACE
+
+if [[ $RC -ne 0 ]] ; then
+	echo "Error: Unexpected exit code $RC" >&2
+	exit 1
+fi
+
+# check <phase> <args> - check for begin and end event of a phase
+function check() {
+	local b e
+
+	b=$(grep -c "^{\"name\":\"$1\",\"cat\":\"tela\",\"ph\":\"B\",.*$2},$" \
+		$TRACE)
+	e=$(grep -c "^{\"name\":\"$1\",\"cat\":\"tela\",\"ph\":\"E\"," $TRACE)
+	if [[ "$b" -eq 0 ]] || [[ "$b" != "$e" ]] ; then
+		echo "Error: Missing or unbalanced '$1' events" >&2
+		RC=1
+	fi
+}
+
+# Events from runtests.sh
+check testsuite '"args":{"test":"subtests"}'
+check count '"tid":[0-9]*'
+check test '"args":{"test":"yaml_out_bash.sh"}'
+
+# Events from 'tela run'
+check prepare '"args":{"test":"yaml_out_bash.sh"}'
+check exec '"args":{"test":"yaml_out_bash.sh"}'
+
+# Events from 'tela format'
+check format '"tid":[0-9]*'
+
+if [[ "$(head -n 1 $TRACE)" != "[" ]] || [[ "$(tail -n 1 $TRACE)" != "]" ]]
+then
+	echo "Error: Trace is not a complete JSON array" >&2
+	RC=1
+fi
+
+# Validate JSON syntax if possible
+if type -P python3 >/dev/null &&
+   ! python3 -c 'import json, sys; json.load(open(sys.argv[1]))' $TRACE ; then
+	echo "Error: Trace is not valid JSON" >&2
+	RC=1
+fi
+
+exit $RC
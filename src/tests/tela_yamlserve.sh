@@ -0,0 +1,60 @@
+#!/bin/bash
+#
+# Ensure that tela's yamlserve function returns the same results as yamlget
+# and yamlscalar.
+#
+
+source $TELA_BASH || exit 1
+source $TELA_FRAMEWORK/src/libexec/lib/common.bash || exit 1
+
+yaml=$TELA_TMP/data.yaml
+text=$TELA_TMP/data.txt
+expect=$TELA_TMP/expect
+actual=$TELA_TMP/actual
+
+cat >$yaml <<'DATA'
+system:
+  _id: localhost
+  ssh:
+    user: root
+    host: host1
+system remote:
+  ssh:
+    user: "it's me"
+    host: host2
+  list:
+    - a
+    - b
+test:
+  plan:
+    first: 1
+    second: 2
+DATA
+printf "line 1\nline 2\001\n" >$text
+
+PATTERNS=( "*" "*/" "system/ssh/user/" "system*/ssh/*/" "*/*/*" \
+	   "test/plan/*/" "[st]*/ssh" "none" )
+
+for pattern in "${PATTERNS[@]}" ; do
+	$TELA_TOOL yamlget $yaml "$pattern"
+done >$expect
+$TELA_TOOL yamlscalar $text 2 1 >>$expect
+echo "root" >>$expect
+
+yamlserve_start $yaml
+yamlserve_get "${PATTERNS[@]}" >$actual
+yamlserve_scalar $text 2 1 >>$actual
+yamlserve_value value "system/ssh/user" && echo "$value" >>$actual
+yamlserve_value value "system/none" && echo "unexpected" >>$actual
+yamlserve_stop
+
+diff -u $expect $actual >$TELA_TMP/diff
+if [[ $? -ne 0 ]] ; then
+	yaml "diff: |"
+	yaml_file $TELA_TMP/diff 2
+	fail "yamlserve"
+else
+	pass "yamlserve"
+fi
+
+exit $(exit_status)
@@ -0,0 +1,57 @@
+#!/bin/bash
+#
+# Tests for functions yaml.c:yaml_write_binary() and yaml_load_binary():
+# - binary round-trip of different input data
+# - replacing an existing file keeps its mode
+#
+
+source $TELA_BASH || exit 1
+
+DATADIR=trav_data
+
+for YAML in $DATADIR/*.yaml ; do
+	NAME=${YAML##*/}
+	NAME=${NAME%.yaml}
+	BIN=$TELA_TMP/${NAME}.bin
+	OUT=$TELA_TMP/${NAME}.out
+
+	./yamltest binary $YAML $BIN >$OUT 2>&1
+	RC_RUN=$?
+
+	yaml "rc:"
+	yaml "  expect: 0"
+	yaml "  actual: $RC_RUN"
+	yaml "output:"
+	yaml_file $OUT 2
+
+	if [ $RC_RUN -ne 0 ] ; then
+		fail "$NAME"
+	else
+		pass "$NAME"
+	fi
+done
+
+# Replace existing file
+BIN=$TELA_TMP/mode.bin
+echo "old" >$BIN
+chmod 0640 $BIN
+./yamltest binary $DATADIR/full.yaml $BIN >$TELA_TMP/mode.out 2>&1
+RC_RUN=$?
+MODE=$(stat -c %a $BIN)
+TMPFILES=$(ls $BIN.tmp.* 2>/dev/null)
+
+yaml "rc:"
+yaml "  expect: 0"
+yaml "  actual: $RC_RUN"
+yaml "mode:"
+yaml "  expect: 640"
+yaml "  actual: $MODE"
+yaml "tmpfiles: \"$TMPFILES\""
+
+if [ $RC_RUN -ne 0 ] || [ "$MODE" != 640 ] || [ -n "$TMPFILES" ] ; then
+	fail "mode"
+else
+	pass "mode"
+fi
+
+exit $(exit_status)
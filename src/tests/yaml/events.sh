@@ -0,0 +1,43 @@
+#!/bin/bash
+#
+# Tests for function yaml.c:yaml_scan_file():
+# - event order and paths
+# - multi-line scalars
+# - early termination by the callback
+# - syntax errors
+#
+
+source $TELA_BASH || exit 1
+
+DATADIR=events_data
+
+for YAML in $DATADIR/*.yaml ; do
+	NAME=${YAML##*/}
+	NAME=${NAME%.yaml}
+	OUT=$TELA_TMP/${NAME}.out
+	BASE=$DATADIR/${NAME}
+	LIMIT=0
+
+	[ -e ${BASE}.limit ] && LIMIT=$(cat ${BASE}.limit)
+
+	(cd $DATADIR && ../yamltest events ${NAME}.yaml $LIMIT) >$OUT 2>&1
+	RC_RUN=$?
+
+	yaml "rc:"
+	yaml "  expect: 0"
+	yaml "  actual: $RC_RUN"
+
+	diff -u ${BASE}.out $OUT >$TELA_TMP/diff
+	RC_DIFF=$?
+
+	yaml "output:"
+	yaml_file $TELA_TMP/diff 2
+
+	if [ $RC_RUN -ne 0 -o $RC_DIFF -ne 0 ] ; then
+		fail "$NAME"
+	else
+		pass "$NAME"
+	fi
+done
+
+exit $(exit_status)
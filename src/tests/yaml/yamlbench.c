@@ -0,0 +1,563 @@
+/*
+ * Throughput benchmark for the YAML functions in yaml.c.
+ *
+ * Generate a YAML document resembling the output of 'make telastate', run
+ * the most frequently used YAML operations on it and report the time and the
+ * number of heap allocations per node. Results are printed in YAML format
+ * and can optionally be compared against a previously stored baseline.
+ *
+ * Times are the median of all runs of an operation. An operation is reported
+ * as regression if its median exceeds the baseline median by more than
+ * <threshold> deviations. The deviation is the larger of the scaled median
+ * absolute deviation (MAD) of baseline and current runs, but at least 10% of
+ * the baseline median. Operations that appear slower are measured again to
+ * rule out transient noise.
+ *
+ * Usage: yamlbench [-n <systems>] [-d <depth>] [-f <fanout>] [-r <repeat>]
+ *                  [-t <threshold>] [-b <baseline>] [-o <output>]
+ */
+
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "misc.h"
+#include "yaml.h"
+
+#define DEFAULT_SYSTEMS		50
+#define DEFAULT_DEPTH		3
+#define DEFAULT_FANOUT		6
+#define DEFAULT_REPEAT		31
+#define DEFAULT_THRESHOLD	3
+#define MIN_DEV_PERCENT		10
+#define RETRIES			2
+
+/* Allocation counters. Memory is obtained from the glibc allocator. */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static bool counting;
+static unsigned long num_allocs;
+static unsigned long num_bytes;
+
+static void count(size_t size)
+{
+	if (counting) {
+		num_allocs++;
+		num_bytes += size;
+	}
+}
+
+void *malloc(size_t size)
+{
+	count(size);
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	count(nmemb * size);
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	count(size);
+	return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+	__libc_free(ptr);
+}
+
+/**
+ * struct params - Benchmark parameters
+ * @systems: Number of top-level system entries
+ * @depth: Maximum nesting depth of resources per system
+ * @fanout: Number of entries per mapping
+ * @repeat: Number of runs per operation
+ * @threshold: Number of deviations above baseline that indicate a regression
+ */
+struct params {
+	int systems;
+	int depth;
+	int fanout;
+	int repeat;
+	int threshold;
+};
+
+/**
+ * struct bench - Benchmark state
+ * @filename: Name of file containing the generated document
+ * @null: Output stream for write operations
+ * @root: Parsed document
+ * @copy: Copy of @root used for two-document operations
+ * @paths: Paths of all mapping nodes in @root
+ * @num_paths: Number of entries in @paths
+ * @num_nodes: Number of nodes in @root
+ * @size: Size of generated document in bytes
+ */
+struct bench {
+	char *filename;
+	FILE *null;
+	struct yaml_node *root;
+	struct yaml_node *copy;
+	char **paths;
+	int num_paths;
+	long num_nodes;
+	long size;
+};
+
+/**
+ * struct result - Result for a single operation
+ * @name: Operation name
+ * @units: Number of units processed per run
+ * @ns: Median run time in nanoseconds
+ * @dev: Scaled median absolute deviation of run times in nanoseconds
+ * @allocs: Number of allocations during the first run
+ * @bytes: Number of bytes allocated during the first run
+ */
+struct result {
+	const char *name;
+	long units;
+	double ns;
+	double dev;
+	unsigned long allocs;
+	unsigned long bytes;
+};
+
+static void gen_map(FILE *fd, const struct params *p, int indent, int depth,
+		    unsigned int *id)
+{
+	int i, j;
+
+	fprintf(fd, "%*s_id: 0.0.%04x\n", indent, "", (*id)++);
+	for (i = 0; i < p->fanout; i++) {
+		if (depth > 0 && i % 3 == 0) {
+			fprintf(fd, "%*sdasd%d 0.0.%04x:\n", indent, "", i,
+				*id);
+			gen_map(fd, p, indent + 2, depth - 1, id);
+		} else if (i % 3 == 1) {
+			fprintf(fd, "%*spackages%d:\n", indent, "", i);
+			for (j = 0; j < p->fanout; j++) {
+				fprintf(fd, "%*s- pkg-%d-%d\n", indent + 2, "",
+					i, j);
+			}
+		} else {
+			fprintf(fd, "%*sattr%d: value %u\n", indent, "", i,
+				(*id)++);
+		}
+	}
+}
+
+/* Generate a document resembling the output of 'make telastate'. */
+static void gen_doc(struct bench *b, const struct params *p)
+{
+	unsigned int id = 0;
+	char *tmpdir;
+	FILE *fd;
+	int i, f;
+
+	tmpdir = getenv("TMPDIR");
+	b->filename = misc_asprintf("%s/yamlbench.XXXXXX",
+				    tmpdir ? tmpdir : "/tmp");
+	f = mkstemp(b->filename);
+	if (f == -1)
+		err(1, "Could not create temporary file");
+	fd = fdopen(f, "w");
+	if (!fd)
+		err(1, "Could not open temporary file");
+
+	for (i = 0; i < p->systems; i++) {
+		if (i == 0)
+			fprintf(fd, "system:\n");
+		else
+			fprintf(fd, "system host%d:\n", i);
+		fprintf(fd, "  hypervisor:\n");
+		fprintf(fd, "    type: zvm\n");
+		fprintf(fd, "    version: 7.3.0\n");
+		fprintf(fd, "  user: root\n");
+		gen_map(fd, p, 2, p->depth, &id);
+	}
+
+	b->size = ftell(fd);
+	if (fclose(fd))
+		err(1, "Could not write temporary file");
+}
+
+static bool collect_cb(struct yaml_iter *iter, void *data)
+{
+	struct bench *b = data;
+
+	b->num_nodes++;
+	if (iter->node->type == yaml_map) {
+		misc_expand_array(&b->paths, &b->num_paths);
+		b->paths[b->num_paths - 1] = misc_strdup(iter->path);
+	}
+
+	return true;
+}
+
+static bool count_cb(struct yaml_iter *iter, void *data)
+{
+	long *n = data;
+
+	(*n)++;
+
+	return true;
+}
+
+static bool count2_cb(struct yaml_iter *a, struct yaml_iter *b, void *data)
+{
+	long *n = data;
+
+	(*n)++;
+
+	return true;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/*
+ * Run a single benchmark iteration of operation @name. Return a newly created
+ * document that must be freed by the caller or %NULL.
+ */
+static struct yaml_node *run_op(struct bench *b, const char *name)
+{
+	struct yaml_node *node = NULL;
+	long n = 0;
+	int i;
+
+	if (strcmp(name, "parse") == 0) {
+		node = yaml_parse_file("%s", b->filename);
+	} else if (strcmp(name, "write") == 0) {
+		yaml_write_stream(b->root, b->null, 0, false);
+		fflush(b->null);
+	} else if (strcmp(name, "dup") == 0) {
+		node = yaml_dup(b->root, false, false);
+	} else if (strcmp(name, "traverse") == 0) {
+		yaml_traverse(&b->root, count_cb, &n);
+	} else if (strcmp(name, "traverse2") == 0) {
+		yaml_traverse2(&b->root, &b->copy, count2_cb, &n);
+	} else if (strcmp(name, "cmp") == 0) {
+		/* Discard cached hashes to measure a full comparison. */
+		yaml_touch(b->root);
+		yaml_touch(b->copy);
+		if (!yaml_cmp(b->root, b->copy))
+			errx(1, "Copy differs from original");
+	} else if (strcmp(name, "get_node") == 0) {
+		for (i = 0; i < b->num_paths; i++) {
+			if (!yaml_get_node(b->root, b->paths[i]))
+				errx(1, "Path not found: %s", b->paths[i]);
+		}
+	}
+
+	return node;
+}
+
+static int double_cmp(const void *a, const void *b)
+{
+	double va = *(const double *) a, vb = *(const double *) b;
+
+	return (va > vb) - (va < vb);
+}
+
+/* Return the median of @num values in @v. Note: @v is sorted. */
+static double median(double *v, int num)
+{
+	qsort(v, num, sizeof(*v), double_cmp);
+	if (num % 2)
+		return v[num / 2];
+
+	return (v[num / 2 - 1] + v[num / 2]) / 2.0;
+}
+
+static void measure(struct bench *b, struct result *r, int repeat)
+{
+	struct yaml_node *node;
+	double start, *ns;
+	int i;
+
+	ns = misc_malloc(repeat * sizeof(*ns));
+	for (i = 0; i < repeat; i++) {
+		num_allocs = 0;
+		num_bytes = 0;
+		counting = true;
+		start = now();
+		node = run_op(b, r->name);
+		ns[i] = now() - start;
+		counting = false;
+		yaml_free(node);
+
+		if (i == 0) {
+			r->allocs = num_allocs;
+			r->bytes = num_bytes;
+		}
+	}
+
+	r->ns = median(ns, repeat);
+	for (i = 0; i < repeat; i++)
+		ns[i] = ns[i] > r->ns ? ns[i] - r->ns : r->ns - ns[i];
+	r->dev = 1.4826 * median(ns, repeat);
+	free(ns);
+}
+
+static void print_results(FILE *fd, const struct params *p,
+			  const struct bench *b, struct result *results,
+			  int num)
+{
+	struct result *r;
+	int i;
+
+	fprintf(fd, "params:\n");
+	fprintf(fd, "  systems: %d\n", p->systems);
+	fprintf(fd, "  depth: %d\n", p->depth);
+	fprintf(fd, "  fanout: %d\n", p->fanout);
+	fprintf(fd, "  nodes: %ld\n", b->num_nodes);
+	fprintf(fd, "  bytes: %ld\n", b->size);
+	fprintf(fd, "results:\n");
+	for (i = 0; i < num; i++) {
+		r = &results[i];
+		fprintf(fd, "  %s:\n", r->name);
+		fprintf(fd, "    ns_per_node: %.1f\n", r->ns / r->units);
+		fprintf(fd, "    ns_dev_per_node: %.1f\n", r->dev / r->units);
+		fprintf(fd, "    allocs_per_node: %.3f\n",
+			(double) r->allocs / r->units);
+		fprintf(fd, "    bytes_per_node: %.1f\n",
+			(double) r->bytes / r->units);
+	}
+}
+
+static bool get_double(struct yaml_node *root, const char *path, double *v)
+{
+	char *str, *end;
+
+	str = yaml_get_scalar(root, path);
+	if (!str)
+		return false;
+	*v = strtod(str, &end);
+
+	return *end == 0;
+}
+
+/*
+ * Check if the run time of @r exceeds the baseline in @base. Store the limit
+ * in nanoseconds per node in @limit.
+ */
+static bool is_slower(struct yaml_node *base, const struct params *p,
+		      struct result *r, double *limit)
+{
+	double base_ns, base_dev, dev;
+	char *path;
+	bool ok;
+
+	path = misc_asprintf("results/%s/ns_per_node", r->name);
+	ok = get_double(base, path, &base_ns);
+	free(path);
+	if (!ok)
+		return false;
+
+	path = misc_asprintf("results/%s/ns_dev_per_node", r->name);
+	if (!get_double(base, path, &base_dev))
+		base_dev = 0;
+	free(path);
+
+	dev = r->dev / r->units;
+	if (dev < base_dev)
+		dev = base_dev;
+	if (dev < base_ns * MIN_DEV_PERCENT / 100)
+		dev = base_ns * MIN_DEV_PERCENT / 100;
+	*limit = base_ns + p->threshold * dev;
+
+	return r->ns / r->units > *limit;
+}
+
+/*
+ * Compare @results against the baseline stored in @filename. Operations that
+ * appear slower are measured again, and the fastest median is kept. Return
+ * %true if a regression was found.
+ */
+static bool compare(const char *filename, const struct params *p,
+		    struct bench *b, struct result *results, int num)
+{
+	double base_allocs, allocs, nodes, limit;
+	struct result *r, retry;
+	struct yaml_node *base;
+	bool regression = false;
+	char *path;
+	int i, j;
+
+	if (access(filename, F_OK) != 0) {
+		warnx("%s: No baseline found - use 'make bench_baseline' to "
+		      "create one", filename);
+		return false;
+	}
+
+	base = yaml_parse_file("%s", filename);
+	if (!base) {
+		warnx("%s: Could not read baseline", filename);
+		return false;
+	}
+
+	if (!get_double(base, "params/nodes", &nodes) ||
+	    nodes != b->num_nodes) {
+		warnx("%s: Baseline uses different parameters - skipping "
+		      "comparison", filename);
+		goto out;
+	}
+
+	for (i = 0; i < num; i++) {
+		r = &results[i];
+		allocs = (double) r->allocs / r->units;
+
+		for (j = 0; j < RETRIES && is_slower(base, p, r, &limit);
+		     j++) {
+			retry = *r;
+			measure(b, &retry, p->repeat);
+			if (retry.ns < r->ns) {
+				r->ns = retry.ns;
+				r->dev = retry.dev;
+			}
+		}
+		if (is_slower(base, p, r, &limit)) {
+			warnx("Regression in %s: %.1f ns per node (limit "
+			      "%.1f)", r->name, r->ns / r->units, limit);
+			regression = true;
+		}
+
+		path = misc_asprintf("results/%s/allocs_per_node", r->name);
+		if (get_double(base, path, &base_allocs) &&
+		    allocs > base_allocs + 0.001) {
+			warnx("Regression in %s: %.3f allocations per node "
+			      "(baseline %.3f)", r->name, allocs, base_allocs);
+			regression = true;
+		}
+		free(path);
+	}
+
+out:
+	yaml_free(base);
+
+	return regression;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "Usage: %s [-n <systems>] [-d <depth>] "
+		"[-f <fanout>] [-r <repeat>]\n", name);
+	fprintf(stderr, "       %*s [-t <threshold>] [-b <baseline>] "
+		"[-o <output>]\n", (int) strlen(name), "");
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	struct params p = {
+		.systems = DEFAULT_SYSTEMS,
+		.depth = DEFAULT_DEPTH,
+		.fanout = DEFAULT_FANOUT,
+		.repeat = DEFAULT_REPEAT,
+		.threshold = DEFAULT_THRESHOLD,
+	};
+	struct result results[] = {
+		{ .name = "parse" },
+		{ .name = "write" },
+		{ .name = "dup" },
+		{ .name = "traverse" },
+		{ .name = "traverse2" },
+		{ .name = "cmp" },
+		{ .name = "get_node" },
+	};
+	int i, c, num = ARRAY_SIZE(results);
+	char *baseline = NULL, *output = NULL;
+	struct bench b;
+	bool regression = false;
+	FILE *fd;
+
+	while ((c = getopt(argc, argv, "n:d:f:r:t:b:o:")) != -1) {
+		switch (c) {
+		case 'n':
+			p.systems = atoi(optarg);
+			break;
+		case 'd':
+			p.depth = atoi(optarg);
+			break;
+		case 'f':
+			p.fanout = atoi(optarg);
+			break;
+		case 'r':
+			p.repeat = atoi(optarg);
+			break;
+		case 't':
+			p.threshold = atoi(optarg);
+			break;
+		case 'b':
+			baseline = optarg;
+			break;
+		case 'o':
+			output = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc || p.systems < 1 || p.depth < 0 || p.fanout < 1 ||
+	    p.repeat < 1 || p.threshold < 0)
+		usage(argv[0]);
+
+	memset(&b, 0, sizeof(b));
+	gen_doc(&b, &p);
+	b.root = yaml_parse_file("%s", b.filename);
+	if (!b.root)
+		errx(1, "Could not parse generated document");
+	b.copy = yaml_dup(b.root, false, false);
+	yaml_traverse(&b.root, collect_cb, &b);
+	b.null = fopen("/dev/null", "w");
+	if (!b.null)
+		err(1, "Could not open /dev/null");
+
+	for (i = 0; i < num; i++) {
+		if (strcmp(results[i].name, "get_node") == 0)
+			results[i].units = b.num_paths;
+		else
+			results[i].units = b.num_nodes;
+		measure(&b, &results[i], p.repeat);
+	}
+
+	if (baseline)
+		regression = compare(baseline, &p, &b, results, num);
+	if (output) {
+		fd = fopen(output, "w");
+		if (!fd)
+			err(1, "Could not open %s", output);
+		print_results(fd, &p, &b, results, num);
+		if (fclose(fd))
+			err(1, "Could not write %s", output);
+	} else {
+		print_results(stdout, &p, &b, results, num);
+	}
+
+	fclose(b.null);
+	for (i = 0; i < b.num_paths; i++)
+		free(b.paths[i]);
+	free(b.paths);
+	yaml_free(b.copy);
+	yaml_free(b.root);
+	unlink(b.filename);
+	free(b.filename);
+
+	return regression ? 1 : 0;
+}
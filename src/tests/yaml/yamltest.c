@@ -1,6 +1,7 @@
 #include <err.h>
 #include <fnmatch.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "misc.h"
@@ -165,16 +166,137 @@ static int do_traverse(const char *filename)
 	return 0;
 }
 
+/* Check if @a and @b and their neighbors are identical including source
+ * file positions. */
+static bool same(struct yaml_node *a, struct yaml_node *b)
+{
+	for (; a && b; a = a->next, b = b->next) {
+		if (a->type != b->type || a->lineno != b->lineno ||
+		    strcmp(STR(a->filename), STR(b->filename)) != 0)
+			return false;
+
+		switch (a->type) {
+		case yaml_scalar:
+			if (strcmp(STR(a->scalar.content),
+				   STR(b->scalar.content)) != 0)
+				return false;
+			break;
+		case yaml_seq:
+			if (!same(a->seq.content, b->seq.content))
+				return false;
+			break;
+		case yaml_map:
+			if (!same(a->map.key, b->map.key) ||
+			    !same(a->map.value, b->map.value))
+				return false;
+			break;
+		}
+	}
+
+	return !a && !b;
+}
+
+static int do_binary(const char *filename, const char *binfile)
+{
+	struct yaml_node *root, *loaded, *parsed;
+	int rc = 0;
+
+	root = yaml_parse_file("%s", filename);
+	if (!yaml_write_binary(root, false, "%s", binfile))
+		err(1, "%s: Could not write file", binfile);
+	loaded = yaml_load_binary("%s", binfile);
+	parsed = yaml_parse_file("%s", binfile);
+
+	yaml_write_stream(loaded, stdout, 2, false);
+
+	if (!same(root, loaded)) {
+		warnx("yaml_load_binary() result differs");
+		rc = 1;
+	}
+	if (!same(root, parsed)) {
+		warnx("yaml_parse_file() result differs");
+		rc = 1;
+	}
+
+	yaml_free(parsed);
+	yaml_free(loaded);
+	yaml_free(root);
+
+	return rc;
+}
+
+static int do_compare(const char *filea, const char *fileb)
+{
+	struct yaml_node *a, *b;
+
+	a = yaml_parse_file("%s", filea);
+	b = yaml_parse_file("%s", fileb);
+
+	printf("cmp(a, b)=%d\n", yaml_cmp(a, b));
+	printf("cmp(b, a)=%d\n", yaml_cmp(b, a));
+	printf("is_subset(a, b)=%d\n", yaml_is_subset(a, b));
+	printf("is_subset(b, a)=%d\n", yaml_is_subset(b, a));
+
+	yaml_free(a);
+	yaml_free(b);
+
+	return 0;
+}
+
+static const char *event_names[] = {
+	[yaml_event_scalar]	= "scalar",
+	[yaml_event_seq_start]	= "seq_start",
+	[yaml_event_seq_end]	= "seq_end",
+	[yaml_event_map_start]	= "map_start",
+	[yaml_event_map_end]	= "map_end",
+};
+
+static bool events_cb(struct yaml_event *event, void *data)
+{
+	int *limit = data;
+
+	printf("%-10s %s:%d %s", event_names[event->type],
+	       STR(event->filename), event->lineno, event->path);
+	if (event->type == yaml_event_scalar)
+		printf(" = %s", STR(event->content));
+	printf("\n");
+
+	/* Stop early when the requested number of events was reached. */
+	return *limit == 0 || --(*limit) > 0;
+}
+
+static int do_events(const char *filename, int limit)
+{
+	bool rc;
+
+	rc = yaml_scan_file(events_cb, &limit, "%s", filename);
+	printf("result=%d\n", rc);
+
+	return 0;
+}
+
 int main(int argc, char *argv[])
 {
 	if (argc == 3 && strcmp(argv[1], "traverse") == 0)
 		return do_traverse(argv[2]);
 	if (argc == 4 && strcmp(argv[1], "traverse2") == 0)
 		return do_traverse2(argv[2], argv[3]);
+	if (argc == 4 && strcmp(argv[1], "binary") == 0)
+		return do_binary(argv[2], argv[3]);
+	if (argc == 4 && strcmp(argv[1], "compare") == 0)
+		return do_compare(argv[2], argv[3]);
+	if (argc == 4 && strcmp(argv[1], "events") == 0)
+		return do_events(argv[2], atoi(argv[3]));
 
 	fprintf(stderr, "Usage: %s traverse <filename>\n", argv[0]);
 	fprintf(stderr, "       %s traverse2 <filename_a> <filename_b>\n",
 		argv[0]);
+	fprintf(stderr, "       %s binary <filename> <binary_filename>\n",
+		argv[0]);
+	fprintf(stderr, "       %s compare <filename_a> <filename_b>\n",
+		argv[0]);
+	fprintf(stderr, "       %s events <filename> <max_events>\n",
+		argv[0]);
 
 	return 1;
 }
@@ -1,8 +1,11 @@
 function check_output() {
 	local filename="$1" expected="$2" filtered="$TELA_TMP/filtered"
 
-	# Filter out irrelevant portions of TAP output
-	grep '^  ' "$filename" | grep -v "^\s\+\(CC\|testresult\|testexec\|starttime\|stoptime\|duration_ms\|source\)" >$filtered
+	# Filter out irrelevant portions of TAP output, including the
+	# framework phases mapping and its children
+	grep '^  ' "$filename" |
+		awk '/^  phases:$/ { p = 1; next } p && /^    / { next } { p = 0; print }' |
+		grep -v "^\s\+\(CC\|testresult\|testexec\|starttime\|stoptime\|duration_ms\|source\)" >$filtered
 
 	echo "Expected output:"
 	cat "$expected"
@@ -0,0 +1,109 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Functions for writing trace events in Chrome trace-event format.
+ *
+ * Copyright IBM Corp. 2023
+ *
+ * If environment variable TELA_TRACE is set, begin and end events are
+ * appended to the trace file named by its value. The file is shared by all
+ * tela components, including Bash scripts, so each event is written as one
+ * line with a single write() to a file descriptor in append mode.
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "misc.h"
+#include "trace.h"
+
+static int trace_fd = -1;
+static bool trace_done;
+static long long trace_base_us;
+
+/* Open trace file if requested. Return %true if events should be written. */
+static bool trace_open(void)
+{
+	char *v;
+
+	if (trace_done)
+		return trace_fd != -1;
+	trace_done = true;
+
+	v = getenv("TELA_TRACE");
+	if (!v || !*v)
+		return false;
+
+	trace_fd = open(v, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0666);
+	if (trace_fd == -1) {
+		warn("Could not open trace file %s", v);
+		return false;
+	}
+
+	/* Use same time base as debug output to align events of all
+	 * components. */
+	v = getenv("_TELA_STARTTIME");
+	if (v)
+		trace_base_us = atoll(v) * 1000;
+
+	return true;
+}
+
+static void trace_event(char phase, const char *name, const char *test)
+{
+	char *line, *ename, *etest = NULL;
+	struct timespec ts;
+	long long us;
+	pid_t pid;
+
+	if (!trace_open())
+		return;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	us = ts.tv_sec * 1000000LL + ts.tv_nsec / 1000 - trace_base_us;
+	pid = getpid();
+
+	ename = misc_escape(name, "\"");
+	if (test)
+		etest = misc_escape(test, "\"");
+	line = misc_asprintf("{\"name\":\"%s\",\"cat\":\"tela\",\"ph\":\"%c\","
+			     "\"ts\":%lld,\"pid\":%d,\"tid\":%d%s%s%s},\n",
+			     ename, phase, us, pid, pid,
+			     etest ? ",\"args\":{\"test\":\"" : "",
+			     etest ? etest : "", etest ? "\"}" : "");
+
+	if (write(trace_fd, line, strlen(line)) == -1)
+		debug("Could not write trace event: %s", strerror(errno));
+
+	free(line);
+	free(etest);
+	free(ename);
+}
+
+/**
+ * trace_begin - Write trace event for the begin of a phase
+ * @name: Phase name
+ * @test: Testcase name or %NULL if not specific to a testcase
+ */
+void trace_begin(const char *name, const char *test)
+{
+	trace_event('B', name, test);
+}
+
+/**
+ * trace_end - Write trace event for the end of a phase
+ * @name: Phase name
+ * @test: Testcase name or %NULL if not specific to a testcase
+ *
+ * Calls to trace_begin() and trace_end() must be properly nested within
+ * a process.
+ */
+void trace_end(const char *name, const char *test)
+{
+	trace_event('E', name, test);
+}
@@ -0,0 +1,14 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Functions for writing trace events in Chrome trace-event format.
+ *
+ * Copyright IBM Corp. 2023
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+void trace_begin(const char *name, const char *test);
+void trace_end(const char *name, const char *test);
+
+#endif /* TRACE_H */
@@ -13,44 +13,338 @@
 
 #include <ctype.h>
 #include <err.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "misc.h"
 #include "yaml.h"
 
 #define SUB_INDENT	1
 
+/* Minimum number of sibling nodes for which a lookup index is built. */
+#define INDEX_MIN	8
+
+/**
+ * struct yaml_index - Lookup index for the mapping keys in a list of siblings
+ * @generation: Generation of the document when the index was built
+ * @keys: Hash table mapping keys to the first mapping node with that key
+ *
+ * An index is attached to the first node of a sibling list.
+ */
+struct yaml_index {
+	unsigned long generation;
+	struct misc_htab keys;
+};
+
+/**
+ * struct yaml_hash - Structural hashes of a node
+ * @node_gen: Generation of the document when @node was computed
+ * @list_gen: Generation of the document when @list was computed
+ * @node: Hash of node type, scalar content and child nodes
+ * @list: Hash of the sibling list starting at this node
+ * @node_dups: Flag indicating that a list below this node contains siblings
+ *             with the same path component
+ * @list_dups: Same as @node_dups for the sibling list starting at this node
+ *
+ * Hashes are computed on demand and cached until the next modification of
+ * the document.
+ */
+struct yaml_hash {
+	unsigned long node_gen;
+	unsigned long list_gen;
+	uint64_t node;
+	uint64_t list;
+	bool node_dups;
+	bool list_dups;
+};
+
+/**
+ * struct yaml_doc - Modification state of a YAML document
+ * @generation: Generation number, changed by each modification
+ * @refs: Number of arenas and documents referencing this document
+ * @merged: Document into which this document was linked, or %NULL
+ *
+ * Lookup indices and hashes record the generation of their document and are
+ * stale when it differs. Each arena starts out as its own document. When
+ * nodes of one document are linked into another, the documents are merged
+ * so that a modification of either part invalidates indices and hashes of
+ * both.
+ */
+struct yaml_doc {
+	unsigned long generation;
+	unsigned long refs;
+	struct yaml_doc *merged;
+};
+
+/* Source of generation numbers. Generation numbers are unique so that data
+ * recorded for one document never matches the generation of another. */
+static unsigned long last_generation;
+
+/* Arena block sizes and allocation alignment. */
+#define ARENA_BLOCK_MIN		512
+#define ARENA_BLOCK_PARSE	4096
+#define ARENA_BLOCK_MAX		(64 * 1024)
+#define ARENA_ALIGN		sizeof(void *)
+
+/**
+ * struct arena_block - Block of memory in an arena
+ * @next: Next block
+ * @size: Size of @data
+ * @used: Number of bytes in @data that are in use
+ * @data: Block data
+ */
+struct arena_block {
+	struct arena_block *next;
+	size_t size;
+	size_t used;
+	char data[];
+};
+
+/**
+ * struct arena_name - Interned filename
+ * @next: Next filename
+ * @name: Filename
+ */
+struct arena_name {
+	struct arena_name *next;
+	char name[];
+};
+
+/**
+ * struct arena_pin - Reference to an arena whose strings are shared
+ * @next: Next pin
+ * @arena: Pinned arena
+ */
+struct arena_pin {
+	struct arena_pin *next;
+	struct yaml_arena *arena;
+};
+
+/**
+ * struct yaml_arena - Memory region owning YAML nodes
+ * @blocks: Memory blocks, most recently allocated block first
+ * @block_size: Size of the next block to allocate
+ * @live: Number of nodes allocated from this arena that were not yet freed
+ * @names: Filenames interned in this arena
+ * @buf: Parser input buffer referenced by scalar nodes, or %NULL
+ * @map_len: Length of mapping if @buf was mapped using mmap(), 0 otherwise
+ * @pins: Arenas whose strings are referenced by nodes in this arena
+ * @pinned: Number of arenas that reference strings in this arena
+ * @doc: Modification state of the document containing nodes of this arena
+ *
+ * Nodes, scalar strings and filenames of a YAML document are allocated from
+ * an arena. The arena releases all of its memory at once when the last node
+ * allocated from it is freed and no other arena references its strings.
+ * Nodes of different arenas may be linked.
+ */
+struct yaml_arena {
+	struct arena_block *blocks;
+	size_t block_size;
+	size_t live;
+	struct arena_name *names;
+	char *buf;
+	size_t map_len;
+	struct arena_pin *pins;
+	size_t pinned;
+	struct yaml_doc *doc;
+};
+
+static void doc_put(struct yaml_doc *doc)
+{
+	struct yaml_doc *next;
+
+	for (; doc && --doc->refs == 0; doc = next) {
+		next = doc->merged;
+		free(doc);
+	}
+}
+
+/* Return the modification state of the document containing @node. */
+static struct yaml_doc *get_doc(struct yaml_node *node)
+{
+	struct yaml_arena *arena = node->arena;
+	struct yaml_doc *doc = arena->doc;
+
+	if (!doc->merged)
+		return doc;
+
+	while (doc->merged)
+		doc = doc->merged;
+	doc->refs++;
+	doc_put(arena->doc);
+	arena->doc = doc;
+
+	return doc;
+}
+
+/* Return the current generation of the document containing @node. */
+static unsigned long get_generation(struct yaml_node *node)
+{
+	return get_doc(node)->generation;
+}
+
+/* Mark the document containing @node as modified. */
+static void touch(struct yaml_node *node)
+{
+	if (node)
+		get_doc(node)->generation = ++last_generation;
+}
+
+/* Merge the documents containing @a and @b after linking their nodes. */
+static void merge_docs(struct yaml_node *a, struct yaml_node *b)
+{
+	struct yaml_doc *doc_a, *doc_b;
+
+	if (!a || !b)
+		return;
+	doc_a = get_doc(a);
+	doc_b = get_doc(b);
+	if (doc_a != doc_b) {
+		doc_b->merged = doc_a;
+		doc_a->refs++;
+	}
+	doc_a->generation = ++last_generation;
+}
+
+static struct yaml_arena *arena_new(size_t block_size)
+{
+	struct yaml_arena *arena = misc_malloc(sizeof(*arena));
+
+	arena->block_size = block_size;
+	arena->doc = misc_malloc(sizeof(*arena->doc));
+	arena->doc->generation = ++last_generation;
+	arena->doc->refs = 1;
+
+	return arena;
+}
+
+/* Release input buffer @buf that was allocated or mapped by read_file(). */
+static void release_buf(char *buf, size_t map_len)
+{
+	if (map_len)
+		munmap(buf, map_len);
+	else
+		free(buf);
+}
+
+static void arena_release(struct yaml_arena *arena)
+{
+	struct arena_block *block, *next;
+	struct arena_pin *pin;
+
+	/* Pins are allocated from this arena. */
+	for (pin = arena->pins; pin; pin = pin->next) {
+		if (--pin->arena->pinned == 0 && pin->arena->live == 0)
+			arena_release(pin->arena);
+	}
+
+	for (block = arena->blocks; block; block = next) {
+		next = block->next;
+		free(block);
+	}
+	release_buf(arena->buf, arena->map_len);
+	doc_put(arena->doc);
+	free(arena);
+}
+
+/* Return pointer to @size bytes of zeroed memory allocated from @arena. */
+static void *arena_alloc(struct yaml_arena *arena, size_t size)
+{
+	struct arena_block *block = arena->blocks;
+	size_t bsize;
+	void *ptr;
+
+	size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+	if (!block || block->used + size > block->size) {
+		bsize = arena->block_size;
+		if (bsize < size)
+			bsize = size;
+		block = misc_malloc(sizeof(*block) + bsize);
+		block->size = bsize;
+		block->next = arena->blocks;
+		arena->blocks = block;
+		if (arena->block_size < ARENA_BLOCK_MAX)
+			arena->block_size *= 2;
+	}
+	ptr = block->data + block->used;
+	block->used += size;
+
+	return ptr;
+}
+
+static char *arena_strdup(struct yaml_arena *arena, const char *str)
+{
+	size_t len = strlen(str) + 1;
+
+	return memcpy(arena_alloc(arena, len), str, len);
+}
+
+/* Return a copy of filename @name that is shared by all nodes in @arena. */
+static char *arena_intern(struct yaml_arena *arena, const char *name)
+{
+	struct arena_name *n;
+	size_t len;
+
+	for (n = arena->names; n; n = n->next) {
+		if (n->name == name || strcmp(n->name, name) == 0)
+			return n->name;
+	}
+
+	len = strlen(name) + 1;
+	n = arena_alloc(arena, sizeof(*n) + len);
+	memcpy(n->name, name, len);
+	n->next = arena->names;
+	arena->names = n;
+
+	return n->name;
+}
+
+/**
+ * struct filepos - Parser state
+ * @arena: Arena for nodes of parsed document, also owns the input buffer
+ * @filename: Name of input file
+ * @cur: Start of next line in input buffer
+ * @end: End of input buffer, points to a terminating zero
+ * @lineno: Current line number
+ * @error: Flag indicating a parsing error
+ * @eof: Flag indicating that the document end marker was found
+ * @line: Line that was put back for re-reading or %NULL
+ *
+ * Lines are terminated in place in the input buffer. Nodes reference strings
+ * in the buffer directly.
+ */
 struct filepos {
+	struct yaml_arena *arena;
 	const char *filename;
-	FILE *fd;
+	char *cur;
+	char *end;
 	int lineno;
 	bool error;
 	bool eof;
 	char *line;
 };
 
-static struct yaml_node *new_node(enum yaml_type type, struct filepos *pos)
+static struct yaml_node *new_node(struct yaml_arena *arena,
+				  enum yaml_type type, const char *filename,
+				  int lineno)
 {
 	struct yaml_node *node;
 
-	node = misc_malloc(sizeof(*node));
+	node = arena_alloc(arena, sizeof(*node));
+	node->arena = arena;
+	arena->live++;
 	node->type = type;
-	if (pos) {
-		node->filename = misc_strdup(pos->filename);
-		node->lineno = pos->lineno;
-	}
-
-	return node;
-}
-
-static struct yaml_node *new_scalar(const char *str, struct filepos *pos)
-{
-	struct yaml_node *node = new_node(yaml_scalar, pos);
-
-	node->scalar.content = misc_strdup(str);
+	if (filename)
+		node->filename = arena_intern(arena, filename);
+	node->lineno = lineno;
 
 	return node;
 }
@@ -73,53 +367,45 @@ static void set_child(struct yaml_node *parent, struct yaml_node *node)
 		parent->seq.content = node;
 }
 
-static void append_scalar(struct yaml_node *node, char *new_s)
+/* Return pointer to the closing @quote character in quoted string @str, or
+ * to the terminating zero if there is none. */
+static char *skip_quoted(char *str, char quote)
 {
-	char *old_s = node->scalar.content;
-
-	node->scalar.content = misc_asprintf("%s %s", old_s, new_s);
-	free(old_s);
+	const char stop[] = { '\\', quote, 0 };
+
+	for (;;) {
+		str += strcspn(str, stop);
+		if (*str != '\\')
+			return str;
+		/* Limit: Single char escape characters only and no check for
+		 * valid escape characters. In single quotes, only a double
+		 * backslash is treated as escape sequence. */
+		if (quote == '"' && str[1])
+			str += 2;
+		else if (quote == '\'' && str[1] == '\\')
+			str += 2;
+		else
+			str++;
+	}
 }
 
 /* Find @c in the unquoted portion of @str. Return a pointer to the first
  * occurrence of @c in @str, or %NULL if @c was not found. */
 static char *strchr_unquoted(char *str, char c)
 {
-	char quote = 0, escape = 0;
-	int i;
-
-	for (i = 0; str[i]; i++) {
-		switch (quote) {
-		case 0:
-			if (str[i] == c)
-				return &str[i];
-			if (str[i] == '"' || str[i] == '\'')
-				quote = str[i];
-			break;
-		case '"':
-			if (escape == 0 && str[i] == '\\') {
-				escape = 1;
-			} else if (escape == 1) {
-				/* Limit: Single char escape characters only and
-				 * no check for valid escape characters. */
-				escape = 0;
-			} else if (str[i] == '"') {
-				quote = 0;
-			}
-			break;
-		case '\'':
-			if (escape == 0 && str[i] == '\\' &&
-			    str[i + 1 ] == '\\')
-				escape = 1;
-			else if (escape == 1)
-				escape = 0;
-			else if (str[i] == '\'')
-				quote = 0;
-			break;
-		}
+	const char stop[] = { c, '"', '\'', 0 };
+
+	for (;;) {
+		str += strcspn(str, stop);
+		if (*str == c)
+			return str;
+		if (!*str)
+			return NULL;
+		str = skip_quoted(str + 1, *str);
+		if (!*str)
+			return NULL;
+		str++;
 	}
-
-	return NULL;
 }
 
 /* Find a map key delimiter in @str. Return pointer to delimiter on success,
@@ -134,46 +420,49 @@ static char *find_map(char *str)
 	return str;
 }
 
-struct misc_map single_quote_map[] = {
-	{ "''", "'" },
-	{ NULL, NULL },
-};
+/*
+ * Remove quotes from @str in place. Resolve '' in single-quoted strings and
+ * \", \n and \\ in double-quoted strings. Return %false if no closing
+ * quote was found.
+ */
+static bool unquote(char *str)
+{
+	char quote = str[0], *r, *w;
+	size_t len;
 
-struct misc_map double_quote_map[] = {
-	{ "\\\"", "\"" },
-	{ "\\n", "\n" },
-	{ "\\\\", "\\" },
-	{ NULL, NULL },
-};
+	if (quote != '\'' && quote != '"')
+		return true;
 
-static void unquote_string(struct filepos *pos, char *str)
-{
-	if (!misc_unquote(str, single_quote_map, double_quote_map)) {
-		warnx("%s:%d: Missing closing quote", pos->filename,
-		      pos->lineno);
+	len = strlen(str);
+	if (len < 2 || str[len - 1] != quote) {
+		/* Remove leading quote only. */
+		memmove(str, str + 1, len);
+		return false;
 	}
-}
+	str[len - 1] = 0;
+
+	for (r = str + 1, w = str; *r; ) {
+		if (quote == '\'' && r[0] == '\'' && r[1] == '\'') {
+			*w++ = '\'';
+			r += 2;
+		} else if (quote == '"' && r[0] == '\\' &&
+			   (r[1] == '"' || r[1] == 'n' || r[1] == '\\')) {
+			*w++ = (r[1] == 'n') ? '\n' : r[1];
+			r += 2;
+		} else
+			*w++ = *r++;
+	}
+	*w = 0;
 
-static struct yaml_node *_parse(struct filepos *pos, int indent);
+	return true;
+}
 
-static struct yaml_node *_parse_implicit(struct filepos *pos, int indent,
-					 char *s)
+static void unquote_string(struct filepos *pos, char *str)
 {
-	struct yaml_node *node = NULL;
-
-	while (isspace(*s))
-		s++;
-	misc_strip_space(s);
-
-	if (*s == 0)
-		node = _parse(pos, indent + SUB_INDENT);
-	else {
-		unquote_string(pos, s);
-		if (!pos->error)
-			node = new_scalar(s, pos);
+	if (!unquote(str)) {
+		warnx("%s:%d: Missing closing quote", pos->filename,
+		      pos->lineno);
 	}
-
-	return node;
 }
 
 static const char *type_str(enum yaml_type type)
@@ -189,28 +478,34 @@ static const char *type_str(enum yaml_type type)
 	return "<unknown>";
 }
 
-static bool pos_getline(struct filepos *pos, char **line, size_t *n)
+/* Return the next line from the input buffer with the trailing newline
+ * removed, or %NULL at the end of input. */
+static char *pos_getline(struct filepos *pos)
 {
-	size_t len;
+	char *line, *nl;
 
 	if (pos->error || pos->eof)
-		return false;
+		return NULL;
 
 	/* Use buffered line if available. */
 	if (pos->line) {
-		len = strlen(pos->line) + 1;
-		if (*n  < len) {
-			free(*line);
-			*line = misc_malloc(len);
-			*n = len;
-		}
-		strcpy(*line, pos->line);
-		free(pos->line);
+		line = pos->line;
 		pos->line = NULL;
-		return true;
+		return line;
 	}
 
-	return getline(line, n, pos->fd) != -1;
+	if (pos->cur >= pos->end)
+		return NULL;
+
+	line = pos->cur;
+	nl = memchr(line, '\n', pos->end - line);
+	if (nl) {
+		*nl = 0;
+		pos->cur = nl + 1;
+	} else
+		pos->cur = pos->end;
+
+	return line;
 }
 
 static void pos_ungetline(struct filepos *pos, char *line)
@@ -218,28 +513,207 @@ static void pos_ungetline(struct filepos *pos, char *line)
 	if (pos->line) {
 		/* Should not happen. */
 		warnx("Internal error: multiple buffered lines");
-		free(pos->line);
 	}
 
-	pos->line = misc_strdup(line);
+	pos->line = line;
 }
 
-static struct yaml_node *_parse(struct filepos *pos, int indent)
+/**
+ * struct path_buf - Buffer for the textual path of the current node
+ * @str: Path string
+ * @len: Length of @str
+ * @size: Size of the allocated buffer
+ *
+ * A single buffer is shared by all levels of a traversal. Each level appends
+ * the path component of its current node to the path of its parent.
+ */
+struct path_buf {
+	char *str;
+	size_t len;
+	size_t size;
+};
+
+/* Make room for @len more characters plus terminating zero in @pb. */
+static void path_reserve(struct path_buf *pb, size_t len)
 {
-	size_t n;
-	char *line = NULL, *s;
-	struct yaml_node *root = NULL, *node, *prev = NULL;
-	int i;
+	if (pb->len + len + 1 <= pb->size)
+		return;
+	while (pb->size < pb->len + len + 1)
+		pb->size = pb->size ? pb->size * 2 : 256;
+	pb->str = misc_realloc(pb->str, pb->size);
+}
+
+/*
+ * Set @pb to the textual path of a YAML node of type @type with path
+ * component @name below the parent path consisting of the first @parent_len
+ * characters of @pb.
+ */
+static void path_set_name(struct path_buf *pb, size_t parent_len,
+			  enum yaml_type type, const char *name)
+{
+	size_t len = strlen(name);
+	char *s;
+
+	pb->len = parent_len;
+	path_reserve(pb, len + 1);
+	if (type == yaml_scalar || parent_len > 0)
+		pb->str[pb->len++] = '/';
+	if (type != yaml_scalar) {
+		/* Replace '/' in name to prevent fnmatch() confusion. */
+		s = pb->str + pb->len;
+		memcpy(s, name, len);
+		pb->len += len;
+		for (; len > 0; s++, len--) {
+			if (*s == '/')
+				*s = YAML_PATH_SLASH;
+		}
+	}
+	pb->str[pb->len] = 0;
+}
+
+/**
+ * struct scanner - State of the event-based YAML reader
+ * @pos: Parser position or %NULL when reading from a node tree
+ * @filename: Filename to report in events
+ * @pb: Path of the current node
+ * @cb: Event callback
+ * @data: Extra data for @cb
+ * @stop: Flag indicating that @cb requested to stop reading
+ * @pending: Flag indicating that a sequence start event is pending
+ * @pending_base: Parent path length of the pending sequence
+ * @pending_lineno: Line number of the pending sequence
+ * @cont: Buffer for scalars spanning multiple lines
+ * @cont_size: Size of @cont
+ *
+ * The path component of a sequence is its first scalar content, which may be
+ * spread over multiple lines. The sequence start event is therefore delayed
+ * until the first content event is known.
+ */
+struct scanner {
+	struct filepos *pos;
+	const char *filename;
+	struct path_buf pb;
+	yaml_event_cb_t cb;
+	void *data;
+	bool stop;
+	bool pending;
+	size_t pending_base;
+	int pending_lineno;
+	char *cont;
+	size_t cont_size;
+};
+
+static void event(struct scanner *sc, enum yaml_event_type type,
+		  const char *content, int lineno)
+{
+	struct yaml_event ev;
+
+	if (sc->stop)
+		return;
+
+	ev.type = type;
+	ev.path = sc->pb.str;
+	ev.content = content;
+	ev.filename = sc->filename;
+	ev.lineno = lineno;
+	if (!sc->cb(&ev, sc->data)) {
+		/* Stop reading input. */
+		sc->stop = true;
+		if (sc->pos)
+			sc->pos->eof = true;
+	}
+}
+
+/* Emit a pending sequence start event using path component @name. Store the
+ * path length of the sequence in @base. */
+static void resolve_pending(struct scanner *sc, const char *name, size_t *base)
+{
+	if (!sc->pending)
+		return;
+	sc->pending = false;
+	path_set_name(&sc->pb, sc->pending_base, yaml_seq, name);
+	*base = sc->pb.len;
+	event(sc, yaml_event_seq_start, NULL, sc->pending_lineno);
+}
+
+static void emit_scalar(struct scanner *sc, size_t *base, const char *content,
+			int lineno)
+{
+	resolve_pending(sc, content, base);
+	path_set_name(&sc->pb, *base, yaml_scalar, "");
+	event(sc, yaml_event_scalar, content, lineno);
+}
+
+/* Emit end event for node with path length @len. */
+static void emit_end(struct scanner *sc, enum yaml_event_type type,
+		     size_t len, int lineno)
+{
+	sc->pb.len = len;
+	sc->pb.str[len] = 0;
+	event(sc, type, NULL, lineno);
+}
+
+/* Append @str to multi-line scalar @scalar. Return resulting scalar. */
+static char *append_scalar(struct scanner *sc, char *scalar, const char *str)
+{
+	size_t old_len = strlen(scalar), len = strlen(str);
+
+	if (old_len + len + 2 > sc->cont_size) {
+		sc->cont_size = old_len + len + 2;
+		if (scalar == sc->cont) {
+			sc->cont = misc_realloc(sc->cont, sc->cont_size);
+			scalar = sc->cont;
+		} else {
+			free(sc->cont);
+			sc->cont = misc_malloc(sc->cont_size);
+		}
+	}
+	if (scalar != sc->cont)
+		memcpy(sc->cont, scalar, old_len);
+	sc->cont[old_len] = ' ';
+	memcpy(sc->cont + old_len + 1, str, len + 1);
+
+	return sc->cont;
+}
+
+static void scan(struct scanner *sc, size_t *base, int indent);
+
+static void scan_implicit(struct scanner *sc, size_t *base, int indent,
+			  char *s)
+{
+	while (isspace(*s))
+		s++;
+	misc_strip_space(s);
+
+	if (*s == 0)
+		scan(sc, base, indent + SUB_INDENT);
+	else {
+		unquote_string(sc->pos, s);
+		if (!sc->pos->error)
+			emit_scalar(sc, base, s, sc->pos->lineno);
+	}
+}
 
-	while (pos_getline(pos, &line, &n)) {
+/*
+ * Read the list of nodes with indentation @indent or more and emit events
+ * for them. The path length of the parent node is stored in @base. If the
+ * parent is a pending sequence, @base is set when the first event is
+ * emitted.
+ */
+static void scan(struct scanner *sc, size_t *base, int indent)
+{
+	struct filepos *pos = sc->pos;
+	char *line, *s, *scalar = NULL;
+	int i, lineno, scalar_lineno = 0;
+	enum yaml_type prev = yaml_scalar;
+	bool have_prev = false;
+	size_t child_base;
+
+	while ((line = pos_getline(pos))) {
 		pos->lineno++;
 
 		debug2("%s:%d: %s", pos->filename, pos->lineno, line);
 
-		/* Remove trailing newlines. */
-		while ((s = strrchr(line, '\n')))
-			*s = 0;
-
 		/* Remove comment portions. */
 		s = strchr_unquoted(line, '#');
 		if (s)
@@ -272,60 +746,71 @@ static struct yaml_node *_parse(struct filepos *pos, int indent)
 		}
 
 		/* Check for tab indentation outside of multi-line scalar. */
-		if (line[i] == '\t' && prev && prev->type != yaml_scalar) {
+		if (line[i] == '\t' && have_prev && prev != yaml_scalar) {
 			twarn(pos->filename, pos->lineno,
 			      "Found unsupported tab indentation");
 			pos->error = true;
 			break;
 		}
 
+		lineno = pos->lineno;
+
 		/* Sequence. */
 		if (line[i] == '-' && isspace(line[i + 1])) {
-			if (prev && prev->type != yaml_seq) {
+			if (have_prev && prev != yaml_seq) {
 				warnx("%s:%d: Found unexpected sequence "
 				      "indicator '-' - expected %s",
 				      pos->filename, pos->lineno,
-				      type_str(prev->type));
+				      type_str(prev));
 				pos->error = true;
 				break;
 			}
+			resolve_pending(sc, "", base);
+			sc->pending = true;
+			sc->pending_base = *base;
+			sc->pending_lineno = lineno;
 			/* Extract content. */
-			node = new_node(yaml_seq, pos);
-			node->seq.content = _parse_implicit(pos, i,
-							    line + i +
-							    /* "- " */ 2);
+			scan_implicit(sc, &child_base, i, line + i +
+				      /* "- " */ 2);
 			if (pos->error)
 				break;
+			resolve_pending(sc, "", &child_base);
+			emit_end(sc, yaml_event_seq_end, child_base, lineno);
+			prev = yaml_seq;
 			goto next;
 		}
 
 		/* Mapping. */
 		s = find_map(line + i);
 		if (s) {
-			if (prev && prev->type != yaml_map) {
+			if (have_prev && prev != yaml_map) {
 				warnx("%s:%d: Found unexpected mapping "
 				      "indicator ':' - expected %s",
 				      pos->filename, pos->lineno,
-				      type_str(prev->type));
+				      type_str(prev));
 				pos->error = true;
 				break;
 			}
 			/* Extract key. */
 			*s = 0;
 			misc_strip_space(line + i);
-			node = new_node(yaml_map, pos);
-			node->map.key = new_scalar(line + i, pos);
+			resolve_pending(sc, "", base);
+			path_set_name(&sc->pb, *base, yaml_map, line + i);
+			child_base = sc->pb.len;
+			event(sc, yaml_event_map_start, line + i, lineno);
 			/* Extract value. */
-			node->map.value = _parse_implicit(pos, i, s + 1);
+			scan_implicit(sc, &child_base, i, s + 1);
 			if (pos->error)
 				break;
+			emit_end(sc, yaml_event_map_end, child_base, lineno);
+			prev = yaml_map;
 			goto next;
 		}
 
 		/* Scalar. */
-		if (prev && prev->type != yaml_scalar) {
+		if (have_prev && prev != yaml_scalar) {
 			warnx("%s:%d: Found unexpected scalar - expected %s",
-			      pos->filename, pos->lineno, type_str(prev->type));
+			      pos->filename, pos->lineno, type_str(prev));
 			pos->error = true;
 			break;
 		}
@@ -335,79 +820,308 @@ static struct yaml_node *_parse(struct filepos *pos, int indent)
 		if (pos->error)
 			break;
 
-		if (prev)
-			append_scalar(prev, line + i);
-		else
-			node = new_scalar(line + i, pos);
-
+		/* Subsequent scalar lines form a single multi-line scalar. */
+		if (scalar)
+			scalar = append_scalar(sc, scalar, line + i);
+		else {
+			scalar = line + i;
+			scalar_lineno = lineno;
+		}
+		prev = yaml_scalar;
 next:
-		if (!root)
-			root = node;
-		else if (prev)
-			prev->next = node;
-		prev = node;
-		node = NULL;
+		have_prev = true;
 	}
-	free(line);
 
-	return root;
+	if (scalar && !pos->error)
+		emit_scalar(sc, base, scalar, scalar_lineno);
 }
 
-/**
- * yaml_parse_stream - Read YAML from I/O stream
- * @fd: I/O stream
- * @name: Stream name
- *
- * Read YAML from stream specified by @fd and return a newly allocated struct
- * yaml_node representing the parsed YAML content or %NULL if the file could
- * not be read or parsed.
- */
-struct yaml_node *yaml_parse_stream(FILE *fd, const char *name)
+/* Read YAML content from @pos and call @cb for each event. Return %false on
+ * parse errors, %true otherwise. */
+static bool scan_pos(struct filepos *pos, yaml_event_cb_t cb, void *data)
 {
-	struct yaml_node *result;
-	struct filepos pos;
+	struct scanner sc;
+	size_t base = 0;
 
-	memset(&pos, 0, sizeof(pos));
-	pos.filename = name;
-	pos.fd = fd;
+	memset(&sc, 0, sizeof(sc));
+	sc.pos = pos;
+	sc.filename = pos->filename;
+	sc.cb = cb;
+	sc.data = data;
+	path_reserve(&sc.pb, 0);
+	sc.pb.str[0] = 0;
 
-	result = _parse(&pos, 0);
-	if (pos.error) {
-		yaml_free(result);
-		result = NULL;
-	}
+	scan(&sc, &base, 0);
 
-	return result;
+	free(sc.cont);
+	free(sc.pb.str);
+
+	return !pos->error;
 }
 
 /**
- * yaml_parse_file - Read YAML file
- * @fmt: Filename format string
- *
- * Read YAML file specified by @fmt and return a newly allocated struct
- * yaml_node representing the parsed YAML content or %NULL if the file could
- * not be read or parsed.
+ * struct builder_level - Node list under construction
+ * @parent: Parent node or %NULL for the top-level list
+ * @last: Last node in list or %NULL
  */
-struct yaml_node *yaml_parse_file(const char *fmt, ...)
-{
-	struct yaml_node *result = NULL;
-	FILE *fd;
+struct builder_level {
+	struct yaml_node *parent;
+	struct yaml_node *last;
+};
 
-	get_varargs(fmt, filename);
+/**
+ * struct builder - State for building a node tree from parser events
+ * @pos: Parser position
+ * @root: First node of the resulting document
+ * @levels: Stack of lists under construction
+ * @depth: Index of current list in @levels
+ * @num: Number of entries allocated in @levels
+ */
+struct builder {
+	struct filepos *pos;
+	struct yaml_node *root;
+	struct builder_level *levels;
+	int depth;
+	int num;
+};
 
-	fd = fopen(filename, "r");
-	if (fd) {
-		result = yaml_parse_stream(fd, filename);
-		fclose(fd);
-	}
+/* Return @str if it points into the input buffer, or an arena copy of @str
+ * otherwise. */
+static char *builder_str(struct builder *b, const char *str)
+{
+	struct yaml_arena *arena = b->pos->arena;
 
-	free(filename);
+	if (str >= arena->buf && str < b->pos->end)
+		return (char *) str;
 
-	return result;
+	return arena_strdup(arena, str);
 }
 
-/**
- * yaml_parse_string - Parse string into YAML representation
+static struct yaml_node *builder_add(struct builder *b, enum yaml_type type,
+				     int lineno)
+{
+	struct builder_level *l = &b->levels[b->depth];
+	struct yaml_node *node;
+
+	node = new_node(b->pos->arena, type, NULL, lineno);
+	node->filename = (char *) b->pos->filename;
+	if (l->last)
+		l->last->next = node;
+	else if (l->parent)
+		set_child(l->parent, node);
+	else
+		b->root = node;
+	l->last = node;
+
+	return node;
+}
+
+static void builder_push(struct builder *b, struct yaml_node *parent)
+{
+	if (++b->depth == b->num) {
+		b->num *= 2;
+		b->levels = misc_realloc(b->levels,
+					 b->num * sizeof(*b->levels));
+	}
+	b->levels[b->depth].parent = parent;
+	b->levels[b->depth].last = NULL;
+}
+
+static bool builder_cb(struct yaml_event *event, void *data)
+{
+	struct builder *b = data;
+	struct yaml_node *node;
+
+	switch (event->type) {
+	case yaml_event_scalar:
+		node = builder_add(b, yaml_scalar, event->lineno);
+		node->scalar.content = builder_str(b, event->content);
+		break;
+	case yaml_event_seq_start:
+		node = builder_add(b, yaml_seq, event->lineno);
+		builder_push(b, node);
+		break;
+	case yaml_event_map_start:
+		node = builder_add(b, yaml_map, event->lineno);
+		node->map.key = new_node(b->pos->arena, yaml_scalar, NULL,
+					 event->lineno);
+		node->map.key->filename = node->filename;
+		node->map.key->scalar.content = builder_str(b, event->content);
+		builder_push(b, node);
+		break;
+	case yaml_event_seq_end:
+	case yaml_event_map_end:
+		b->depth--;
+		break;
+	}
+
+	return true;
+}
+
+/*
+ * Parse YAML content in buffer @buf of length @len. @buf must be writable and
+ * zero-terminated at @len. The resulting document takes ownership of @buf,
+ * which is released using munmap() if @map_len is non-zero, or free()
+ * otherwise.
+ */
+static struct yaml_node *parse_buf(const char *name, char *buf, size_t len,
+				   size_t map_len)
+{
+	struct yaml_node *result;
+	struct filepos pos;
+	struct builder b;
+
+	memset(&pos, 0, sizeof(pos));
+	pos.arena = arena_new(ARENA_BLOCK_PARSE);
+	pos.arena->buf = buf;
+	pos.arena->map_len = map_len;
+	pos.filename = arena_intern(pos.arena, name);
+	pos.cur = buf;
+	pos.end = buf + len;
+
+	memset(&b, 0, sizeof(b));
+	b.pos = &pos;
+	b.num = 16;
+	b.levels = misc_malloc(b.num * sizeof(*b.levels));
+
+	scan_pos(&pos, builder_cb, &b);
+	free(b.levels);
+
+	result = b.root;
+	if (pos.error || !result) {
+		arena_release(pos.arena);
+		result = NULL;
+	}
+
+	return result;
+}
+
+/* Read all data from file descriptor @fd into a newly allocated,
+ * zero-terminated buffer. Store the data length in @len_ptr. */
+static char *read_fd(int fd, size_t *len_ptr)
+{
+	size_t size = 4096, len = 0;
+	ssize_t r;
+	char *buf;
+
+	buf = misc_malloc(size);
+	while ((r = read(fd, buf + len, size - len - 1)) != 0) {
+		if (r < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		len += r;
+		if (len + 1 == size) {
+			size *= 2;
+			buf = misc_realloc(buf, size);
+		}
+	}
+	buf[len] = 0;
+	*len_ptr = len;
+
+	return buf;
+}
+
+/**
+ * yaml_parse_stream - Read YAML from I/O stream
+ * @fd: I/O stream
+ * @name: Stream name
+ *
+ * Read YAML from stream specified by @fd and return a newly allocated struct
+ * yaml_node representing the parsed YAML content or %NULL if the file could
+ * not be read or parsed. All data available in @fd is consumed.
+ */
+struct yaml_node *yaml_parse_stream(FILE *fd, const char *name)
+{
+	size_t size = 4096, len = 0;
+	char *buf;
+
+	buf = misc_malloc(size);
+	while ((len += fread(buf + len, 1, size - len - 1, fd)) + 1 == size) {
+		size *= 2;
+		buf = misc_realloc(buf, size);
+	}
+	buf[len] = 0;
+
+	return parse_buf(name, buf, len, 0);
+}
+
+/*
+ * Read file @filename into a writable, zero-terminated buffer. Regular files
+ * are mapped into memory using a private writable mapping. The byte following
+ * the end of file in the last page is guaranteed to be zero, so the mapping is
+ * used directly if the file size is not a multiple of the page size. Store
+ * the data length in @len_ptr, and the mapping length or 0 if the buffer was
+ * allocated on the heap in @map_len_ptr. Return %NULL if the file could not
+ * be opened.
+ */
+static char *read_file(const char *filename, size_t *len_ptr,
+		       size_t *map_len_ptr)
+{
+	struct stat st;
+	char *buf;
+	int fd;
+
+	fd = open(filename, O_RDONLY);
+	if (fd == -1)
+		return NULL;
+
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 &&
+	    st.st_size % sysconf(_SC_PAGESIZE) != 0) {
+		buf = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE,
+			   MAP_PRIVATE, fd, 0);
+		if (buf != MAP_FAILED) {
+			close(fd);
+			*len_ptr = st.st_size;
+			*map_len_ptr = st.st_size;
+			return buf;
+		}
+	}
+
+	buf = read_fd(fd, len_ptr);
+	close(fd);
+	*map_len_ptr = 0;
+
+	return buf;
+}
+
+static struct yaml_node *load_buf(const char *name, char *buf, size_t len,
+				  size_t map_len);
+static bool is_binary(const char *buf, size_t len);
+
+/**
+ * yaml_parse_file - Read YAML file
+ * @fmt: Filename format string
+ *
+ * Read YAML file specified by @fmt and return a newly allocated struct
+ * yaml_node representing the parsed YAML content or %NULL if the file could
+ * not be read or parsed. Files written by yaml_write_binary() are detected
+ * and loaded automatically.
+ */
+struct yaml_node *yaml_parse_file(const char *fmt, ...)
+{
+	struct yaml_node *result = NULL;
+	size_t len, map_len;
+	char *buf;
+
+	get_varargs(fmt, filename);
+
+	buf = read_file(filename, &len, &map_len);
+	if (buf) {
+		if (is_binary(buf, len))
+			result = load_buf(filename, buf, len, map_len);
+		else
+			result = parse_buf(filename, buf, len, map_len);
+	}
+
+	free(filename);
+
+	return result;
+}
+
+/**
+ * yaml_parse_string - Parse string into YAML representation
  * @fmt: Textual YAML content
  *
  * Parse the textual YAML content @fmt and return a newly allocated struct
@@ -416,20 +1130,18 @@ struct yaml_node *yaml_parse_file(const char *fmt, ...)
  */
 struct yaml_node *yaml_parse_string(const char *name, const char *fmt, ...)
 {
-	struct yaml_node *result = NULL;
-	FILE *fd;
-
 	get_varargs(fmt, str);
 
-	fd = fmemopen((void *) str, strlen(str), "r");
-	if (fd) {
-		result = yaml_parse_stream(fd, name);
-		fclose(fd);
-	}
-
-	free(str);
+	return parse_buf(name, str, strlen(str), 0);
+}
 
-	return result;
+static void index_free(struct yaml_node *node)
+{
+	if (!node->index)
+		return;
+	misc_htab_free(&node->index->keys);
+	free(node->index);
+	node->index = NULL;
 }
 
 void yaml_free(struct yaml_node *node)
@@ -439,11 +1151,13 @@ void yaml_free(struct yaml_node *node)
 	if (!node)
 		return;
 
+	/* Freed nodes may still be referenced by lookup indices. */
+	touch(node);
+
 	for (next = NULL; node; node = next) {
-		free(node->filename);
+		index_free(node);
 		switch (node->type) {
 		case yaml_scalar:
-			free(node->scalar.content);
 			break;
 		case yaml_seq:
 			yaml_free(node->seq.content);
@@ -454,7 +1168,10 @@ void yaml_free(struct yaml_node *node)
 			break;
 		}
 		next = node->next;
-		free(node);
+
+		/* Release arena memory with the last node. */
+		if (--node->arena->live == 0 && node->arena->pinned == 0)
+			arena_release(node->arena);
 	}
 }
 
@@ -511,6 +1228,66 @@ static int scalar_strcmp(struct yaml_node *node, const char *str)
 	return -1;
 }
 
+/* Check if @node is a mapping with key @key. */
+static bool is_key(struct yaml_node *node, const char *key)
+{
+	return node->type == yaml_map && node->map.key &&
+	       scalar_strcmp(node->map.key, key) == 0;
+}
+
+/* Add a lookup index for the mapping keys in sibling list @list. */
+static struct yaml_index *index_build(struct yaml_node *list)
+{
+	struct yaml_index *index;
+	struct yaml_node *node;
+	size_t num = 0;
+	char *key;
+
+	index_free(list);
+	yaml_for_each(node, list)
+		num++;
+
+	index = misc_malloc(sizeof(*index));
+	index->generation = get_generation(list);
+	misc_htab_init(&index->keys, num);
+	yaml_for_each(node, list) {
+		if (node->type != yaml_map || !node->map.key ||
+		    node->map.key->type != yaml_scalar)
+			continue;
+		key = node->map.key->scalar.content;
+		if (key && !misc_htab_get(&index->keys, key))
+			misc_htab_put(&index->keys, key, node);
+	}
+	list->index = index;
+
+	return index;
+}
+
+/*
+ * Return the first mapping node with key @key in sibling list @list. Lists
+ * with many entries get a lookup index that is reused by subsequent calls
+ * until the next modification.
+ */
+static struct yaml_node *find_key(struct yaml_node *list, const char *key)
+{
+	struct yaml_index *index = list->index;
+	struct yaml_node *node;
+	int i;
+
+	if (index && index->generation == get_generation(list))
+		return misc_htab_get(&index->keys, key);
+
+	for (i = 0, node = list; node && i < INDEX_MIN; i++) {
+		if (is_key(node, key))
+			return node;
+		node = node->next;
+	}
+	if (!node)
+		return NULL;
+
+	return misc_htab_get(&index_build(list)->keys, key);
+}
+
 /**
  * yaml_get_node - Get a node in a YAML document
  * @root: Root node of the YAML document
@@ -540,11 +1317,8 @@ struct yaml_node *yaml_get_node(struct yaml_node *root, const char *path)
 
 	while ((comp = strsep(&str, "/"))) {
 		yaml_decode_path(comp);
-		for (; *comp && node; node = node->next) {
-			if (node->type == yaml_map && node->map.key &&
-			    scalar_strcmp(node->map.key, comp) == 0)
-				break;
-		}
+		if (*comp && node)
+			node = find_key(node, comp);
 
 		if (!node)
 			break;
@@ -627,53 +1401,78 @@ void yaml_check_unhandled(struct yaml_node *root)
 	}
 }
 
-/**
- * yaml_dup - Duplicate a YAML node
- * @node: Node to duplicate
- * @single: If set, do not duplicate neighbor nodes
- * @no_child: If set, do not duplicate child nodes
- *
- * Return a newly allocated YAML node which is a duplicate of @node, including
- * all content nodes.
+/* Keep strings of @src valid for as long as @arena exists. */
+static void arena_pin(struct yaml_arena *arena, struct yaml_arena *src)
+{
+	struct arena_pin *pin;
+
+	if (src == arena)
+		return;
+	for (pin = arena->pins; pin; pin = pin->next) {
+		if (pin->arena == src)
+			return;
+	}
+	pin = arena_alloc(arena, sizeof(*pin));
+	pin->arena = src;
+	pin->next = arena->pins;
+	arena->pins = pin;
+	src->pinned++;
+}
+
+/*
+ * Duplicate @node into @arena. If @share is set, reference scalar strings and
+ * filenames of @node instead of copying them. The source arena must be kept
+ * alive, and shared strings must not be modified in place: use
+ * yaml_set_scalar() to change scalar content, which replaces the string.
  */
-struct yaml_node *yaml_dup(struct yaml_node *node, bool single, bool no_child)
+static struct yaml_node *dup_node(struct yaml_arena *arena,
+				  struct yaml_node *node, bool single,
+				  bool no_child, bool share)
 {
-	struct yaml_node *res = NULL, *last, *dup;
-	struct filepos pos;
+	struct yaml_node *res = NULL, *last, *d;
 
 	while (node) {
 		/* Duplicate node and content. */
-		pos.filename = node->filename;
-		pos.lineno = node->lineno;
-		dup = new_node(node->type, &pos);
+		if (share) {
+			arena_pin(arena, node->arena);
+			d = new_node(arena, node->type, NULL, node->lineno);
+			d->filename = node->filename;
+		} else {
+			d = new_node(arena, node->type, node->filename,
+				     node->lineno);
+		}
 		switch (node->type) {
 		case yaml_scalar:
-			if (node->scalar.content) {
-				dup->scalar.content =
-					misc_strdup(node->scalar.content);
+			if (share)
+				d->scalar.content = node->scalar.content;
+			else if (node->scalar.content) {
+				d->scalar.content =
+					arena_strdup(arena,
+						     node->scalar.content);
 			}
 			break;
 		case yaml_seq:
 			if (no_child)
 				break;
-			dup->seq.content = yaml_dup(node->seq.content, false,
-						    false);
+			d->seq.content = dup_node(arena, node->seq.content,
+						  false, false, share);
 			break;
 		case yaml_map:
-			dup->map.key = yaml_dup(node->map.key, false, false);
+			d->map.key = dup_node(arena, node->map.key, false,
+					      false, share);
 			if (no_child)
 				break;
-			dup->map.value = yaml_dup(node->map.value, false,
-						  false);
+			d->map.value = dup_node(arena, node->map.value, false,
+						false, share);
 			break;
 		}
 
 		/* Continue with neighbor node. */
 		if (res) {
-			last->next = dup;
-			last = dup;
+			last->next = d;
+			last = d;
 		} else {
-			last = res = dup;
+			last = res = d;
 		}
 
 		if (single)
@@ -685,6 +1484,67 @@ struct yaml_node *yaml_dup(struct yaml_node *node, bool single, bool no_child)
 	return res;
 }
 
+/**
+ * yaml_dup - Duplicate a YAML node
+ * @node: Node to duplicate
+ * @single: If set, do not duplicate neighbor nodes
+ * @no_child: If set, do not duplicate child nodes
+ *
+ * Return a newly allocated YAML node which is a duplicate of @node, including
+ * all content nodes.
+ *
+ * Scalar strings and filenames are shared with @node. Use yaml_set_scalar()
+ * to change scalar content of either copy.
+ */
+struct yaml_node *yaml_dup(struct yaml_node *node, bool single, bool no_child)
+{
+	if (!node)
+		return NULL;
+
+	return dup_node(arena_new(ARENA_BLOCK_MIN), node, single, no_child,
+			true);
+}
+
+/**
+ * yaml_adopt - Move YAML nodes into the arena of another document
+ * @owner: Node of the target document
+ * @node: Nodes to move
+ *
+ * Copy @node, including neighbors and child nodes, into the memory arena
+ * of @owner and free @node. Use this function before linking small
+ * documents into larger ones so that their memory can be released early.
+ *
+ * Return the copy of @node.
+ */
+struct yaml_node *yaml_adopt(struct yaml_node *owner, struct yaml_node *node)
+{
+	struct yaml_node *copy;
+
+	if (!node || node->arena == owner->arena)
+		return node;
+
+	copy = dup_node(owner->arena, node, false, false, false);
+	yaml_free(node);
+
+	return copy;
+}
+
+/**
+ * yaml_set_scalar - Change content of a scalar node
+ * @node: Scalar node
+ * @content: New content
+ *
+ * Replace the content of scalar @node with a copy of @content. Use this
+ * function to change mapping keys and scalar values instead of modifying
+ * node content directly.
+ */
+void yaml_set_scalar(struct yaml_node *node, const char *content)
+{
+	node->scalar.content = content ? arena_strdup(node->arena, content) :
+					 NULL;
+	touch(node);
+}
+
 /**
  * yaml_append - Append YAML node to end of document
  * @root: YAML document to which node should be appended to
@@ -694,6 +1554,7 @@ struct yaml_node *yaml_append(struct yaml_node *root, struct yaml_node *node)
 {
 	struct yaml_node *prev;
 
+	merge_docs(root, node);
 	for (prev = root; prev && prev->next; prev = prev->next)
 		;
 
@@ -712,94 +1573,498 @@ struct yaml_node *yaml_append(struct yaml_node *root, struct yaml_node *node)
  */
 void yaml_append_child(struct yaml_node *parent, struct yaml_node *node)
 {
+	merge_docs(parent, node);
 	set_child(parent, yaml_append(get_child(parent), node));
 }
 
-#define	STR(x)	(x) ? : ""
+#define	STR(x)	(x) ? : ""
+
+/* Write out a YAML node. Restrictions:
+ * - sequences can only have scalar contents
+ * - maps can only have scalar keys
+ * - scalars can only contain non-quoted characters
+ */
+void _yaml_write_stream(struct yaml_node *root, FILE *file, int ind,
+			bool single, bool cont)
+{
+	struct yaml_node *node, *c;
+
+	yaml_for_each(node, root) {
+		if (cont)
+			cont = false;
+		else
+			fprintf(file, "%*s", ind, "");
+
+		switch (node->type) {
+		case yaml_scalar:
+			fprintf(file, "%s\n", STR(node->scalar.content));
+			break;
+		case yaml_seq:
+			c = node->seq.content;
+			if (!c || c->type != yaml_scalar)
+				break;
+			fprintf(file, "- ");
+			_yaml_write_stream(c, file, ind + 2, false, true);
+			break;
+		case yaml_map:
+			c = node->map.key;
+			if (!c || c->type != yaml_scalar)
+				break;
+			fprintf(file, "%s:", STR(c->scalar.content));
+
+			c = node->map.value;
+			if (!c)
+				fprintf(file, "\n");
+			else if (c->type == yaml_scalar)
+				fprintf(file, " %s\n", STR(c->scalar.content));
+			else {
+				fprintf(file, "\n");
+				_yaml_write_stream(c, file, ind + 2, false,
+						   false);
+			}
+		}
+
+		if (single)
+			break;
+	}
+}
+
+/**
+ * yaml_write_stream - Write YAML document to I/O stream
+ * @root: YAML document
+ * @file: I/O stream
+ * @indent: Number of blanks to use for indentation
+ * @single: If %true, do not write data for neighbors of @root
+ */
+void yaml_write_stream(struct yaml_node *root, FILE *file, int indent,
+		       bool single)
+{
+	_yaml_write_stream(root, file, indent, single, false);
+}
+
+/* Check if a temporary file can replace @filename with status @st without
+ * changing its ownership or links. */
+static bool can_replace(struct stat *st)
+{
+	if (!S_ISREG(st->st_mode) || st->st_nlink > 1)
+		return false;
+
+	return st->st_uid == geteuid() || geteuid() == 0;
+}
+
+/*
+ * Open @filename for writing. Regular files are replaced atomically:
+ * yaml_parse_file() maps files into memory, and truncating a file while it is
+ * mapped by another process would cause that process to fail with SIGBUS.
+ * If a temporary file is used, its name is stored in @tmpname_ptr. The
+ * temporary file gets the mode and ownership of the file it replaces. Files
+ * with other owners or multiple links are written in place.
+ *
+ * Limitations:
+ * - a reader still fails with SIGBUS if another program truncates a file
+ *   that the reader has mapped
+ * - a temporary file "<filename>.tmp.<pid>" is left behind if the writing
+ *   process is killed before the file is complete
+ */
+static FILE *open_output(const char *filename, char **tmpname_ptr)
+{
+	char *tmpname = NULL;
+	bool exists;
+	struct stat st;
+	FILE *file = NULL;
+	int fd;
+
+	exists = (lstat(filename, &st) == 0);
+	if (!exists || can_replace(&st)) {
+		tmpname = misc_asprintf("%s.tmp.%d", filename, getpid());
+		fd = open(tmpname, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC,
+			  0666);
+		if (fd != -1 && exists &&
+		    (fchown(fd, st.st_uid, st.st_gid) == -1 ||
+		     fchmod(fd, st.st_mode & 07777) == -1)) {
+			close(fd);
+			unlink(tmpname);
+			fd = -1;
+		}
+		file = (fd == -1) ? NULL : fdopen(fd, "w");
+		if (!file) {
+			if (fd != -1) {
+				close(fd);
+				unlink(tmpname);
+			}
+			/* Fall back to writing in place. */
+			free(tmpname);
+			tmpname = NULL;
+		}
+	}
+	if (!tmpname)
+		file = fopen(filename, "w");
+	*tmpname_ptr = tmpname;
+
+	return file;
+}
+
+/* Close @file opened by open_output() and move temporary file @tmpname
+ * to @filename. */
+static bool close_output(FILE *file, const char *filename, char *tmpname)
+{
+	bool result;
+
+	result = (fclose(file) == 0);
+	if (tmpname) {
+		if (result)
+			result = (rename(tmpname, filename) == 0);
+		if (!result)
+			unlink(tmpname);
+		free(tmpname);
+	}
+
+	return result;
+}
+
+/**
+ * yaml_write_file - Write YAML document to file
+ * @root: YAML document
+ * @indent: Number of blanks to use for indentation
+ * @single: If %true, do not write data for neighbors of @root
+ * @fmt: Filename format string
+ */
+bool yaml_write_file(struct yaml_node *root, int indent, bool single,
+		     const char *fmt, ...)
+{
+	bool result = false;
+	char *tmpname;
+	FILE *file;
+
+	get_varargs(fmt, filename);
+
+	file = open_output(filename, &tmpname);
+	if (file) {
+		yaml_write_stream(root, file, indent, single);
+		result = close_output(file, filename, tmpname);
+	}
+
+	free(filename);
+
+	return result;
+}
+
+/*
+ * Binary YAML format
+ *
+ * The binary format is used to pass parsed YAML documents between tela
+ * processes without the cost of formatting and re-parsing text. A binary
+ * file consists of:
+ *
+ *   struct bin_header
+ *   struct bin_node[num_nodes]
+ *   char strtab[strtab_size]
+ *
+ * Nodes are stored in pre-order, so that all node references point to
+ * nodes with a higher index. Index 0 is the root node. Strings are stored
+ * zero-terminated and de-duplicated in the string table and referenced by
+ * offset. Data is stored in host byte order - files are not meant to be
+ * portable between systems.
+ */
+#define BIN_MAGIC	"TELAYAML"
+#define BIN_VERSION	1
+#define BIN_BYTE_ORDER	0x01020304
+#define BIN_NONE	UINT32_MAX
+
+struct bin_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t byte_order;
+	uint32_t num_nodes;
+	uint32_t strtab_size;
+};
+
+/* @a and @b contain scalar content, seq content, or map key and value. */
+struct bin_node {
+	uint32_t type;
+	uint32_t lineno;
+	uint32_t filename;
+	uint32_t a;
+	uint32_t b;
+	uint32_t next;
+};
+
+struct bin_writer {
+	struct bin_node *nodes;
+	size_t num_nodes;
+	size_t max_nodes;
+	char *strtab;
+	size_t strtab_size;
+	size_t strtab_max;
+	struct misc_htab strings;
+};
+
+/* Return string table offset of @str. */
+static uint32_t bin_add_str(struct bin_writer *w, const char *str)
+{
+	size_t len;
+	void *v;
+
+	if (!str)
+		return BIN_NONE;
+
+	v = misc_htab_get(&w->strings, str);
+	if (v)
+		return (uint32_t) ((uintptr_t) v - 1);
+
+	len = strlen(str) + 1;
+	if (w->strtab_size + len > w->strtab_max) {
+		w->strtab_max = (w->strtab_max + len) * 2;
+		w->strtab = misc_realloc(w->strtab, w->strtab_max);
+	}
+	memcpy(w->strtab + w->strtab_size, str, len);
+	misc_htab_put(&w->strings, str, (void *) (w->strtab_size + 1));
+	w->strtab_size += len;
+
+	return w->strtab_size - len;
+}
+
+/* Add @node and, unless @single is set, its neighbors to @w. Return index
+ * of the first added node. */
+static uint32_t bin_add_node(struct bin_writer *w, struct yaml_node *node,
+			     bool single)
+{
+	uint32_t first = BIN_NONE, prev = BIN_NONE, i, a = BIN_NONE,
+		 b = BIN_NONE;
+
+	for (; node; node = single ? NULL : node->next) {
+		if (w->num_nodes == w->max_nodes) {
+			w->max_nodes = w->max_nodes ? w->max_nodes * 2 : 64;
+			w->nodes = misc_realloc(w->nodes, w->max_nodes *
+						sizeof(struct bin_node));
+		}
+		i = w->num_nodes++;
+		if (prev == BIN_NONE)
+			first = i;
+		else
+			w->nodes[prev].next = i;
+
+		switch (node->type) {
+		case yaml_scalar:
+			a = bin_add_str(w, node->scalar.content);
+			b = BIN_NONE;
+			break;
+		case yaml_seq:
+			a = bin_add_node(w, node->seq.content, false);
+			b = BIN_NONE;
+			break;
+		case yaml_map:
+			a = bin_add_node(w, node->map.key, false);
+			b = bin_add_node(w, node->map.value, false);
+			break;
+		}
+		w->nodes[i].type = node->type;
+		w->nodes[i].lineno = node->lineno;
+		w->nodes[i].filename = bin_add_str(w, node->filename);
+		w->nodes[i].a = a;
+		w->nodes[i].b = b;
+		w->nodes[i].next = BIN_NONE;
+		prev = i;
+	}
+
+	return first;
+}
+
+/**
+ * yaml_write_binary - Write YAML document to file in binary format
+ * @root: YAML document
+ * @single: If %true, do not write data for neighbors of @root
+ * @fmt: Filename format string
+ *
+ * Write @root to the file specified by @fmt in a binary format that can be
+ * loaded using yaml_load_binary() or yaml_parse_file(). Use this function
+ * for files that are only read by tela.
+ */
+bool yaml_write_binary(struct yaml_node *root, bool single,
+		       const char *fmt, ...)
+{
+	struct bin_header hdr;
+	struct bin_writer w;
+	bool result = false;
+	char *tmpname;
+	FILE *file;
+
+	get_varargs(fmt, filename);
+
+	memset(&w, 0, sizeof(w));
+	misc_htab_init(&w.strings, 0);
+	bin_add_node(&w, root, single);
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, BIN_MAGIC, sizeof(hdr.magic));
+	hdr.version = BIN_VERSION;
+	hdr.byte_order = BIN_BYTE_ORDER;
+	hdr.num_nodes = w.num_nodes;
+	hdr.strtab_size = w.strtab_size;
+
+	file = open_output(filename, &tmpname);
+	if (file) {
+		fwrite(&hdr, sizeof(hdr), 1, file);
+		fwrite(w.nodes, sizeof(struct bin_node), w.num_nodes, file);
+		fwrite(w.strtab, 1, w.strtab_size, file);
+		result = close_output(file, filename, tmpname);
+	}
+
+	misc_htab_free(&w.strings);
+	free(w.strtab);
+	free(w.nodes);
+	free(filename);
+
+	return result;
+}
+
+static bool is_binary(const char *buf, size_t len)
+{
+	return len >= sizeof(struct bin_header) &&
+	       memcmp(buf, BIN_MAGIC, sizeof(((struct bin_header *) 0)->magic))
+	       == 0;
+}
+
+/*
+ * Check node reference @x of node @i in a list of @num nodes. References must
+ * point forward to keep the tree free of cycles, and each node except the
+ * root must be referenced exactly once, so that yaml_free() releases all
+ * nodes of the arena exactly once. @refd records referenced nodes.
+ */
+static bool bin_ref(bool *refd, uint32_t i, uint32_t num, uint32_t x)
+{
+	if (x == BIN_NONE)
+		return true;
+	if (x <= i || x >= num || refd[x])
+		return false;
+	refd[x] = true;
+
+	return true;
+}
 
-/* Write out a YAML node. Restrictions:
- * - sequences can only have scalar contents
- * - maps can only have scalar keys
- * - scalars can only contain non-quoted characters
+/*
+ * Create YAML nodes for binary data in @buf of length @len. The resulting
+ * document takes ownership of @buf, see parse_buf(). Scalar content and
+ * filenames reference the string table in @buf directly.
  */
-void _yaml_write_stream(struct yaml_node *root, FILE *file, int ind,
-			bool single, bool cont)
+static struct yaml_node *load_buf(const char *name, char *buf, size_t len,
+				  size_t map_len)
 {
-	struct yaml_node *node, *c;
+	struct bin_header *hdr = (struct bin_header *) buf;
+	struct yaml_node **nodes = NULL, *n;
+	struct yaml_arena *arena;
+	bool ok, *refd = NULL;
+	struct bin_node *b;
+	uint32_t i, num;
+	char *strtab;
+
+	arena = arena_new(ARENA_BLOCK_PARSE);
+	arena->buf = buf;
+	arena->map_len = map_len;
+
+	if (hdr->version != BIN_VERSION || hdr->byte_order != BIN_BYTE_ORDER) {
+		debug("%s: Unsupported binary YAML version", name);
+		goto err;
+	}
+	/* Empty document. */
+	num = hdr->num_nodes;
+	if (num == 0)
+		goto err;
+	if (len - sizeof(*hdr) < (size_t) num * sizeof(*b) ||
+	    len - sizeof(*hdr) - (size_t) num * sizeof(*b) !=
+	    hdr->strtab_size)
+		goto corrupt;
+	b = (struct bin_node *) (hdr + 1);
+	strtab = (char *) (b + num);
+	if (hdr->strtab_size > 0 && strtab[hdr->strtab_size - 1] != 0)
+		goto corrupt;
+
+	nodes = misc_malloc(num * sizeof(struct yaml_node *));
+	for (i = 0; i < num; i++) {
+		nodes[i] = new_node(arena, b[i].type, NULL, b[i].lineno);
+		if (b[i].filename < hdr->strtab_size)
+			nodes[i]->filename = strtab + b[i].filename;
+	}
 
-	yaml_for_each(node, root) {
-		if (cont)
-			cont = false;
-		else
-			fprintf(file, "%*s", ind, "");
+	refd = misc_malloc(num * sizeof(bool));
 
-		switch (node->type) {
+	for (i = 0; i < num; i++) {
+		n = nodes[i];
+		ok = bin_ref(refd, i, num, b[i].next);
+		switch (b[i].type) {
 		case yaml_scalar:
-			fprintf(file, "%s\n", STR(node->scalar.content));
+			if (b[i].a != BIN_NONE && b[i].a >= hdr->strtab_size)
+				ok = false;
+			else if (b[i].a != BIN_NONE)
+				n->scalar.content = strtab + b[i].a;
 			break;
 		case yaml_seq:
-			c = node->seq.content;
-			if (!c || c->type != yaml_scalar)
-				break;
-			fprintf(file, "- ");
-			_yaml_write_stream(c, file, ind + 2, false, true);
+			ok = ok && bin_ref(refd, i, num, b[i].a);
+			if (ok && b[i].a != BIN_NONE)
+				n->seq.content = nodes[b[i].a];
 			break;
 		case yaml_map:
-			c = node->map.key;
-			if (!c || c->type != yaml_scalar)
-				break;
-			fprintf(file, "%s:", STR(c->scalar.content));
-
-			c = node->map.value;
-			if (!c)
-				fprintf(file, "\n");
-			else if (c->type == yaml_scalar)
-				fprintf(file, " %s\n", STR(c->scalar.content));
-			else {
-				fprintf(file, "\n");
-				_yaml_write_stream(c, file, ind + 2, false,
-						   false);
-			}
+			ok = ok && bin_ref(refd, i, num, b[i].a) &&
+			     bin_ref(refd, i, num, b[i].b);
+			if (ok && b[i].a != BIN_NONE)
+				n->map.key = nodes[b[i].a];
+			if (ok && b[i].b != BIN_NONE)
+				n->map.value = nodes[b[i].b];
+			break;
+		default:
+			ok = false;
+			break;
 		}
+		if (!ok)
+			goto corrupt;
+		if (b[i].next != BIN_NONE)
+			n->next = nodes[b[i].next];
+	}
 
-		if (single)
-			break;
+	for (i = 1; i < num; i++) {
+		if (!refd[i])
+			goto corrupt;
 	}
-}
 
-/**
- * yaml_write_stream - Write YAML document to I/O stream
- * @root: YAML document
- * @file: I/O stream
- * @indent: Number of blanks to use for indentation
- * @single: If %true, do not write data for neighbors of @root
- */
-void yaml_write_stream(struct yaml_node *root, FILE *file, int indent,
-		       bool single)
-{
-	_yaml_write_stream(root, file, indent, single, false);
+	n = nodes[0];
+	free(refd);
+	free(nodes);
+
+	return n;
+
+corrupt:
+	warnx("%s: Corrupted binary YAML file", name);
+
+err:
+	free(refd);
+	free(nodes);
+	arena_release(arena);
+
+	return NULL;
 }
 
 /**
- * yaml_write_file - Write YAML document to file
- * @root: YAML document
- * @indent: Number of blanks to use for indentation
- * @single: If %true, do not write data for neighbors of @root
+ * yaml_load_binary - Load YAML document from binary file
  * @fmt: Filename format string
+ *
+ * Load a YAML document that was written using yaml_write_binary() from the
+ * file specified by @fmt. Return the resulting document or %NULL if the file
+ * could not be read or is not a valid binary YAML file.
  */
-bool yaml_write_file(struct yaml_node *root, int indent, bool single,
-		     const char *fmt, ...)
+struct yaml_node *yaml_load_binary(const char *fmt, ...)
 {
-	bool result = false;
-	FILE *file;
+	struct yaml_node *result = NULL;
+	size_t len, map_len;
+	char *buf;
 
 	get_varargs(fmt, filename);
 
-	file = fopen(filename, "w");
-	if (file) {
-		yaml_write_stream(root, file, indent, single);
-		fclose(file);
-		result = true;
+	buf = read_file(filename, &len, &map_len);
+	if (buf) {
+		if (is_binary(buf, len))
+			result = load_buf(filename, buf, len, map_len);
+		else
+			release_buf(buf, map_len);
 	}
 
 	free(filename);
@@ -829,34 +2094,34 @@ void yaml_decode_path(char *path)
 	replace_char(path, YAML_PATH_SLASH, '/');
 }
 
-/* Return a textual path of YAML node @node with parent path @parent. */
-static char *node_path(struct yaml_node *node, const char *parent)
+/* Return the path component for @node at top level if @top is set. */
+static const char *node_name(struct yaml_node *node, bool top)
 {
-	char *name, *result;
+	struct yaml_node *c;
 
 	switch (node->type) {
 	case yaml_scalar:
-		return misc_asprintf("%s/", parent);
+		return top ? "/" : "";
 	case yaml_seq:
-		name = node->seq.content->scalar.content;
+		c = node->seq.content;
+		if (c && c->type == yaml_scalar && c->scalar.content)
+			return c->scalar.content;
 		break;
 	case yaml_map:
-		name = node->map.key->scalar.content;
+		c = node->map.key;
+		if (c && c->type == yaml_scalar && c->scalar.content)
+			return c->scalar.content;
 		break;
 	}
 
-	/* Replace '/' in name to prevent fnmatch() confusion. */
-	name = misc_strdup(name);
-	replace_char(name, '/', YAML_PATH_SLASH);
-
-	if (*parent)
-		result = misc_asprintf("%s/%s", parent, name);
-	else
-		result = misc_strdup(name);
-
-	free(name);
+	return "";
+}
 
-	return result;
+/* Set @pb to the textual path of YAML node @node, see path_set_name(). */
+static void path_set(struct path_buf *pb, size_t parent_len,
+		     struct yaml_node *node)
+{
+	path_set_name(pb, parent_len, node->type, node_name(node, false));
 }
 
 /*
@@ -887,16 +2152,15 @@ static void iter_init(struct yaml_iter *iter, struct yaml_node **root,
 /* Perform cleanup of @iter. */
 static void iter_exit(struct yaml_iter *iter, struct yaml_node **root)
 {
-	free(iter->path);
-
 	/* Root node may have changed. */
 	if (root)
 		*root = iter->root;
 }
 
-/* Update @iter to point to the next YAML node. Return %true on success,
- * %false if iterator was already at end. */
-static bool iter_advance(struct yaml_iter *iter, const char *parent_path)
+/* Update @iter to point to the next YAML node and store its path in @pb.
+ * Return %true on success, %false if iterator was already at end. */
+static bool iter_advance(struct yaml_iter *iter, struct path_buf *pb,
+			 size_t parent_len)
 {
 	/* Advance iter->prev only if node was not removed. */
 	if (iter->node)
@@ -904,10 +2168,11 @@ static bool iter_advance(struct yaml_iter *iter, const char *parent_path)
 
 	iter->node = iter->next;
 
-	free(iter->path);
 	if (iter->node) {
 		iter->next = iter->node->next;
-		iter->path = node_path(iter->node, parent_path);
+		iter->skip = false;
+		path_set(pb, parent_len, iter->node);
+		iter->path = pb->str;
 	} else {
 		/* Reached end. */
 		iter->next = NULL;
@@ -930,7 +2195,8 @@ static void iter_reset(struct yaml_iter *iter)
 }
 
 static bool _traverse(struct yaml_node **root, struct yaml_node *parent,
-		      const char *parent_path, yaml_cb_t cb, void *data)
+		      struct path_buf *pb, size_t parent_len, yaml_cb_t cb,
+		      void *data)
 {
 	struct yaml_iter iter;
 	bool result = true;
@@ -938,15 +2204,17 @@ static bool _traverse(struct yaml_node **root, struct yaml_node *parent,
 	iter_init(&iter, root, parent);
 
 	iter_reset(&iter);
-	while (result && iter_advance(&iter, parent_path)) {
+	while (result && iter_advance(&iter, pb, parent_len)) {
 		/* Handle node. */
 		result = cb(&iter, data);
 		if (!result)
 			break;
 
 		/* Handle child nodes. */
+		if (iter.skip)
+			continue;
 		result = _traverse(iter.node ? &iter.root : NULL, iter.node,
-				   iter.path, cb, data);
+				   pb, pb->len, cb, data);
 	}
 
 	iter_exit(&iter, root);
@@ -964,13 +2232,218 @@ static bool _traverse(struct yaml_node **root, struct yaml_node *parent,
  *
  * Callback functions may replace or delete the current node in @root using the
  * yaml_replace() and yaml_del() functions. If the root node is modified,
- * the @root pointer will be updated accordingly.
+ * the @root pointer will be updated accordingly. Callbacks may set the @skip
+ * field of @iter to skip the child nodes of the current node.
  *
  * Return %true if all nodes were traversed, or %false otherwise.
  */
 bool yaml_traverse(struct yaml_node **root, yaml_cb_t cb, void *data)
 {
-	return _traverse(root, NULL, "", cb, data);
+	struct path_buf pb = { 0 };
+	bool result;
+
+	path_reserve(&pb, 0);
+	pb.str[0] = 0;
+	result = _traverse(root, NULL, &pb, 0, cb, data);
+	free(pb.str);
+
+	return result;
+}
+
+/* Emit events for @node and its neighbors below parent path length @base. */
+static void tree_events(struct scanner *sc, struct yaml_node *node,
+			size_t base)
+{
+	struct yaml_node *key;
+	size_t len;
+
+	for (; node && !sc->stop; node = node->next) {
+		sc->filename = node->filename;
+		path_set(&sc->pb, base, node);
+		len = sc->pb.len;
+		switch (node->type) {
+		case yaml_scalar:
+			event(sc, yaml_event_scalar, node->scalar.content,
+			      node->lineno);
+			break;
+		case yaml_seq:
+			event(sc, yaml_event_seq_start, NULL, node->lineno);
+			tree_events(sc, node->seq.content, len);
+			emit_end(sc, yaml_event_seq_end, len, node->lineno);
+			break;
+		case yaml_map:
+			key = node->map.key;
+			event(sc, yaml_event_map_start,
+			      key && key->type == yaml_scalar ?
+			      key->scalar.content : NULL, node->lineno);
+			tree_events(sc, node->map.value, len);
+			emit_end(sc, yaml_event_map_end, len, node->lineno);
+			break;
+		}
+	}
+}
+
+/**
+ * yaml_scan_file - Read YAML file as a sequence of events
+ * @cb: Callback to call for each event
+ * @data: Extra data to pass to callback
+ * @fmt: Filename format string
+ *
+ * Read the YAML file specified by @fmt and call @cb for each node start and
+ * end in document order, or until @cb returns %false. Event paths match the
+ * paths reported by yaml_traverse() for the document returned by
+ * yaml_parse_file(). Text files are read without building a node tree, so
+ * that memory usage only depends on nesting depth and scalar length. Files
+ * written by yaml_write_binary() are loaded and reported in the same way.
+ *
+ * Note that events for a document with syntax errors may be reported before
+ * the error is detected.
+ *
+ * Return %false if the file could not be read or parsed, %true otherwise.
+ */
+bool yaml_scan_file(yaml_event_cb_t cb, void *data, const char *fmt, ...)
+{
+	struct scanner sc;
+	struct filepos pos;
+	struct yaml_node *root;
+	size_t len, map_len;
+	bool result = false;
+	char *buf;
+
+	get_varargs(fmt, filename);
+
+	buf = read_file(filename, &len, &map_len);
+	if (!buf)
+		goto out;
+
+	if (is_binary(buf, len)) {
+		root = load_buf(filename, buf, len, map_len);
+		if (root) {
+			memset(&sc, 0, sizeof(sc));
+			sc.cb = cb;
+			sc.data = data;
+			path_reserve(&sc.pb, 0);
+			tree_events(&sc, root, 0);
+			free(sc.pb.str);
+			yaml_free(root);
+			result = true;
+		}
+	} else {
+		memset(&pos, 0, sizeof(pos));
+		pos.filename = filename;
+		pos.cur = buf;
+		pos.end = buf + len;
+		result = scan_pos(&pos, cb, data);
+		release_buf(buf, map_len);
+	}
+
+out:
+	free(filename);
+
+	return result;
+}
+
+/**
+ * struct sibling - Entry in a sibling index
+ * @node: Sibling node
+ * @prev: Previous sibling of @node or %NULL
+ */
+struct sibling {
+	struct yaml_node *node;
+	struct yaml_node *prev;
+};
+
+/**
+ * struct sibling_index - Lookup index for siblings during dual traversal
+ * @names: Hash table mapping path components to the first matching sibling
+ * @entries: Array of siblings referenced by @names
+ * @valid: Flag indicating that @names reflects the current sibling list
+ */
+struct sibling_index {
+	struct misc_htab names;
+	struct sibling *entries;
+	bool valid;
+};
+
+static void sibling_index_free(struct sibling_index *si)
+{
+	if (si->entries) {
+		misc_htab_free(&si->names);
+		free(si->entries);
+	}
+	si->entries = NULL;
+	si->valid = false;
+}
+
+/*
+ * Position @iter on the first sibling with the same path component @name
+ * as a node at top level if @top is set. Use @si to speed up lookups in long
+ * sibling lists. The path of a matching node is the path of the node that
+ * was looked up, which is already stored in @pb. Return %true if a matching
+ * node was found, %false otherwise.
+ */
+static bool iter_find(struct yaml_iter *iter, const char *name, bool top,
+		      struct sibling_index *si, struct path_buf *pb)
+{
+	struct yaml_node *node, *prev = NULL;
+	struct sibling *s = NULL;
+	const char *n;
+	size_t num;
+
+	if (si->valid) {
+		s = misc_htab_get(&si->names, name);
+		if (s) {
+			node = s->node;
+			prev = s->prev;
+		} else
+			node = NULL;
+		goto out;
+	}
+
+	iter_reset(iter);
+	num = 0;
+	yaml_for_each(node, iter->next) {
+		if (strcmp(node_name(node, top), name) == 0)
+			break;
+		prev = node;
+		num++;
+	}
+	if (num < INDEX_MIN)
+		goto out;
+
+	/* Build index for subsequent lookups. */
+	sibling_index_free(si);
+	for (num = 0, node = iter->next; node; node = node->next)
+		num++;
+	si->entries = misc_malloc(num * sizeof(*si->entries));
+	misc_htab_init(&si->names, num);
+	for (num = 0, prev = NULL, node = iter->next; node;
+	     prev = node, node = node->next, num++) {
+		si->entries[num].node = node;
+		si->entries[num].prev = prev;
+		n = node_name(node, top);
+		if (!misc_htab_get(&si->names, n))
+			misc_htab_put(&si->names, n, &si->entries[num]);
+	}
+	si->valid = true;
+
+	s = misc_htab_get(&si->names, name);
+	node = s ? s->node : NULL;
+	prev = s ? s->prev : NULL;
+
+out:
+	iter->node = node;
+	iter->skip = false;
+	if (node) {
+		iter->prev = prev;
+		iter->next = node->next;
+		iter->path = pb->str;
+	} else {
+		iter->next = NULL;
+		iter->path = NULL;
+	}
+
+	return !!node;
 }
 
 /**
@@ -978,57 +2451,61 @@ bool yaml_traverse(struct yaml_node **root, yaml_cb_t cb, void *data)
  * @b_parent: Parent node in the second document, or %NULL.
  * @a_root: Root node of the first document, or %NULL.
  * @b_root: Root node of the second document, or %NULL.
+ *
+ * Partner nodes are looked up by path component, using a per-level sibling
+ * index for long lists. The index for @b is dropped when a callback modifies
+ * the matched node, the index for @a is only needed in the second pass where
+ * callbacks cannot modify @a.
  */
 static bool _traverse2(struct yaml_node **a_root, struct yaml_node *a_parent,
 		       struct yaml_node **b_root, struct yaml_node *b_parent,
-		       const char *parent_path, yaml_cb2_t cb, void *data)
+		       struct path_buf *pb, size_t parent_len, yaml_cb2_t cb,
+		       void *data)
 {
+	struct sibling_index a_si = { 0 }, b_si = { 0 };
 	struct yaml_iter a_iter, b_iter;
-	bool result = true;
+	struct yaml_node *match;
+	bool result = true, top = parent_len == 0;
 
 	iter_init(&a_iter, a_root, a_parent);
 	iter_init(&b_iter, b_root, b_parent);
 
 	/* First pass: nodes in a and a+b. */
 	iter_reset(&a_iter);
-	while (result && iter_advance(&a_iter, parent_path)) {
+	while (result && iter_advance(&a_iter, pb, parent_len)) {
 		/* Find matching node in b. */
-		iter_reset(&b_iter);
-		while (iter_advance(&b_iter, parent_path)) {
-			if (strcmp(a_iter.path, b_iter.path) == 0)
-				break;
-		}
+		iter_find(&b_iter, node_name(a_iter.node, top), top, &b_si, pb);
+		match = b_iter.node;
 
 		/* Handle nodes. */
 		result = cb(&a_iter, b_iter.node ? &b_iter : NULL, data);
 		if (!result)
 			break;
+		if (b_iter.node != match)
+			b_si.valid = false;
 
 		/* Skip calls for two NULL nodes. */
 		if (!a_iter.node && !b_iter.node)
 			continue;
 
+		if (a_iter.skip || b_iter.skip)
+			continue;
+
 		/* Handle child nodes. */
 		result = _traverse2(a_iter.node ? &a_iter.root : NULL,
 				    a_iter.node,
 				    b_iter.node ? &b_iter.root : NULL,
-				    b_iter.node, a_iter.path, cb, data);
+				    b_iter.node, pb, pb->len, cb, data);
 	}
 	if (!result)
 		goto out;
 
 	/* Second pass: nodes in b only. */
 	iter_reset(&b_iter);
-	while (result && iter_advance(&b_iter, parent_path)) {
-		/* Find matching node in a. */
-		iter_reset(&a_iter);
-		while (iter_advance(&a_iter, parent_path)) {
-			if (strcmp(a_iter.path, b_iter.path) == 0)
-				break;
-		}
-
+	while (result && iter_advance(&b_iter, pb, parent_len)) {
 		/* Skip nodes in both documents as they were already handled. */
-		if (a_iter.node)
+		if (iter_find(&a_iter, node_name(b_iter.node, top), top, &a_si,
+			      pb))
 			continue;
 
 		/* Handle nodes. */
@@ -1037,15 +2514,17 @@ static bool _traverse2(struct yaml_node **a_root, struct yaml_node *a_parent,
 			break;
 
 		/* Skip if b was deleted. */
-		if (!b_iter.node)
+		if (!b_iter.node || b_iter.skip)
 			continue;
 
 		/* Handle child nodes. */
 		result = _traverse2(NULL, NULL, &b_iter.root, b_iter.node,
-				    b_iter.path, cb, data);
+				    pb, pb->len, cb, data);
 	}
 
 out:
+	sibling_index_free(&a_si);
+	sibling_index_free(&b_si);
 	iter_exit(&a_iter, a_root);
 	iter_exit(&b_iter, b_root);
 
@@ -1064,14 +2543,23 @@ out:
  *
  * Callback functions may replace or delete the current node in @a and @b using
  * the yaml_replace() and yaml_del() functions. If the root nodes of a and b
- * are modified, @a and @b will be updated accordingly.
+ * are modified, @a and @b will be updated accordingly. Callbacks may set the
+ * @skip field of either iterator to skip the child nodes of the current nodes.
  *
  * Return %true if all nodes were traversed, or %false otherwise.
  */
 bool yaml_traverse2(struct yaml_node **a, struct yaml_node **b, yaml_cb2_t cb,
 		    void *data)
 {
-	return _traverse2(a, NULL, b, NULL, "", cb, data);
+	struct path_buf pb = { 0 };
+	bool result;
+
+	path_reserve(&pb, 0);
+	pb.str[0] = 0;
+	result = _traverse2(a, NULL, b, NULL, &pb, 0, cb, data);
+	free(pb.str);
+
+	return result;
 }
 
 /**
@@ -1089,6 +2577,7 @@ void yaml_iter_replace(struct yaml_iter *iter, struct yaml_node *replacement)
 
 	/* Replace node in iterator. */
 	iter->node = replacement;
+	merge_docs(t, replacement);
 
 	if (replacement) {
 		/* Use yaml_append here to cover multi-node replacement. */
@@ -1111,6 +2600,23 @@ void yaml_iter_replace(struct yaml_iter *iter, struct yaml_node *replacement)
 	yaml_free(t);
 }
 
+/**
+ * yaml_iter_decoded_path - Return copy of path of current node
+ * @iter: Represents current node
+ *
+ * Return a newly allocated copy of the path of the node identified by @iter
+ * in normal format as produced by yaml_decode_path(). Use this function to
+ * obtain a path that remains valid after the traversal callback returns.
+ */
+char *yaml_iter_decoded_path(struct yaml_iter *iter)
+{
+	char *path = misc_strdup(iter->path);
+
+	yaml_decode_path(path);
+
+	return path;
+}
+
 /**
  * yaml_iter_del - Remove node from YAML document
  * @iter: Represents node to remove
@@ -1197,9 +2703,176 @@ void yaml_free_data(struct yaml_node *root, release_fn_t release_fn)
 	yaml_traverse(&root, free_data_cb, release_fn);
 }
 
+/* Mix value @v into hash @h. */
+static uint64_t hash_mix(uint64_t h, uint64_t v)
+{
+	h ^= v;
+	h ^= h >> 30;
+	h *= 0xbf58476d1ce4e5b9ULL;
+	h ^= h >> 27;
+	h *= 0x94d049bb133111ebULL;
+	h ^= h >> 31;
+
+	return h;
+}
+
+static struct yaml_hash *get_hash(struct yaml_node *node)
+{
+	if (!node->hash)
+		node->hash = arena_alloc(node->arena, sizeof(*node->hash));
+
+	return node->hash;
+}
+
+static struct yaml_hash *list_hash(struct yaml_node *list);
+
+/* Return hashes of @node with an up-to-date node hash. */
+static struct yaml_hash *node_hash(struct yaml_node *node)
+{
+	struct yaml_hash *h = get_hash(node), *c;
+	struct yaml_node *child;
+	unsigned long gen;
+
+	gen = get_generation(node);
+	if (h->node_gen == gen)
+		return h;
+
+	h->node = hash_mix(0, node->type + 1);
+	h->node_dups = false;
+	if (node->type == yaml_scalar) {
+		h->node = hash_mix(h->node, node->scalar.content ?
+				   misc_hash_str(node->scalar.content) : 0);
+	} else {
+		child = get_child(node);
+		if (child) {
+			c = list_hash(child);
+			h->node = hash_mix(h->node, c->list);
+			h->node_dups = c->list_dups;
+		}
+	}
+	h->node_gen = gen;
+
+	return h;
+}
+
+/* Check if @node is the first node with its path component in the sibling
+ * list starting at @list. @names is used for long lists. */
+static bool is_first(struct yaml_node *list, struct yaml_node *node,
+		     struct misc_htab *names)
+{
+	const char *name = node_name(node, false);
+	struct yaml_node *n;
+
+	if (names->entries) {
+		if (misc_htab_get(names, name))
+			return false;
+		misc_htab_put(names, name, node);
+		return true;
+	}
+	for (n = list; n != node; n = n->next) {
+		if (strcmp(node_name(n, false), name) == 0)
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * Return hashes of @list with an up-to-date list hash. Siblings are matched
+ * by path component during dual traversal, and only the first sibling with a
+ * given path component is ever matched. The list hash is therefore computed
+ * as order-independent sum over the hashes of these first siblings. Documents
+ * that compare equal using yaml_cmp() always have the same list hash.
+ */
+static struct yaml_hash *list_hash(struct yaml_node *list)
+{
+	struct yaml_hash *h = get_hash(list), *nh;
+	struct misc_htab names = { 0 };
+	struct yaml_node *node;
+	unsigned long gen;
+	size_t num = 0;
+
+	gen = get_generation(list);
+	if (h->list_gen == gen)
+		return h;
+
+	yaml_for_each(node, list)
+		num++;
+	if (num >= INDEX_MIN)
+		misc_htab_init(&names, num);
+
+	h->list = 0;
+	h->list_dups = false;
+	yaml_for_each(node, list) {
+		nh = node_hash(node);
+		if (nh->node_dups)
+			h->list_dups = true;
+		if (!is_first(list, node, &names)) {
+			h->list_dups = true;
+			continue;
+		}
+		h->list += hash_mix(misc_hash_str(node_name(node, false)),
+				    nh->node);
+	}
+	h->list_gen = gen;
+
+	if (names.entries)
+		misc_htab_free(&names);
+
+	return h;
+}
+
+static bool same(struct yaml_node *a, struct yaml_node *b);
+
+/* Return %true if nodes @a and @b have the same content and child nodes,
+ * including the order of siblings. */
+static bool same_node(struct yaml_node *a, struct yaml_node *b)
+{
+	const char *as, *bs;
+
+	if (a->type != b->type)
+		return false;
+	if (a->type == yaml_scalar) {
+		as = a->scalar.content;
+		bs = b->scalar.content;
+		return as == bs || (as && bs && strcmp(as, bs) == 0);
+	}
+	if (a->type == yaml_map &&
+	    strcmp(node_name(a, false), node_name(b, false)) != 0)
+		return false;
+
+	return same(get_child(a), get_child(b));
+}
+
+/* Return %true if sibling lists @a and @b have the same structure and
+ * content, including the order of siblings. */
+static bool same(struct yaml_node *a, struct yaml_node *b)
+{
+	for (; a && b; a = a->next, b = b->next) {
+		if (!same_node(a, b))
+			return false;
+	}
+
+	return !a && !b;
+}
+
 static bool is_subset_cb(struct yaml_iter *a, struct yaml_iter *b, void *data)
 {
-	return !!b;
+	struct yaml_hash *ah;
+
+	if (!b)
+		return false;
+
+	/* Skip identical sub-trees. Verify matching hashes to rule out
+	 * collisions. */
+	if (a) {
+		ah = node_hash(a->node);
+		if (!ah->node_dups && ah->node == node_hash(b->node)->node &&
+		    same_node(a->node, b->node))
+			a->skip = true;
+	}
+
+	return true;
 }
 
 /**
@@ -1209,9 +2882,22 @@ static bool is_subset_cb(struct yaml_iter *a, struct yaml_iter *b, void *data)
  *
  * Return %true if all nodes in @a have a counterpart with the same YAML
  * path in @b, %false otherwise.
+ *
+ * Sub-trees of @a that are identical to their counterpart in @b, as
+ * indicated by the same structural hash and verified by comparison, are not
+ * traversed.
  */
 bool yaml_is_subset(struct yaml_node *a, struct yaml_node *b)
 {
+	struct yaml_hash *ah;
+
+	if (!a)
+		return true;
+	ah = list_hash(a);
+	if (b && !ah->list_dups && ah->list == list_hash(b)->list &&
+	    same(a, b))
+		return true;
+
 	return yaml_traverse2(&a, &b, &is_subset_cb, NULL);
 }
 
@@ -1247,9 +2933,25 @@ static bool cmp_cb(struct yaml_iter *a, struct yaml_iter *b, void *data)
  *
  * Return %true if all nodes, including child nodes, in @a are present in @b,
  * %false otherwise.
+ *
+ * Documents with different structural hashes are rejected without traversal.
+ * Documents without duplicate siblings that are identical including sibling
+ * order are accepted without traversal.
  */
 bool yaml_cmp(struct yaml_node *a, struct yaml_node *b)
 {
+	struct yaml_hash *ah, *bh;
+
+	if (!a || !b)
+		return !a && !b;
+
+	ah = list_hash(a);
+	bh = list_hash(b);
+	if (ah->list != bh->list)
+		return false;
+	if (!ah->list_dups && same(a, b))
+		return true;
+
 	return yaml_traverse2(&a, &b, &cmp_cb, NULL);
 }
 
@@ -1275,6 +2977,22 @@ void yaml_set_handled(struct yaml_node *node)
 	set_handled(node, true);
 }
 
+/**
+ * yaml_touch - Notify YAML code of direct document modifications
+ * @node: Node of the modified document, or %NULL
+ *
+ * Lookup indices that speed up yaml_get_node() and related functions, and
+ * structural hashes used by yaml_cmp() and yaml_is_subset() become stale when
+ * sibling lists, mapping keys or scalar values change. Code that modifies these
+ * directly instead of using functions such as yaml_append() or
+ * yaml_iter_replace() must call this function afterwards. Only indices and
+ * hashes of the document containing @node are affected.
+ */
+void yaml_touch(struct yaml_node *node)
+{
+	touch(node);
+}
+
 /**
  * yaml_sanitize_scalar - Print file data as valid YAML block scalar
  *
@@ -32,6 +32,8 @@ enum yaml_type {
 };
 
 struct yaml_node;
+struct yaml_index;
+struct yaml_arena;
 
 struct yaml_scalar_data {
 	char *content;
@@ -58,6 +60,9 @@ struct yaml_node {
 		struct yaml_map_data map;
 	};
 	struct yaml_node *next;
+	struct yaml_index *index;
+	struct yaml_arena *arena;
+	struct yaml_hash *hash;
 };
 
 /**
@@ -68,6 +73,11 @@ struct yaml_node {
  * @parent: Parent node or %NULL
  * @root: Root node
  * @path: Textual path to current node
+ * @skip: Set by callback to skip the child nodes of the current node
+ *
+ * Note: @path points to a buffer owned by the traversal code. It must not be
+ * modified and is only valid until the callback returns. Use
+ * yaml_iter_decoded_path() to obtain a copy.
  */
 struct yaml_iter {
 	struct yaml_node *node;
@@ -75,7 +85,8 @@ struct yaml_iter {
 	struct yaml_node *next;
 	struct yaml_node *parent;
 	struct yaml_node *root;
-	char *path;
+	const char *path;
+	bool skip;
 };
 
 /**
@@ -111,9 +122,46 @@ typedef bool (*yaml_cb_t)(struct yaml_iter *iter, void *data);
 typedef bool (*yaml_cb2_t)(struct yaml_iter *a, struct yaml_iter *b,
 			   void *data);
 
+enum yaml_event_type {
+	yaml_event_scalar,
+	yaml_event_seq_start,
+	yaml_event_seq_end,
+	yaml_event_map_start,
+	yaml_event_map_end,
+};
+
+/**
+ * struct yaml_event - Event reported by yaml_scan_file()
+ * @type: Event type
+ * @path: Textual path of the node in yaml_traverse() format
+ * @content: Scalar content for yaml_event_scalar, mapping key for
+ *           yaml_event_map_start, %NULL otherwise
+ * @filename: Name of file containing the node
+ * @lineno: Line number of the node
+ *
+ * Note: @path and @content are only valid until the callback returns.
+ */
+struct yaml_event {
+	enum yaml_event_type type;
+	const char *path;
+	const char *content;
+	const char *filename;
+	int lineno;
+};
+
+/**
+ * yaml_event_cb_t - Event callback function
+ * @event: Event data
+ * @data: Extra data as passed to yaml_scan_file()
+ *
+ * Return %true if reading should continue, %false to stop reading.
+ */
+typedef bool (*yaml_event_cb_t)(struct yaml_event *event, void *data);
+
 typedef void (*release_fn_t)(void *);
 
 struct yaml_node *yaml_parse_file(const char *fmt, ...);
+bool yaml_scan_file(yaml_event_cb_t cb, void *data, const char *fmt, ...);
 struct yaml_node *yaml_parse_string(const char *name, const char *fmt, ...);
 struct yaml_node *yaml_parse_stream(FILE *fd, const char *name);
 void yaml_free(struct yaml_node *node);
@@ -122,17 +170,23 @@ struct yaml_node *yaml_get_node(struct yaml_node *root, const char *path);
 char *yaml_get_scalar(struct yaml_node *root, const char *path);
 void yaml_check_unhandled(struct yaml_node *root);
 struct yaml_node *yaml_dup(struct yaml_node *node, bool single, bool no_child);
+struct yaml_node *yaml_adopt(struct yaml_node *owner, struct yaml_node *node);
+void yaml_set_scalar(struct yaml_node *node, const char *content);
 struct yaml_node *yaml_append(struct yaml_node *root, struct yaml_node *node);
 void yaml_append_child(struct yaml_node *parent, struct yaml_node *node);
 void yaml_write_stream(struct yaml_node *root, FILE *file, int indent,
 		       bool single);
 bool yaml_write_file(struct yaml_node *root, int indent, bool single,
 		     const char *fmt, ...);
+bool yaml_write_binary(struct yaml_node *root, bool single,
+		       const char *fmt, ...);
+struct yaml_node *yaml_load_binary(const char *fmt, ...);
 bool yaml_traverse(struct yaml_node **root, yaml_cb_t cb, void *data);
 bool yaml_traverse2(struct yaml_node **a, struct yaml_node **b, yaml_cb2_t cb,
 		    void *data);
 void yaml_iter_replace(struct yaml_iter *iter, struct yaml_node *replacement);
 void yaml_iter_del(struct yaml_iter *iter);
+char *yaml_iter_decoded_path(struct yaml_iter *iter);
 char *yaml_canon_path(const char *path);
 void yaml_free_data(struct yaml_node *root, release_fn_t release_fn);
 void yaml_decode_path(char *path);
@@ -141,5 +195,6 @@ bool yaml_cmp(struct yaml_node *a, struct yaml_node *b);
 char *yaml_quote(const char * src);
 void yaml_set_handled(struct yaml_node *node);
 void yaml_sanitize_scalar(FILE *in, FILE *out, int indent, bool escape);
+void yaml_touch(struct yaml_node *node);
 
 #endif /* YAML_H */
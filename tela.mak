@@ -45,12 +45,29 @@ export TELA_LIB      ?= $(LIBEXEC)/lib
 export TELA_WRITELOG  ?= $(LOG)
 export TELA_WRITEDATA ?= $(DATA)
 export TELA_RESFAIL   ?= $(RESFAIL)
+export TELA_OUTPUT_LIMIT ?= $(OUTPUT_LIMIT)
+export TELA_OUTPUT_SPILL ?= $(OUTPUT_SPILL)
+export TELA_CGROUP ?= $(CGROUP)
+export TELA_CGROUP_KILL ?= $(CGROUP_KILL)
+export TELA_PERF ?= $(PERF)
+export TELA_SAMPLE ?= $(SAMPLE)
+export TELA_LOGSYNC ?= $(LOGSYNC)
+export TELA_HISTORY ?= $(if $(HISTORY),$(abspath $(HISTORY)))
+export TELA_PERFCHECK ?= $(PERFCHECK)
+export TELA_PERFCHECK_THRESHOLD ?= $(PERFCHECK_THRESHOLD)
+export TELA_PERFCHECK_CPU ?= $(PERFCHECK_CPU)
+export TELA_PERFCHECK_FAIL ?= $(PERFCHECK_FAIL)
 
 # Log of unprocessed test program output intended for debugging purposes
 ifneq ($(RUNLOG),)
   export TELA_RUNLOG    ?= $(abspath $(RUNLOG))
 endif
 
+# Trace file receiving begin and end events of test run phases
+ifneq ($(TRACE),)
+  export TELA_TRACE     ?= $(abspath $(TRACE))
+endif
+
 # Framework base directory. Used to locate framework components.
 export TELA_FRAMEWORK ?= $(TELADIR)
 
@@ -147,7 +164,7 @@ all_check2: $$(TESTS) $$(addsuffix .all,$$(TELA_SUBDIRS))
 	@$(MAKE) -C $(patsubst %.all,%,$@) all
 
 clean_check: $$(addsuffix .clean,$$(TELA_SUBDIRS))
-	@rm -f test.log test.tgz *.yaml.new
+	@rm -f test.log test.log.idx test.tgz *.yaml.new
 
 %.clean:
 	@$(MAKE) -C $(patsubst %.clean,%,$@) clean